@@ -9,6 +9,8 @@
 #include <linux/types.h>
 #include <lttng/kernel-version.h>
 
+#define LTTNG_TEST_RING_BUFFER_DATA_LEN	60
+
 LTTNG_TRACEPOINT_ENUM(
 	lttng_test_filter_event_enum,
 	TP_ENUM_VALUES(
@@ -55,6 +57,19 @@ LTTNG_TRACEPOINT_EVENT(lttng_test_filter_event,
 	)
 )
 
+/*
+ * Fixed layout event used by the ring buffer tests, which decode the
+ * packets: data[i] holds (seq + i) & 0xff.
+ */
+LTTNG_TRACEPOINT_EVENT(lttng_test_ring_buffer_event,
+	TP_PROTO(uint32_t seq, const uint8_t *data),
+	TP_ARGS(seq, data),
+	TP_FIELDS(
+		ctf_integer(uint32_t, seq, seq)
+		ctf_array(uint8_t, data, data, LTTNG_TEST_RING_BUFFER_DATA_LEN)
+	)
+)
+
 #endif /*  LTTNG_TRACE_LTTNG_TEST_H */
 
 /* This part must be outside protection */
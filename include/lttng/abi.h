@@ -18,7 +18,7 @@
  * should be increased when an incompatible ABI change is done.
  */
 #define LTTNG_KERNEL_ABI_MAJOR_VERSION		2
-#define LTTNG_KERNEL_ABI_MINOR_VERSION		6
+#define LTTNG_KERNEL_ABI_MINOR_VERSION		8
 
 #define LTTNG_KERNEL_ABI_SYM_NAME_LEN		256
 #define LTTNG_KERNEL_ABI_SESSION_NAME_LEN	256
@@ -40,19 +40,56 @@ enum lttng_kernel_abi_instrumentation {
 enum lttng_kernel_abi_output {
 	LTTNG_KERNEL_ABI_SPLICE	= 0,
 	LTTNG_KERNEL_ABI_MMAP	= 1,
+	LTTNG_KERNEL_ABI_READ	= 2,
+};
+
+enum lttng_kernel_abi_backend {
+	LTTNG_KERNEL_ABI_BACKEND_PAGE	= 0,
+	LTTNG_KERNEL_ABI_BACKEND_VMAP	= 1,
+};
+
+/*
+ * Event header layout. By default, the compact header is used when the
+ * channel has fewer than 31 events when the session starts, and the large
+ * header otherwise.
+ */
+enum lttng_kernel_abi_event_header {
+	LTTNG_KERNEL_ABI_EVENT_HEADER_AUTO	= 0,
+	LTTNG_KERNEL_ABI_EVENT_HEADER_COMPACT	= 1,
+	LTTNG_KERNEL_ABI_EVENT_HEADER_LARGE	= 2,
+	LTTNG_KERNEL_ABI_EVENT_HEADER_VARLEN	= 3,	/* Variable length */
+};
+
+/*
+ * Compression of the delivered packets. Compressed packets are read with
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_PACKET.
+ */
+enum lttng_kernel_abi_compression {
+	LTTNG_KERNEL_ABI_COMPRESSION_NONE	= 0,
+	LTTNG_KERNEL_ABI_COMPRESSION_LZ4	= 1,
 };
 
 /*
  * LTTng DebugFS ABI structures.
  */
-#define LTTNG_KERNEL_ABI_CHANNEL_PADDING	LTTNG_KERNEL_ABI_SYM_NAME_LEN + 32
+#define LTTNG_KERNEL_ABI_CHANNEL_PADDING	LTTNG_KERNEL_ABI_SYM_NAME_LEN - 8
 struct lttng_kernel_abi_channel {
 	uint64_t subbuf_size;			/* in bytes */
 	uint64_t num_subbuf;
 	unsigned int switch_timer_interval;	/* usecs */
 	unsigned int read_timer_interval;	/* usecs */
-	uint32_t output;			/* enum lttng_kernel_abi_output (splice, mmap) */
+	uint32_t output;			/* enum lttng_kernel_abi_output (splice, mmap, read) */
 	int overwrite;				/* 1: overwrite, 0: discard */
+	uint32_t backend;			/* enum lttng_kernel_abi_backend (page, vmap) */
+	uint32_t huge_pages;			/* 1: back sub-buffers with huge pages (mmap output) */
+	uint32_t wakeup_watermark;		/* ready sub-buffers waking the reader, 0: off */
+	uint32_t wakeup_watermark_pct;		/* same, in percent of sub-buffers, 0: off */
+	uint32_t switch_timer_max_interval;	/* usecs, adaptive switch timer bound, 0: off */
+	uint32_t lazy_alloc;			/* 1: allocate per-cpu buffers on first write */
+	uint32_t event_id_remap;		/* 1: give compact IDs to frequent events */
+	uint32_t event_header;			/* enum lttng_kernel_abi_event_header */
+	uint32_t sticky_ctx;			/* 1: write per-task contexts only when they change */
+	uint32_t compression;			/* enum lttng_kernel_abi_compression */
 	char padding[LTTNG_KERNEL_ABI_CHANNEL_PADDING];
 } __attribute__((packed));
 
@@ -145,6 +182,26 @@ struct lttng_kernel_abi_event {
 	} u;
 } __attribute__((packed));
 
+/*
+ * Sampling of an event recorder, per cpu: 1 in "period" hits is kept, then
+ * the kept hits go through a token bucket of "burst" tokens refilled at
+ * "rate" tokens per second.
+ */
+#define LTTNG_KERNEL_ABI_EVENT_SAMPLING_PADDING	32
+struct lttng_kernel_abi_event_sampling {
+	uint32_t period;	/* 0 or 1: record all hits */
+	uint32_t rate;		/* Hits per second, 0: no rate limit */
+	uint32_t burst;		/* 0: same as rate */
+	char padding[LTTNG_KERNEL_ABI_EVENT_SAMPLING_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_ABI_EVENT_SAMPLING_STATS_PADDING	32
+struct lttng_kernel_abi_event_sampling_stats {
+	uint64_t skipped_period;	/* output: hits skipped by sampling */
+	uint64_t skipped_rate;		/* output: hits skipped by the rate limit */
+	char padding[LTTNG_KERNEL_ABI_EVENT_SAMPLING_STATS_PADDING];
+} __attribute__((packed));
+
 #define LTTNG_KERNEL_ABI_EVENT_NOTIFIER_PADDING	32
 struct lttng_kernel_abi_event_notifier {
 	struct lttng_kernel_abi_event event;
@@ -321,6 +378,16 @@ struct lttng_kernel_abi_filter_bytecode {
 	char data[0];
 } __attribute__((packed));
 
+/*
+ * Fields recorded by the events of an enabler. The other payload fields
+ * are left out of the events and of their metadata.
+ */
+#define LTTNG_KERNEL_ABI_EVENT_FIELDS_MAX_LEN		65536
+struct lttng_kernel_abi_event_fields {
+	uint32_t len;		/* Length of names, 0: all fields */
+	char names[0];		/* Field names, each followed by '\0' */
+} __attribute__((packed));
+
 #define LTTNG_KERNEL_ABI_CAPTURE_BYTECODE_MAX_LEN		65536
 struct lttng_kernel_abi_capture_bytecode {
 	uint32_t len;
@@ -345,6 +412,35 @@ struct lttng_kernel_abi_tracker_args {
 	int32_t id;
 };
 
+/*
+ * Packet index record of a sub-buffer, as used to build the CTF packet
+ * index. "version" is set to LTTNG_KERNEL_ABI_PACKET_INDEX_VERSION by the
+ * tracer; fields added in later versions are carved from the padding.
+ */
+#define LTTNG_KERNEL_ABI_PACKET_INDEX_VERSION	1
+#define LTTNG_KERNEL_ABI_PACKET_INDEX_PADDING	32
+struct lttng_kernel_abi_packet_index {
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t offset;		/* Position of the packet in the stream */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t content_size;
+	uint64_t packet_size;
+	uint64_t stream_id;
+	uint64_t stream_instance_id;
+	uint64_t seq_num;
+	char padding[LTTNG_KERNEL_ABI_PACKET_INDEX_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_ABI_PACKET_INDEX_BATCH_PADDING	32
+struct lttng_kernel_abi_packet_index_batch {
+	uint64_t entries;		/* User-space array of struct lttng_kernel_abi_packet_index */
+	uint32_t count;			/* In: array length. Out: entries filled. */
+	char padding[LTTNG_KERNEL_ABI_PACKET_INDEX_BATCH_PADDING];
+} __attribute__((packed));
+
 /* LTTng file descriptor ioctl */
 /* lttng/abi-old.h reserve 0x40, 0x41, 0x42, 0x43, and 0x44. */
 #define LTTNG_KERNEL_ABI_SESSION			_IO(0xF6, 0x45)
@@ -413,6 +509,13 @@ struct lttng_kernel_abi_tracker_args {
 #define LTTNG_KERNEL_ABI_FILTER			_IO(0xF6, 0x90)
 #define LTTNG_KERNEL_ABI_ADD_CALLSITE		_IO(0xF6, 0x91)
 
+/* Event enabler FD ioctl */
+#define LTTNG_KERNEL_ABI_EVENT_SAMPLING		\
+	_IOW(0xF6, 0x92, struct lttng_kernel_abi_event_sampling)
+#define LTTNG_KERNEL_ABI_EVENT_SAMPLING_STATS	\
+	_IOR(0xF6, 0x93, struct lttng_kernel_abi_event_sampling_stats)
+#define LTTNG_KERNEL_ABI_EVENT_FIELDS		_IO(0xF6, 0x94)
+
 /* Session FD ioctl (continued) */
 #define LTTNG_KERNEL_ABI_SESSION_LIST_TRACKER_IDS	\
 	_IOW(0xF6, 0xA0, struct lttng_kernel_abi_tracker_args)
@@ -464,6 +567,16 @@ struct lttng_kernel_abi_tracker_args {
 #define LTTNG_KERNEL_ABI_RING_BUFFER_GET_SEQ_NUM		_IOR(0xF6, 0x27, uint64_t)
 /* returns the stream instance id (invariant for the stream) */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_INSTANCE_ID		_IOR(0xF6, 0x28, uint64_t)
+/* returns the packet index record of the current sub-buffer */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_PACKET_INDEX	\
+	_IOR(0xF6, 0x29, struct lttng_kernel_abi_packet_index)
+/*
+ * returns the packet index records of the sub-buffers ready for reading,
+ * starting at the consumer position, without consuming them. No sub-buffer
+ * may be held by the reader. Discard mode channels only.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_PACKET_INDEX_BATCH	\
+	_IOWR(0xF6, 0x2A, struct lttng_kernel_abi_packet_index_batch)
 
 /*
  * Those ioctl numbers use the wrong direction, but are kept for ABI backward
@@ -512,6 +625,12 @@ struct lttng_kernel_abi_tracker_args {
 /* returns the stream instance id (invariant for the stream) */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_INSTANCE_ID	\
 	LTTNG_KERNEL_ABI_RING_BUFFER_INSTANCE_ID
+/* returns the packet index record of the current sub-buffer */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_PACKET_INDEX	\
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_PACKET_INDEX
+/* returns the packet index records of the sub-buffers ready for reading */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_PACKET_INDEX_BATCH	\
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_PACKET_INDEX_BATCH
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LTTNG_ABI_H */
@@ -189,6 +189,13 @@ enum bytecode_op {
 
 	BYTECODE_OP_RETURN_S64			= 99,
 
+	/*
+	 * Internal instructions, generated by the bytecode optimizer.
+	 * Never accepted from user-space.
+	 */
+	BYTECODE_OP_CMP_FIELD_IMM_S64		= 100,
+	BYTECODE_OP_FIELD_IN_RANGES_S64		= 101,
+
 	NR_BYTECODE_OPS,
 };
 
@@ -222,4 +229,25 @@ struct return_op {
 	bytecode_opcode_t op;
 } __attribute__((packed));
 
+/* Compare an integer payload field with an immediate. */
+struct cmp_field_imm_op {
+	bytecode_opcode_t op;
+	bytecode_opcode_t cmp_op;	/* BYTECODE_OP_{EQ,NE,GT,LT,GE,LE}_S64 */
+	bytecode_opcode_t load_op;	/* BYTECODE_OP_LOAD_FIELD_{S,U}{8,16,32,64} */
+	uint16_t offset;		/* Field offset in the interpreter stack data */
+	int64_t v;
+} __attribute__((packed));
+
+/*
+ * Check if an integer payload field is within a table of struct
+ * bytecode_range held in the runtime data.
+ */
+struct field_in_ranges_op {
+	bytecode_opcode_t op;
+	bytecode_opcode_t load_op;	/* BYTECODE_OP_LOAD_FIELD_{S,U}{8,16,32,64} */
+	uint16_t offset;		/* Field offset in the interpreter stack data */
+	uint16_t table;			/* Table offset in the runtime data */
+	uint16_t nr_ranges;		/* Sorted, disjoint and not adjacent */
+} __attribute__((packed));
+
 #endif /* _FILTER_BYTECODE_H */
@@ -8,6 +8,7 @@
 #ifndef _LTTNG_EVENTS_INTERNAL_H
 #define _LTTNG_EVENTS_INTERNAL_H
 
+#include <linux/workqueue.h>
 #include <wrapper/compiler_attributes.h>
 
 #include <lttng/events.h>
@@ -17,6 +18,7 @@ struct lttng_metadata_cache;
 struct perf_event;
 struct perf_event_attr;
 struct lttng_kernel_ring_buffer_config;
+struct lttng_kernel_ring_buffer_channel_attr;
 
 enum lttng_enabler_format_type {
 	LTTNG_ENABLER_FORMAT_STAR_GLOB,
@@ -77,6 +79,8 @@ struct lttng_kernel_event_common_private {
 	int has_enablers_without_filter_bytecode;
 	/* list of struct lttng_kernel_bytecode_runtime, sorted by seqnum */
 	struct list_head filter_bytecode_runtime_head;
+	/* Merged filters (RCU), NULL if evaluated one by one */
+	struct lttng_kernel_filter_set *filter_set;
 	enum lttng_kernel_abi_instrumentation instrumentation;
 	/* Selected by instrumentation */
 	union {
@@ -104,6 +108,12 @@ struct lttng_kernel_event_recorder_private {
 	struct lttng_kernel_ctx *ctx;
 	unsigned int id;
 	unsigned int metadata_dumped:1;
+
+	/* Event ID remapping, see struct lttng_event_id_remap. */
+	unsigned int compact_id;		/* Compact event ID alias */
+	unsigned int compact_gen;		/* Generation of compact_id, 0: no alias */
+	unsigned long __percpu *hits;		/* Per-cpu hit counts */
+	unsigned long hits_sampled;		/* Hit count at last sampling */
 };
 
 struct lttng_kernel_event_notifier_private {
@@ -147,7 +157,7 @@ struct lttng_kernel_channel_buffer_private {
 
 	unsigned int id;			/* Channel ID */
 	unsigned int free_event_id;		/* Next event ID to allocate */
-	int header_type;			/* 0: unset, 1: compact, 2: large */
+	int header_type;			/* 0: unset, 1: compact, 2: large, 3: varlen */
 
 	enum channel_type channel_type;
 	struct lttng_kernel_ctx *ctx;
@@ -155,6 +165,8 @@ struct lttng_kernel_channel_buffer_private {
 	unsigned int metadata_dumped:1;
 	struct list_head node;			/* Channel list in session */
 	struct lttng_transport *transport;
+	struct lttng_event_id_remap *id_remap;	/* NULL if event ID remapping is off */
+	struct lttng_sticky_ctx_state __percpu *sticky_ctx;	/* NULL if sticky context is off */
 };
 
 enum lttng_kernel_bytecode_interpreter_ret {
@@ -199,8 +211,25 @@ struct lttng_kernel_bytecode_runtime {
 				struct lttng_kernel_probe_ctx *lttng_probe_ctx,
 				void *caller_ctx);
 	int link_failed;
+	int duplicate;		/* Same bytecode as an earlier enabled runtime: skipped */
 	struct list_head node;	/* list of bytecode runtime in event */
 	struct lttng_kernel_ctx *ctx;
+	uint64_t payload_fields;	/* Payload fields read (LTTNG_FILTER_FIELD_BIT() mask) */
+};
+
+/*
+ * Filters of an event which all compare the same integer payload field
+ * with a constant, merged into a hash set of the accepted values. See
+ * lttng_bytecode_sync_filters().
+ */
+struct lttng_kernel_filter_set {
+	struct list_head node;		/* Release list */
+	uint8_t load_op;		/* BYTECODE_OP_LOAD_FIELD_{S,U}{8,16,32,64} */
+	uint16_t offset;		/* Field offset in the interpreter stack data */
+	uint64_t payload_fields;	/* Payload fields read (LTTNG_FILTER_FIELD_BIT() mask) */
+	bool accept_zero;		/* Empty slots hold 0 */
+	unsigned int bits;		/* Number of slots is 1 << bits */
+	int64_t values[];
 };
 
 /*
@@ -223,6 +252,9 @@ struct lttng_event_enabler {
 	struct lttng_enabler base;
 	struct list_head node;	/* per-session list of enablers */
 	struct lttng_kernel_channel_buffer *chan;
+	struct lttng_kernel_abi_event_sampling sampling;	/* Zeroed: record all hits */
+	char *fields;		/* Recorded field names, each followed by '\0', NULL: all */
+	uint32_t fields_len;
 };
 
 struct lttng_event_notifier_enabler {
@@ -273,13 +305,49 @@ struct lttng_kernel_ctx_field {
 			struct lttng_ctx_value *value);
 	void (*destroy)(void *priv);
 	void *priv;
+	unsigned int sticky:1;	/* Value seldom changes between events on a CPU */
+	unsigned int reserve_cpu:1;	/* record() writes the reservation cpu */
+
+	/* Computed by lttng_context_update(). */
+	size_t fixed_size;	/* in bytes, 0 if the field size is variable */
+	size_t fixed_align;	/* in bytes */
+	unsigned int sticky_group:1;	/* Part of the sticky context group */
 };
 
+/*
+ * Upper bound on the context length which can be gathered on the stack
+ * and written into the ring buffer as a single chunk.
+ */
+#define LTTNG_KERNEL_CTX_GATHER_MAX	128
+
 struct lttng_kernel_ctx {
 	struct lttng_kernel_ctx_field *fields;
 	unsigned int nr_fields;
 	unsigned int allocated_fields;
 	size_t largest_align;	/* in bytes */
+
+	/* Precomputed layout, updated by lttng_context_update(). */
+	size_t fixed_len;	/* Length from an aligned start if all fields are fixed size */
+	unsigned int all_fixed:1,	/* All fields are fixed size */
+		gather:1;		/* All fields can be gathered through get_value */
+	unsigned int nr_sticky;	/* Number of fields in the sticky group */
+	size_t sticky_len;	/* Length of the sticky group from an aligned start */
+	size_t sticky_align;	/* in bytes */
+};
+
+/*
+ * Per-cpu state of a channel in sticky context mode: the sticky context
+ * group is only written when it differs from the last value written in
+ * the current packet of that cpu.
+ *
+ * Nested events always write the sticky group and bump gen, which
+ * invalidates last[] even when the outer event updates it afterwards.
+ * last[] is valid when valid_gen == gen + 1.
+ */
+struct lttng_sticky_ctx_state {
+	unsigned long gen;
+	unsigned long valid_gen;
+	char last[LTTNG_KERNEL_CTX_GATHER_MAX];
 };
 
 struct lttng_metadata_cache {
@@ -315,7 +383,8 @@ struct lttng_kernel_channel_buffer_ops_private {
 				void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval);
+				unsigned int read_timer_interval,
+				const struct lttng_kernel_ring_buffer_channel_attr *attr);
 	void (*channel_destroy)(struct lttng_kernel_ring_buffer_channel *chan);
 	struct lttng_kernel_ring_buffer *(*buffer_read_open)(struct lttng_kernel_ring_buffer_channel *chan);
 	int (*buffer_has_read_closed_stream)(struct lttng_kernel_ring_buffer_channel *chan);
@@ -450,6 +519,28 @@ struct lttng_counter_transport {
 #define LTTNG_EVENT_HT_BITS		12
 #define LTTNG_EVENT_HT_SIZE		(1U << LTTNG_EVENT_HT_BITS)
 
+/*
+ * Frequency-adaptive event ID remapping.
+ *
+ * The 31 event IDs which fit in the compact event header are kept out of
+ * the creation order ID allocation of the channel. Event hit counts are
+ * sampled periodically, and the most frequent events get a compact ID
+ * alias, declared in the metadata as a second event with the same name and
+ * fields. An alias is used by a buffer starting with the first packet
+ * begun after its declaration. Aliases are never reassigned.
+ */
+#define LTTNG_EVENT_ID_REMAP_NR_COMPACT		31
+#define LTTNG_EVENT_ID_REMAP_PERIOD_MS		1000
+#define LTTNG_EVENT_ID_REMAP_MIN_HITS		1000	/* per period */
+
+struct lttng_event_id_remap {
+	struct delayed_work work;		/* Periodic hit count sampling */
+	struct lttng_kernel_channel_buffer *chan;
+	unsigned int nr_compact;		/* Compact IDs handed out */
+	unsigned int gen;			/* Current remapping generation */
+	unsigned int __percpu *packet_gen;	/* Generation at current packet start, per buffer */
+};
+
 struct lttng_event_ht {
 	struct hlist_head table[LTTNG_EVENT_HT_SIZE];
 };
@@ -794,6 +885,12 @@ int lttng_event_notifier_enabler_disable(
 
 int lttng_event_enabler_attach_filter_bytecode(struct lttng_event_enabler *event_enabler,
 		struct lttng_kernel_abi_filter_bytecode __user *bytecode);
+int lttng_event_enabler_set_sampling(struct lttng_event_enabler *event_enabler,
+		const struct lttng_kernel_abi_event_sampling *param);
+void lttng_event_enabler_sampling_stats(struct lttng_event_enabler *event_enabler,
+		struct lttng_kernel_abi_event_sampling_stats *stats);
+int lttng_event_enabler_set_fields(struct lttng_event_enabler *event_enabler,
+		struct lttng_kernel_abi_event_fields __user *ufields);
 int lttng_event_notifier_enabler_attach_filter_bytecode(
 		struct lttng_event_notifier_enabler *event_notifier_enabler,
 		struct lttng_kernel_abi_filter_bytecode __user *bytecode);
@@ -807,7 +904,11 @@ int lttng_desc_match_enabler(const struct lttng_kernel_event_desc *desc,
 void lttng_enabler_link_bytecode(const struct lttng_kernel_event_desc *event_desc,
 		struct lttng_kernel_ctx *ctx,
 		struct list_head *instance_bytecode_runtime_head,
-		struct list_head *enabler_bytecode_runtime_head);
+		struct list_head *enabler_bytecode_runtime_head,
+		uint64_t *instance_payload_fields);
+void lttng_bytecode_sync_filters(struct lttng_kernel_event_common_private *event_priv,
+		struct list_head *release_list);
+void lttng_bytecode_release_filter_sets(struct list_head *release_list);
 
 #if defined(CONFIG_HAVE_SYSCALL_TRACEPOINTS)
 int lttng_syscalls_register_event(struct lttng_event_enabler *event_enabler);
@@ -1088,6 +1189,10 @@ struct lttng_kernel_channel_buffer *lttng_channel_create(struct lttng_kernel_ses
 				       size_t subbuf_size, size_t num_subbuf,
 				       unsigned int switch_timer_interval,
 				       unsigned int read_timer_interval,
+				       const struct lttng_kernel_ring_buffer_channel_attr *attr,
+				       unsigned int event_id_remap,
+				       int header_type,
+				       unsigned int sticky_ctx,
 				       enum channel_type channel_type);
 struct lttng_kernel_channel_buffer *lttng_global_channel_create(struct lttng_kernel_session *session,
 				       int overwrite, void *buf_addr,
@@ -1171,8 +1276,6 @@ void lttng_clock_unref(void);
 
 void lttng_free_event_filter_runtime(struct lttng_kernel_event_common *event);
 
-int lttng_probes_init(void);
-
 int lttng_logger_init(void);
 void lttng_logger_exit(void);
 
@@ -1193,4 +1296,29 @@ extern const struct file_operations lttng_syscall_list_fops;
 		.priv = (_priv),									\
 	})
 
+/* Same as lttng_kernel_static_ctx_field, for fields eligible to sticky context mode. */
+#define lttng_kernel_static_sticky_ctx_field(_event_field, _get_size, _record, _get_value, _destroy, _priv)	\
+	__LTTNG_COMPOUND_LITERAL(const struct lttng_kernel_ctx_field, {					\
+		.event_field = (_event_field),								\
+		.get_size = (_get_size),								\
+		.record = (_record),									\
+		.get_value = (_get_value),								\
+		.destroy = (_destroy),									\
+		.priv = (_priv),									\
+		.sticky = 1,										\
+	})
+
+/* Same as lttng_kernel_static_sticky_ctx_field, for fields recording the reservation cpu. */
+#define lttng_kernel_static_reserve_cpu_ctx_field(_event_field, _get_size, _record, _get_value, _destroy, _priv)	\
+	__LTTNG_COMPOUND_LITERAL(const struct lttng_kernel_ctx_field, {					\
+		.event_field = (_event_field),								\
+		.get_size = (_get_size),								\
+		.record = (_record),									\
+		.get_value = (_get_value),								\
+		.destroy = (_destroy),									\
+		.priv = (_priv),									\
+		.sticky = 1,										\
+		.reserve_cpu = 1,									\
+	})
+
 #endif /* _LTTNG_EVENTS_INTERNAL_H */
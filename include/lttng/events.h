@@ -16,7 +16,13 @@
 #include <linux/kref.h>
 #include <linux/uuid.h>
 #include <linux/irq_work.h>
+#include <linux/hardirq.h>
+#include <linux/hash.h>
+#include <linux/cred.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
 #include <wrapper/uprobes.h>
+#include <wrapper/user_namespace.h>
 #include <lttng/cpuhotplug.h>
 #include <lttng/tracer.h>
 #include <lttng/abi.h>
@@ -330,6 +336,28 @@ enum lttng_kernel_event_filter_result {
 	LTTNG_KERNEL_EVENT_FILTER_REJECT = 1,
 };
 
+/*
+ * Bit of a payload field, indexed among the fields available to filters,
+ * in a mask of fields laid out on the interpreter stack. Bit 63 stands
+ * for all the fields from index 63 on.
+ */
+#define LTTNG_FILTER_FIELD_BIT(_idx)	(1ULL << ((_idx) < 63 ? (_idx) : 63))
+
+/*
+ * Bit of a field of an event class, indexed in its array of fields, in the
+ * mask of fields not recorded by an event recorder. Bit 63 stands for all
+ * the fields from index 63 on.
+ */
+#define LTTNG_EVENT_FIELD_BIT(_idx)	LTTNG_FILTER_FIELD_BIT(_idx)
+
+/*
+ * Filter context passed to the run_filter() callback by the probes. A
+ * NULL filter context means all the fields are laid out.
+ */
+struct lttng_kernel_event_filter_ctx {
+	uint64_t payload_fields;		/* Fields laid out on the stack */
+};
+
 struct lttng_kernel_event_common_private;
 
 enum lttng_kernel_event_type {
@@ -345,6 +373,7 @@ struct lttng_kernel_event_common {
 
 	int enabled;
 	int eval_filter;				/* Need to evaluate filters */
+	uint64_t filter_payload_fields;			/* Fields read by the filters */
 	int (*run_filter)(const struct lttng_kernel_event_common *event,
 		const char *stack_data,
 		struct lttng_kernel_probe_ctx *probe_ctx,
@@ -358,6 +387,35 @@ struct lttng_kernel_event_recorder {
 	struct lttng_kernel_event_recorder_private *priv;	/* Private event record interface */
 
 	struct lttng_kernel_channel_buffer *chan;
+	const void *fanout_key;			/* Shared by the recorders of a tracepoint, NULL: no fan-out */
+	struct lttng_event_sampling *sampling;	/* NULL: record all hits */
+	uint64_t skip_fields;			/* Fields not recorded, see LTTNG_EVENT_FIELD_BIT() */
+};
+
+/*
+ * Sampling state of an event recorder on a cpu. Updated without atomics:
+ * a hit nested in another hit of the same event on the same cpu (interrupt
+ * or NMI) may be miscounted.
+ */
+struct lttng_event_sampling_state {
+	unsigned long count;		/* Hits since the last sampled hit */
+	uint64_t credit;		/* Token bucket level, in ns */
+	uint64_t last;			/* Last token bucket refill, in ns */
+	unsigned long skipped_period;	/* Hits skipped by sampling */
+	unsigned long skipped_rate;	/* Hits skipped by the rate limit */
+};
+
+/*
+ * Sampling parameters of an event recorder, fixed once its metadata is
+ * dumped. The token bucket counts time: a hit costs 1/rate second.
+ */
+struct lttng_event_sampling {
+	unsigned int period;		/* Record 1 in period hits, 1: all */
+	unsigned int rate;		/* Hits per second, 0: no rate limit */
+	unsigned int burst;
+	uint64_t cost;			/* NSEC_PER_SEC / rate */
+	uint64_t max_credit;		/* burst * cost */
+	struct lttng_event_sampling_state __percpu *state;
 };
 
 struct lttng_kernel_notification_ctx {
@@ -433,6 +491,90 @@ struct lttng_dynamic_len_stack {
 
 DECLARE_PER_CPU(struct lttng_dynamic_len_stack, lttng_dynamic_len_stack);
 
+/*
+ * Payload fan-out. When several recorders are attached to a tracepoint,
+ * the first one called for a hit serializes the payload into a per-cpu
+ * scratch area which the others copy into their channel. There is one
+ * scratch area per context level (task, softirq, irq, nmi), as a hit can
+ * nest within a hit of the same tracepoint only from a higher level.
+ */
+#define LTTNG_FANOUT_SCRATCH_LEN	1024
+#define LTTNG_FANOUT_NR_LEVELS		4
+#define LTTNG_FANOUT_MAX_RECORDERS	8
+
+struct lttng_fanout_scratch {
+	const void *key;			/* fanout_key of the hit recorders */
+	unsigned long gen;			/* lttng_fanout_gen of the hit */
+	const struct lttng_kernel_event_recorder *seen[LTTNG_FANOUT_MAX_RECORDERS];
+	unsigned int nr_seen;			/* Recorders called for the hit */
+	int valid;				/* Payload serialized */
+	size_t len;				/* Payload size */
+	size_t align;				/* Payload alignment */
+	char data[LTTNG_FANOUT_SCRATCH_LEN] __attribute__((aligned(sizeof(uint64_t))));
+};
+
+struct lttng_fanout_percpu {
+	struct lttng_fanout_scratch level[LTTNG_FANOUT_NR_LEVELS];
+};
+
+extern struct lttng_fanout_percpu __percpu *lttng_fanout_percpu;
+extern unsigned long lttng_fanout_gen;
+extern struct lttng_kernel_channel_buffer lttng_fanout_chan;
+
+static inline
+unsigned int lttng_fanout_level(void)
+{
+	if (in_nmi())
+		return 3;
+	if (hardirq_count())
+		return 2;
+	if (in_serving_softirq())
+		return 1;
+	return 0;
+}
+
+/*
+ * Called on entry of the probe of a recorder, before any early return,
+ * so every recorder called for a hit is seen. Each recorder is called
+ * once per hit: calling one already seen means a new hit. A recorder
+ * getting a key after (un)registrations sees the generation bumped after
+ * its key was set. Starting over is always safe, it only costs a new
+ * serialization. Returns the scratch area, or NULL if the recorder does
+ * not share its payload.
+ */
+static inline
+struct lttng_fanout_scratch *lttng_fanout_enter(const struct lttng_kernel_event_recorder *event_recorder)
+{
+	const void *key = READ_ONCE(event_recorder->fanout_key);
+	struct lttng_fanout_scratch *scratch;
+	unsigned long gen;
+	unsigned int i;
+
+	if (likely(!key))
+		return NULL;
+	/* Read the key before the generation. */
+	smp_rmb();
+	gen = READ_ONCE(lttng_fanout_gen);
+	scratch = &this_cpu_ptr(lttng_fanout_percpu)->level[lttng_fanout_level()];
+	if (scratch->key != key || scratch->gen != gen
+			|| scratch->nr_seen >= LTTNG_FANOUT_MAX_RECORDERS)
+		goto new_hit;
+	for (i = 0; i < scratch->nr_seen; i++) {
+		if (scratch->seen[i] == event_recorder)
+			goto new_hit;
+	}
+	scratch->seen[scratch->nr_seen++] = event_recorder;
+	return scratch;
+
+new_hit:
+	scratch->key = key;
+	scratch->gen = gen;
+	scratch->seen[0] = event_recorder;
+	scratch->nr_seen = 1;
+	scratch->valid = 0;
+	return scratch;
+}
+
 /*
  * struct lttng_kernel_id_tracker declared in header due to deferencing of *v
  * in RCU_INITIALIZER(v).
@@ -450,6 +592,29 @@ struct lttng_kernel_id_tracker {
 	struct lttng_kernel_id_tracker_rcu *p;	/* RCU dereferenced. */
 };
 
+/*
+ * Tracker verdict of a task for a session. The process IDs of a task are
+ * fixed for its lifetime, but its uid and gid, and their values in its
+ * user namespace, change with its credentials: the verdict is keyed on
+ * the task, its pid, these IDs, and on the session tracker generation.
+ * Credentials are not compared by address, as a freed cred can be
+ * reallocated at the same address with other IDs.
+ */
+struct lttng_tracker_verdict {
+	const struct task_struct *task;
+	pid_t pid;
+	uid_t uid, vuid;
+	gid_t gid, vgid;
+	bool track;
+	unsigned long gen;		/* Session tracker_gen, 0: invalid */
+};
+
+#define LTTNG_TRACKER_CACHE_BITS	4
+
+struct lttng_tracker_cache {
+	struct lttng_tracker_verdict verdict[1U << LTTNG_TRACKER_CACHE_BITS];
+};
+
 struct lttng_kernel_session_private;
 
 struct lttng_kernel_session {
@@ -463,11 +628,79 @@ struct lttng_kernel_session {
 	struct lttng_kernel_id_tracker vuid_tracker;
 	struct lttng_kernel_id_tracker gid_tracker;
 	struct lttng_kernel_id_tracker vgid_tracker;
+
+	int tracker_active;		/* At least one tracker restricts the IDs */
+	unsigned long tracker_gen;	/* Bumped on tracker changes */
+	struct lttng_tracker_cache __percpu *tracker_cache;
 };
 
 int lttng_kernel_probe_register(struct lttng_kernel_probe_desc *desc);
 void lttng_kernel_probe_unregister(struct lttng_kernel_probe_desc *desc);
 
 bool lttng_id_tracker_lookup(struct lttng_kernel_id_tracker_rcu *p, int id);
+bool lttng_session_track_current_slow(struct lttng_kernel_session *session,
+		struct lttng_tracker_verdict *verdict, unsigned long gen);
+
+/*
+ * Whether the session trackers let the current task be traced. Called
+ * with preemption disabled.
+ */
+static inline
+bool lttng_session_track_current(struct lttng_kernel_session *session)
+{
+	struct lttng_tracker_verdict *verdict;
+	unsigned long gen;
+
+	if (likely(!READ_ONCE(session->tracker_active)))
+		return true;
+	gen = READ_ONCE(session->tracker_gen);
+	verdict = &this_cpu_ptr(session->tracker_cache)->verdict[
+			hash_ptr(current, LTTNG_TRACKER_CACHE_BITS)];
+	if (likely(verdict->gen == gen && verdict->task == current
+			&& verdict->pid == current->pid
+			&& verdict->uid == lttng_current_uid()
+			&& verdict->gid == lttng_current_gid()
+			&& verdict->vuid == lttng_current_vuid()
+			&& verdict->vgid == lttng_current_vgid()))
+		return verdict->track;
+	return lttng_session_track_current_slow(session, verdict, gen);
+}
+
+/*
+ * Whether the sampling and rate limit of an event recorder let the current
+ * hit be recorded. Called with preemption disabled.
+ */
+static inline
+bool lttng_event_recorder_sample(struct lttng_kernel_event_recorder *event_recorder)
+{
+	struct lttng_event_sampling *sampling = READ_ONCE(event_recorder->sampling);
+	struct lttng_event_sampling_state *state;
+
+	if (likely(!sampling))
+		return true;
+	state = this_cpu_ptr(sampling->state);
+	if (sampling->period > 1) {
+		if (++state->count < sampling->period) {
+			state->skipped_period++;
+			return false;
+		}
+		state->count = 0;
+	}
+	if (sampling->rate) {
+		uint64_t now = ktime_get_mono_fast_ns(), credit;
+
+		credit = state->credit + (now - state->last);
+		state->last = now;
+		if (credit > sampling->max_credit)
+			credit = sampling->max_credit;
+		if (credit < sampling->cost) {
+			state->credit = credit;
+			state->skipped_rate++;
+			return false;
+		}
+		state->credit = credit - sampling->cost;
+	}
+	return true;
+}
 
 #endif /* _LTTNG_EVENTS_H */
@@ -41,6 +41,14 @@ struct bytecode_runtime {
 	size_t data_len;
 	size_t data_alloc_len;
 	char *data;
+	/* Native code compiled from the bytecode, NULL if interpreted. */
+	int (*jit_func)(const char *interpreter_stack_data);
+	size_t jit_len;		/* Size of the jit_func image */
+	/* Shared link result, owns data when set. */
+	struct bytecode_link_cache *link_cache;
+	/* Rewritten by the optimizer: may contain internal instructions. */
+	bool optimized;
+	uint32_t content_hash;	/* Hash of the bytecode before linking */
 	uint16_t len;
 	char code[0];
 };
@@ -105,6 +113,12 @@ struct bytecode_get_index_data {
 	} elem;
 };
 
+/* Entry of a BYTECODE_OP_FIELD_IN_RANGES_S64 table, bounds included. */
+struct bytecode_range {
+	int64_t min;
+	int64_t max;
+};
+
 /* Validation stack */
 struct vstack_load {
 	enum load_type type;
@@ -289,6 +303,9 @@ void lttng_bytecode_sync_state(struct lttng_kernel_bytecode_runtime *runtime);
 int lttng_bytecode_validate(struct bytecode_runtime *bytecode);
 int lttng_bytecode_specialize(const struct lttng_kernel_event_desc *event_desc,
 		struct bytecode_runtime *bytecode);
+ssize_t bytecode_push_data(struct bytecode_runtime *runtime,
+		const void *p, size_t align, size_t len);
+int lttng_bytecode_optimize(struct bytecode_runtime *bytecode);
 
 int lttng_bytecode_interpret_error(struct lttng_kernel_bytecode_runtime *bytecode_runtime,
 		const char *stack_data,
@@ -300,4 +317,11 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
 		void *caller_ctx);
 
+int lttng_bytecode_jit_compile(struct bytecode_runtime *bytecode);
+void lttng_bytecode_jit_free(struct bytecode_runtime *bytecode);
+int lttng_bytecode_jit_interpret(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx);
+
 #endif /* _LTTNG_FILTER_H */
@@ -396,22 +396,31 @@ static __used struct lttng_kernel_probe_desc TP_ID(__probe_desc___, TRACE_SYSTEM
 /*
  * Stage 4 of the trace events.
  *
- * Create static inline function that calculates event size.
+ * Create static inline function that calculates event size. The fields
+ * skipped by the event recorder (see LTTNG_EVENT_FIELD_BIT()) are not
+ * counted. Nowrite fields are only counted in the field index.
  */
 
 /* Reset all macros within TRACEPOINT_EVENT */
 #include <lttng/events-reset.h>
 #include <lttng/events-write.h>
+#include <lttng/events-nowrite.h>
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
-	__event_len += sizeof(_type);
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
+		__event_len += sizeof(_type);				       \
+	}								       \
+	__field_idx++;
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
-	__event_len += sizeof(_type) * (_length);
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
+		__event_len += sizeof(_type) * (_length);		       \
+	}								       \
+	__field_idx++;
 
 #undef _ctf_array_bitfield
 #define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
@@ -420,18 +429,20 @@ static __used struct lttng_kernel_probe_desc TP_ID(__probe_desc___, TRACE_SYSTEM
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _length_type,			\
 			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_length_type)); \
-	__event_len += sizeof(_length_type);				       \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
-	{										\
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
 		size_t __seqlen = (_src_length);					\
 											\
+		__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_length_type)); \
+		__event_len += sizeof(_length_type);				       \
+		__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
 		if (unlikely(++this_cpu_ptr(&lttng_dynamic_len_stack)->offset >= LTTNG_DYNAMIC_LEN_STACK_SIZE)) \
 			goto error;							\
 		barrier();	/* reserve before use. */				\
 		this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = __seqlen; \
 		__event_len += sizeof(_type) * __seqlen;				\
-	}
+	}									\
+	/* Length and sequence fields. */					\
+	__field_idx += 2;
 
 #undef _ctf_sequence_bitfield
 #define _ctf_sequence_bitfield(_type, _item, _src,		\
@@ -446,16 +457,19 @@ static __used struct lttng_kernel_probe_desc TP_ID(__probe_desc___, TRACE_SYSTEM
  */
 #undef _ctf_string
 #define _ctf_string(_item, _src, _user, _nowrite)			       \
-	if (unlikely(++this_cpu_ptr(&lttng_dynamic_len_stack)->offset >= LTTNG_DYNAMIC_LEN_STACK_SIZE)) \
-		goto error;						       \
-	barrier();	/* reserve before use. */			       \
-	if (_user) {							       \
-		__event_len += this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = \
-			max_t(size_t, lttng_strlen_user_inatomic(_src), 1);    \
-	} else {							       \
-		__event_len += this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = \
-			strlen((_src) ? (_src) : __LTTNG_NULL_STRING) + 1; \
-	}
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		if (unlikely(++this_cpu_ptr(&lttng_dynamic_len_stack)->offset >= LTTNG_DYNAMIC_LEN_STACK_SIZE)) \
+			goto error;					       \
+		barrier();	/* reserve before use. */		       \
+		if (_user) {						       \
+			__event_len += this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = \
+				max_t(size_t, lttng_strlen_user_inatomic(_src), 1); \
+		} else {						       \
+			__event_len += this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = \
+				strlen((_src) ? (_src) : __LTTNG_NULL_STRING) + 1; \
+		}							       \
+	}								       \
+	__field_idx++;
 
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		       \
@@ -465,11 +479,19 @@ static __used struct lttng_kernel_probe_desc TP_ID(__probe_desc___, TRACE_SYSTEM
 #define ctf_align(_type)						\
 	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type));
 
+/*
+ * The fields of the custom code are written as a whole: they are not
+ * indexed.
+ */
 #undef ctf_custom_field
 #define ctf_custom_field(_type, _item, _code)				\
-	{								\
+	if (!(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) {	\
+		uint64_t __skip_fields __attribute__((unused)) = 0;	\
+		unsigned int __field_idx __attribute__((unused)) = 0;	\
+									\
 		_code							\
-	}
+	}								\
+	__field_idx++;
 
 #undef ctf_custom_code
 #define ctf_custom_code(...)		__VA_ARGS__
@@ -485,10 +507,12 @@ static __used struct lttng_kernel_probe_desc TP_ID(__probe_desc___, TRACE_SYSTEM
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
-static inline ssize_t __event_get_size__##_name(void *__tp_locvar, _proto)     \
+static inline ssize_t __event_get_size__##_name(uint64_t __skip_fields,	      \
+		void *__tp_locvar, _proto)					      \
 {									      \
 	size_t __event_len = 0;						      \
 	unsigned int __dynamic_len_idx __attribute__((unused)) = 0;	      \
+	unsigned int __field_idx __attribute__((unused)) = 0;		      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
@@ -501,10 +525,12 @@ error:									      \
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
-static inline ssize_t __event_get_size__##_name(void *__tp_locvar)	      \
+static inline ssize_t __event_get_size__##_name(uint64_t __skip_fields,	      \
+		void *__tp_locvar)						      \
 {									      \
 	size_t __event_len = 0;						      \
 	unsigned int __dynamic_len_idx __attribute__((unused)) = 0;	      \
+	unsigned int __field_idx __attribute__((unused)) = 0;		      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
@@ -522,7 +548,9 @@ error:									      \
  * Stage 4.1 of tracepoint event generation.
  *
  * Create static inline function that layout the filter stack data.
- * We make both write and nowrite data available to the filter.
+ * We make both write and nowrite data available to the filter. Only the
+ * fields in the __fields mask (see LTTNG_FILTER_FIELD_BIT()) are fetched,
+ * the stack layout stays the same.
  */
 
 /* Reset all macros within TRACEPOINT_EVENT */
@@ -606,8 +634,7 @@ error:									      \
 			BUG_ON(1);					       \
 		};							       \
 		memcpy(__stack_data, &__ctf_tmp_uint64, sizeof(uint64_t));     \
-	}								       \
-	__stack_data += sizeof(int64_t);
+	}
 
 #undef _ctf_integer_ext_isuser0
 #define _ctf_integer_ext_isuser0(_type, _item, _src, _byte_order, _base, _nowrite) \
@@ -628,18 +655,23 @@ error:									      \
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _user_src, _byte_order, _base, _user, _nowrite) \
-	_ctf_integer_ext_isuser##_user(_type, _item, _user_src, _byte_order, _base, _nowrite)
+	if (__fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {		       \
+		_ctf_integer_ext_isuser##_user(_type, _item, _user_src, _byte_order, _base, _nowrite) \
+	}								       \
+	__stack_data += sizeof(int64_t);				       \
+	__field_idx++;
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
-	{								       \
+	if (__fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {		       \
 		unsigned long __ctf_tmp_ulong = (unsigned long) (_length);     \
 		const void *__ctf_tmp_ptr = (_src);			       \
 		memcpy(__stack_data, &__ctf_tmp_ulong, sizeof(unsigned long)); \
-		__stack_data += sizeof(unsigned long);			       \
-		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+		memcpy(__stack_data + sizeof(unsigned long), &__ctf_tmp_ptr,   \
+			sizeof(void *));				       \
+	}								       \
+	__stack_data += sizeof(unsigned long) + sizeof(void *);	       \
+	__field_idx++;
 
 #undef _ctf_array_bitfield
 #define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
@@ -648,14 +680,15 @@ error:									      \
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _length_type,		       \
 			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
-	{								       \
+	if (__fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {		       \
 		unsigned long __ctf_tmp_ulong = (unsigned long) (_src_length); \
 		const void *__ctf_tmp_ptr = (_src);			       \
 		memcpy(__stack_data, &__ctf_tmp_ulong, sizeof(unsigned long)); \
-		__stack_data += sizeof(unsigned long);			       \
-		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+		memcpy(__stack_data + sizeof(unsigned long), &__ctf_tmp_ptr,   \
+			sizeof(void *));				       \
+	}								       \
+	__stack_data += sizeof(unsigned long) + sizeof(void *);	       \
+	__field_idx++;
 
 #undef _ctf_sequence_bitfield
 #define _ctf_sequence_bitfield(_type, _item, _src,		\
@@ -666,12 +699,13 @@ error:									      \
 
 #undef _ctf_string
 #define _ctf_string(_item, _src, _user, _nowrite)			       \
-	{								       \
+	if (__fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {		       \
 		const void *__ctf_tmp_ptr =				       \
 			((_src) ? (_src) : __LTTNG_NULL_STRING);	       \
 		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+	}								       \
+	__stack_data += sizeof(void *);					       \
+	__field_idx++;
 
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		       \
@@ -690,9 +724,10 @@ error:									      \
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
 static inline								      \
 void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
-		void *__tp_locvar)					      \
+		uint64_t __fields, void *__tp_locvar)			      \
 {									      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+	unsigned int __field_idx __attribute__((unused)) = 0;		      \
 									      \
 	_fields								      \
 }
@@ -701,9 +736,10 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
 static inline								      \
 void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
-		void *__tp_locvar, _proto)				      \
+		uint64_t __fields, void *__tp_locvar, _proto)		      \
 {									      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+	unsigned int __field_idx __attribute__((unused)) = 0;		      \
 									      \
 	_fields								      \
 }
@@ -713,20 +749,26 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 /*
  * Stage 5 of the trace events.
  *
- * Create static inline function that calculates event payload alignment.
+ * Create static inline function that calculates event payload alignment,
+ * over the fields recorded by the event recorder.
  */
 
 /* Reset all macros within TRACEPOINT_EVENT */
 #include <lttng/events-reset.h>
 #include <lttng/events-write.h>
+#include <lttng/events-nowrite.h>
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
-	__event_align = max_t(size_t, __event_align, lttng_alignof(_type));
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) \
+		__event_align = max_t(size_t, __event_align, lttng_alignof(_type)); \
+	__field_idx++;
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
-	__event_align = max_t(size_t, __event_align, lttng_alignof(_type));
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) \
+		__event_align = max_t(size_t, __event_align, lttng_alignof(_type)); \
+	__field_idx++;
 
 #undef _ctf_array_bitfield
 #define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
@@ -735,8 +777,11 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _length_type,			\
 			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
-	__event_align = max_t(size_t, __event_align, lttng_alignof(_length_type)); \
-	__event_align = max_t(size_t, __event_align, lttng_alignof(_type));
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		__event_align = max_t(size_t, __event_align, lttng_alignof(_length_type)); \
+		__event_align = max_t(size_t, __event_align, lttng_alignof(_type)); \
+	}									\
+	__field_idx += 2;
 
 #undef _ctf_sequence_bitfield
 #define _ctf_sequence_bitfield(_type, _item, _src,		\
@@ -746,7 +791,8 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 		none, __LITTLE_ENDIAN, 10, _user, _nowrite)
 
 #undef _ctf_string
-#define _ctf_string(_item, _src, _user, _nowrite)
+#define _ctf_string(_item, _src, _user, _nowrite)			\
+	__field_idx++;
 
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)	\
@@ -766,7 +812,14 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 #define TP_locvar(...)	__VA_ARGS__
 
 #undef ctf_custom_field
-#define ctf_custom_field(_type, _item, _code)		_code
+#define ctf_custom_field(_type, _item, _code)				\
+	if (!(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) {	\
+		uint64_t __skip_fields __attribute__((unused)) = 0;	\
+		unsigned int __field_idx __attribute__((unused)) = 0;	\
+									\
+		_code							\
+	}								\
+	__field_idx++;
 
 #undef ctf_custom_code
 #define ctf_custom_code(...)						\
@@ -776,9 +829,11 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
-static inline size_t __event_get_align__##_name(void *__tp_locvar, _proto)    \
+static inline size_t __event_get_align__##_name(uint64_t __skip_fields,     \
+		void *__tp_locvar, _proto)					      \
 {									      \
 	size_t __event_align = 1;					      \
+	unsigned int __field_idx __attribute__((unused)) = 0;		      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
@@ -787,9 +842,11 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar, _proto)    \
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
-static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
+static inline size_t __event_get_align__##_name(uint64_t __skip_fields,     \
+		void *__tp_locvar)						      \
 {									      \
 	size_t __event_align = 1;					      \
+	unsigned int __field_idx __attribute__((unused)) = 0;		      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
@@ -802,12 +859,14 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
  * Stage 6 of tracepoint event generation.
  *
  * Create the probe function. This function calls event size calculation
- * and writes event data into the buffer.
+ * and writes event data into the buffer. Only the fields recorded by the
+ * event recorder are written.
  */
 
 /* Reset all macros within TRACEPOINT_EVENT */
 #include <lttng/events-reset.h>
 #include <lttng/events-write.h>
+#include <lttng/events-nowrite.h>
 
 #undef _ctf_integer_ext_fetched
 #define _ctf_integer_ext_fetched(_type, _item, _src, _byte_order, _base, _nowrite) \
@@ -835,11 +894,16 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _user_src, _byte_order, _base, _user, _nowrite) \
-	_ctf_integer_ext_isuser##_user(_type, _item, _user_src, _byte_order, _base, _nowrite)
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		_ctf_integer_ext_isuser##_user(_type, _item, _user_src, _byte_order, _base, _nowrite) \
+	}								\
+	__field_idx++;
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
-	if (lttng_kernel_string_encoding_##_encoding == lttng_kernel_string_encoding_none) { \
+	if (_nowrite || (__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		/* Not recorded. */							\
+	} else if (lttng_kernel_string_encoding_##_encoding == lttng_kernel_string_encoding_none) { \
 		if (_user) {								\
 			__chan->ops->event_write_from_user(&__ctx, _src, sizeof(_type) * (_length), lttng_alignof(_type)); \
 		} else {								\
@@ -851,26 +915,31 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 		} else {								\
 			__chan->ops->event_pstrcpy_pad(&__ctx, (const char *) (_src), _length); \
 		}									\
-	}
+	}										\
+	__field_idx++;
 
 #if (__BYTE_ORDER == __LITTLE_ENDIAN)
 #undef _ctf_array_bitfield
 #define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
-	if (_user) {							\
+	if (_nowrite || (__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		/* Not recorded. */					\
+	} else if (_user) {						\
 		__chan->ops->event_write_from_user(&__ctx, _src, sizeof(_type) * (_length), lttng_alignof(_type)); \
 	} else {							\
 		__chan->ops->event_write(&__ctx, _src, sizeof(_type) * (_length), lttng_alignof(_type)); \
-	}
+	}								\
+	__field_idx++;
 #else /* #if (__BYTE_ORDER == __LITTLE_ENDIAN) */
 /*
  * For big endian, we need to byteswap into little endian.
  */
 #undef _ctf_array_bitfield
 #define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
-	lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_type));	\
-	{								\
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
 		size_t _i;						\
 									\
+		lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_type)); \
+									\
 		for (_i = 0; _i < (_length); _i++) {			\
 			_type _tmp;					\
 									\
@@ -897,50 +966,53 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 			}						\
 			__chan->ops->event_write(&__ctx, &_tmp, sizeof(_type), 1); \
 		}							\
-	}
+	}								\
+	__field_idx++;
 #endif /* #else #if (__BYTE_ORDER == __LITTLE_ENDIAN) */
 
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _length_type,			\
 			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
-	{									\
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
 		_length_type __tmpl = this_cpu_ptr(&lttng_dynamic_len_stack)->stack[__dynamic_len_idx]; \
 		__chan->ops->event_write(&__ctx, &__tmpl, sizeof(_length_type), lttng_alignof(_length_type));\
-	}									\
-	if (lttng_kernel_string_encoding_##_encoding == lttng_kernel_string_encoding_none) { \
-		if (_user) {							\
-			__chan->ops->event_write_from_user(&__ctx, _src,	\
-				sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type));	\
+		if (lttng_kernel_string_encoding_##_encoding == lttng_kernel_string_encoding_none) { \
+			if (_user) {						\
+				__chan->ops->event_write_from_user(&__ctx, _src, \
+					sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type)); \
+			} else {						\
+				__chan->ops->event_write(&__ctx, _src,		\
+					sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type)); \
+			}							\
 		} else {							\
-			__chan->ops->event_write(&__ctx, _src,			\
-				sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type));	\
+			if (_user) {						\
+				__chan->ops->event_pstrcpy_pad_from_user(&__ctx, (const char __user *) (_src), \
+					__get_dynamic_len(dest));		\
+			} else {						\
+				__chan->ops->event_pstrcpy_pad(&__ctx, (const char *) (_src), \
+					__get_dynamic_len(dest));		\
+			}							\
 		}								\
-	} else {								\
-		if (_user) {							\
-			__chan->ops->event_pstrcpy_pad_from_user(&__ctx, (const char __user *) (_src), \
-				__get_dynamic_len(dest));			\
-		} else {							\
-			__chan->ops->event_pstrcpy_pad(&__ctx, (const char *) (_src), \
-				__get_dynamic_len(dest));			\
-		}								\
-	}
+	}									\
+	__field_idx += 2;
 
 #if (__BYTE_ORDER == __LITTLE_ENDIAN)
 #undef _ctf_sequence_bitfield
 #define _ctf_sequence_bitfield(_type, _item, _src,		\
 			_length_type, _src_length,		\
 			_user, _nowrite)			\
-	{								\
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
 		_length_type __tmpl = this_cpu_ptr(&lttng_dynamic_len_stack)->stack[__dynamic_len_idx] * sizeof(_type) * CHAR_BIT; \
 		__chan->ops->event_write(&__ctx, &__tmpl, sizeof(_length_type), lttng_alignof(_length_type)); \
+		if (_user) {						\
+			__chan->ops->event_write_from_user(&__ctx, _src, \
+				sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type)); \
+		} else {						\
+			__chan->ops->event_write(&__ctx, _src,		\
+				sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type)); \
+		}							\
 	}								\
-	if (_user) {							\
-		__chan->ops->event_write_from_user(&__ctx, _src,	\
-			sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type));	\
-	} else {							\
-		__chan->ops->event_write(&__ctx, _src,			\
-			sizeof(_type) * __get_dynamic_len(dest), lttng_alignof(_type));	\
-	}
+	__field_idx += 2;
 #else /* #if (__BYTE_ORDER == __LITTLE_ENDIAN) */
 /*
  * For big endian, we need to byteswap into little endian.
@@ -949,14 +1021,12 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 #define _ctf_sequence_bitfield(_type, _item, _src,		\
 			_length_type, _src_length,		\
 			_user, _nowrite)			\
-	{							\
+	if (!_nowrite && !(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
 		_length_type __tmpl = this_cpu_ptr(&lttng_dynamic_len_stack)->stack[__dynamic_len_idx] * sizeof(_type) * CHAR_BIT; \
-		__chan->ops->event_write(&__ctx, &__tmpl, sizeof(_length_type), lttng_alignof(_length_type)); \
-	}								\
-	lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_type));	\
-	{								\
 		size_t _i, _length;					\
 									\
+		__chan->ops->event_write(&__ctx, &__tmpl, sizeof(_length_type), lttng_alignof(_length_type)); \
+		lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_type)); \
 		_length = __get_dynamic_len(dest);			\
 		for (_i = 0; _i < _length; _i++) {			\
 			_type _tmp;					\
@@ -984,12 +1054,15 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 			}						\
 			__chan->ops->event_write(&__ctx, &_tmp, sizeof(_type), 1); \
 		}							\
-	}
+	}								\
+	__field_idx += 2;
 #endif /* #else #if (__BYTE_ORDER == __LITTLE_ENDIAN) */
 
 #undef _ctf_string
 #define _ctf_string(_item, _src, _user, _nowrite)		        \
-	if (_user) {							\
+	if (_nowrite || (__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) { \
+		/* Not recorded. */					\
+	} else if (_user) {						\
 		lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(*(_src))); \
 		__chan->ops->event_strcpy_from_user(&__ctx, _src,	\
 			__get_dynamic_len(dest));			\
@@ -1000,7 +1073,8 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 			lttng_alignof(*__ctf_tmp_string));		\
 		__chan->ops->event_strcpy(&__ctx, __ctf_tmp_string,	\
 			__get_dynamic_len(dest));			\
-	}
+	}								\
+	__field_idx++;
 
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
@@ -1011,7 +1085,14 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 	lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_type));
 
 #undef ctf_custom_field
-#define ctf_custom_field(_type, _item, _code)		_code
+#define ctf_custom_field(_type, _item, _code)				\
+	if (!(__skip_fields & LTTNG_EVENT_FIELD_BIT(__field_idx))) {	\
+		uint64_t __skip_fields __attribute__((unused)) = 0;	\
+		unsigned int __field_idx __attribute__((unused)) = 0;	\
+									\
+		_code							\
+	}								\
+	__field_idx++;
 
 #undef ctf_custom_code
 #define ctf_custom_code(...)						\
@@ -1077,7 +1158,8 @@ static void __event_probe__##_name(_data_proto)						\
 	struct probe_local_vars __tp_locvar;						\
 	struct probe_local_vars *tp_locvar __attribute__((unused)) =			\
 			&__tp_locvar;							\
-	bool __interpreter_stack_prepared = false;					\
+	struct lttng_kernel_event_filter_ctx __filter_ctx = { 0 };			\
+	struct lttng_fanout_scratch *__fanout = NULL;					\
 											\
 	switch (__event->type) {							\
 	case LTTNG_KERNEL_EVENT_TYPE_RECORDER:						\
@@ -1086,35 +1168,15 @@ static void __event_probe__##_name(_data_proto)						\
 			container_of(__event, struct lttng_kernel_event_recorder, parent); \
 		struct lttng_kernel_channel_buffer *__chan = __event_recorder->chan;	\
 		struct lttng_kernel_session *__session = __chan->parent.session;	\
-		struct lttng_kernel_id_tracker_rcu *__lf;				\
 											\
+		__fanout = lttng_fanout_enter(__event_recorder);			\
 		if (!_TP_SESSION_CHECK(session, __session))				\
 			return;								\
 		if (unlikely(!LTTNG_READ_ONCE(__session->active)))			\
 			return;								\
 		if (unlikely(!LTTNG_READ_ONCE(__chan->parent.enabled)))			\
 			return;								\
-		__lf = lttng_rcu_dereference(__session->pid_tracker.p);			\
-		if (__lf && likely(!lttng_id_tracker_lookup(__lf, current->tgid)))	\
-			return;								\
-		__lf = lttng_rcu_dereference(__session->vpid_tracker.p);		\
-		if (__lf && likely(!lttng_id_tracker_lookup(__lf, task_tgid_vnr(current)))) \
-			return;								\
-		__lf = lttng_rcu_dereference(__session->uid_tracker.p);			\
-		if (__lf && likely(!lttng_id_tracker_lookup(__lf,			\
-				lttng_current_uid())))					\
-			return;								\
-		__lf = lttng_rcu_dereference(__session->vuid_tracker.p);		\
-		if (__lf && likely(!lttng_id_tracker_lookup(__lf,			\
-				lttng_current_vuid())))					\
-			return;								\
-		__lf = lttng_rcu_dereference(__session->gid_tracker.p);			\
-		if (__lf && likely(!lttng_id_tracker_lookup(__lf,			\
-				lttng_current_gid())))					\
-			return;								\
-		__lf = lttng_rcu_dereference(__session->vgid_tracker.p);		\
-		if (__lf && likely(!lttng_id_tracker_lookup(__lf,			\
-				lttng_current_vgid())))					\
+		if (!lttng_session_track_current(__session))				\
 			return;								\
 		break;									\
 	}										\
@@ -1125,15 +1187,21 @@ static void __event_probe__##_name(_data_proto)						\
 	}										\
 	if (unlikely(!READ_ONCE(__event->enabled)))					\
 		return;									\
+	if (__event->type == LTTNG_KERNEL_EVENT_TYPE_RECORDER				\
+			&& !lttng_event_recorder_sample(container_of(__event,		\
+				struct lttng_kernel_event_recorder, parent)))		\
+		return;									\
 	__orig_dynamic_len_offset = this_cpu_ptr(&lttng_dynamic_len_stack)->offset;	\
 	__dynamic_len_idx = __orig_dynamic_len_offset;					\
 	_code_pre									\
 	if (unlikely(READ_ONCE(__event->eval_filter))) {				\
+		/* Only lay out the fields read by the filters. */			\
+		__filter_ctx.payload_fields = READ_ONCE(__event->filter_payload_fields); \
 		__event_prepare_interpreter_stack__##_name(__stackvar.__interpreter_stack_data, \
-				_locvar_args);						\
-		__interpreter_stack_prepared = true;					\
+				__filter_ctx.payload_fields, _locvar_args);		\
 		if (likely(__event->run_filter(__event,			      		\
-				__stackvar.__interpreter_stack_data, &__lttng_probe_ctx, NULL) != LTTNG_KERNEL_EVENT_FILTER_ACCEPT)) \
+				__stackvar.__interpreter_stack_data, &__lttng_probe_ctx, \
+				&__filter_ctx) != LTTNG_KERNEL_EVENT_FILTER_ACCEPT))	\
 			goto __post;							\
 	}										\
 	switch (__event->type) {							\
@@ -1142,17 +1210,52 @@ static void __event_probe__##_name(_data_proto)						\
 		struct lttng_kernel_event_recorder *__event_recorder =			\
 			container_of(__event, struct lttng_kernel_event_recorder, parent); \
 		struct lttng_kernel_channel_buffer *__chan = __event_recorder->chan;	\
+		uint64_t __skip_fields = __event_recorder->skip_fields;		\
+		unsigned int __field_idx __attribute__((unused)) = 0;		\
 		struct lttng_kernel_ring_buffer_ctx __ctx;				\
 		ssize_t __event_len;							\
 		size_t __event_align;							\
 		int __ret;								\
 											\
-		__event_len = __event_get_size__##_name(_locvar_args);			\
+		if (__fanout && __fanout->valid) {					\
+			/* Payload serialized by a previous recorder of this hit. */	\
+			lib_ring_buffer_ctx_init(&__ctx, __event_recorder, __fanout->len, \
+						 __fanout->align, &__lttng_probe_ctx);	\
+			__ret = __chan->ops->event_reserve(&__ctx);			\
+			if (__ret < 0)							\
+				goto __post;						\
+			__chan->ops->event_write(&__ctx, __fanout->data, __fanout->len, 1); \
+			__chan->ops->event_commit(&__ctx);				\
+			break;								\
+		}									\
+		__event_len = __event_get_size__##_name(__skip_fields, _locvar_args);	\
 		if (unlikely(__event_len < 0)) {					\
 			__chan->ops->lost_event_too_big(__chan);			\
 			goto __post;							\
 		}									\
-		__event_align = __event_get_align__##_name(_locvar_args);		\
+		__event_align = __event_get_align__##_name(__skip_fields, _locvar_args); \
+		if (__fanout && __event_len <= LTTNG_FANOUT_SCRATCH_LEN) {		\
+			/* First recorder of this hit: serialize into the scratch area. */ \
+			lib_ring_buffer_ctx_init(&__ctx, __fanout, __event_len,		\
+						 __event_align, &__lttng_probe_ctx);	\
+			__ctx.priv.buf_offset = 0;					\
+			{								\
+				struct lttng_kernel_channel_buffer *__chan = &lttng_fanout_chan; \
+											\
+				_fields							\
+			}								\
+			__fanout->len = __event_len;					\
+			__fanout->align = __event_align;				\
+			__fanout->valid = 1;						\
+			lib_ring_buffer_ctx_init(&__ctx, __event_recorder, __event_len,	\
+						 __event_align, &__lttng_probe_ctx);	\
+			__ret = __chan->ops->event_reserve(&__ctx);			\
+			if (__ret < 0)							\
+				goto __post;						\
+			__chan->ops->event_write(&__ctx, __fanout->data, __event_len, 1); \
+			__chan->ops->event_commit(&__ctx);				\
+			break;								\
+		}									\
 		lib_ring_buffer_ctx_init(&__ctx, __event_recorder, __event_len,		\
 					 __event_align, &__lttng_probe_ctx);		\
 		__ret = __chan->ops->event_reserve(&__ctx);				\
@@ -1169,10 +1272,11 @@ static void __event_probe__##_name(_data_proto)						\
 		struct lttng_kernel_notification_ctx __notif_ctx;			\
 											\
 		__notif_ctx.eval_capture = LTTNG_READ_ONCE(__event_notifier->eval_capture); \
-		if (unlikely(!__interpreter_stack_prepared && __notif_ctx.eval_capture)) \
+		/* Captures read any field. */						\
+		if (unlikely(__filter_ctx.payload_fields != ~0ULL && __notif_ctx.eval_capture)) \
 			__event_prepare_interpreter_stack__##_name(			\
 					__stackvar.__interpreter_stack_data,		\
-					_locvar_args);					\
+					~0ULL, _locvar_args);				\
 											\
 		__event_notifier->notification_send(__event_notifier,			\
 				__stackvar.__interpreter_stack_data,			\
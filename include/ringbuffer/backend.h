@@ -77,7 +77,6 @@ void lib_ring_buffer_write(const struct lttng_kernel_ring_buffer_config *config,
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 
@@ -86,13 +85,11 @@ void lib_ring_buffer_write(const struct lttng_kernel_ring_buffer_config *config,
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len))
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len)))
 		lib_ring_buffer_do_copy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
+			lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset),
+			src, len);
 	else
 		_lib_ring_buffer_write(bufb, offset, src, len);
 	ctx->priv.buf_offset += len;
@@ -118,7 +115,6 @@ void lib_ring_buffer_memset(const struct lttng_kernel_ring_buffer_config *config
 
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 
@@ -127,12 +123,11 @@ void lib_ring_buffer_memset(const struct lttng_kernel_ring_buffer_config *config
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len))
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					  + (offset & ~PAGE_MASK),
-					  c, len);
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len)))
+		lib_ring_buffer_do_memset(
+			lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset),
+			c, len);
 	else
 		_lib_ring_buffer_memset(bufb, offset, c, len);
 	ctx->priv.buf_offset += len;
@@ -215,7 +210,6 @@ void lib_ring_buffer_strcpy(const struct lttng_kernel_ring_buffer_config *config
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 
@@ -224,29 +218,21 @@ void lib_ring_buffer_strcpy(const struct lttng_kernel_ring_buffer_config *config
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len))) {
+		char *dest = lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset);
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+					dest, src, len - 1);
 		/* Padding */
 		if (unlikely(count < len - 1)) {
 			size_t pad_len = len - 1 - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest + count, pad, pad_len);
 		}
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest + len - 1, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy(bufb, offset, src, len, pad);
 	}
@@ -281,7 +267,6 @@ void lib_ring_buffer_pstrcpy(const struct lttng_kernel_ring_buffer_config *confi
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 
@@ -290,24 +275,18 @@ void lib_ring_buffer_pstrcpy(const struct lttng_kernel_ring_buffer_config *confi
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len))) {
+		char *dest = lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset);
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
-		offset += count;
+					dest, src, len);
 		/* Padding */
 		if (unlikely(count < len)) {
 			size_t pad_len = len - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest + count, pad, pad_len);
 		}
 	} else {
 		_lib_ring_buffer_pstrcpy(bufb, offset, src, len, pad);
@@ -335,7 +314,6 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lttng_kernel_ring_buff
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 	unsigned long ret;
@@ -345,16 +323,15 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lttng_kernel_ring_buff
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
 
 	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
 	pagefault_disable();
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len))) {
 		ret = lib_ring_buffer_do_copy_from_user_inatomic(
-			backend_pages->p[index].virt + (offset & ~PAGE_MASK),
+			lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset),
 			src, len);
 		if (unlikely(ret > 0)) {
 			/* Copy failed. */
@@ -404,7 +381,6 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lttng_kernel_ring_bu
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 
@@ -413,34 +389,26 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lttng_kernel_ring_bu
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
 
 	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
 	pagefault_disable();
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len))) {
+		char *dest = lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset);
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+					dest, src, len - 1);
 		/* Padding */
 		if (unlikely(count < len - 1)) {
 			size_t pad_len = len - 1 - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest + count, pad, pad_len);
 		}
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest + len - 1, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy_from_user_inatomic(bufb, offset, src,
 					len, pad);
@@ -489,7 +457,6 @@ void lib_ring_buffer_pstrcpy_from_user_inatomic(const struct lttng_kernel_ring_b
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
 
@@ -498,29 +465,23 @@ void lib_ring_buffer_pstrcpy_from_user_inatomic(const struct lttng_kernel_ring_b
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
 
 	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
 	pagefault_disable();
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(lib_ring_buffer_backend_write_fits(config, offset, len))) {
+		char *dest = lib_ring_buffer_backend_write_addr(config, chanb,
+				backend_pages, offset);
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
-		offset += count;
+					dest, src, len);
 		/* Padding */
 		if (unlikely(count < len)) {
 			size_t pad_len = len - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest + count, pad, pad_len);
 		}
 	} else {
 		_lib_ring_buffer_pstrcpy_from_user_inatomic(bufb, offset, src, len, pad);
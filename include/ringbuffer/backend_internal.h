@@ -10,6 +10,7 @@
 #ifndef _LIB_RING_BUFFER_BACKEND_INTERNAL_H
 #define _LIB_RING_BUFFER_BACKEND_INTERNAL_H
 
+#include <wrapper/barrier.h>
 #include <wrapper/compiler.h>
 #include <wrapper/inline_memcpy.h>
 #include <ringbuffer/config.h>
@@ -26,6 +27,7 @@ int lib_ring_buffer_backend_create(struct lttng_kernel_ring_buffer_backend *bufb
 				   struct channel_backend *chan, int cpu);
 void channel_backend_unregister_notifiers(struct channel_backend *chanb);
 void lib_ring_buffer_backend_free(struct lttng_kernel_ring_buffer_backend *bufb);
+int lib_ring_buffer_backend_populate(struct lttng_kernel_ring_buffer_backend *bufb);
 int channel_backend_init(struct channel_backend *chanb,
 			 const char *name,
 			 const struct lttng_kernel_ring_buffer_config *config,
@@ -36,7 +38,6 @@ void channel_backend_free(struct channel_backend *chanb);
 void lib_ring_buffer_backend_reset(struct lttng_kernel_ring_buffer_backend *bufb);
 void channel_backend_reset(struct channel_backend *chanb);
 
-int lib_ring_buffer_backend_init(void);
 void lib_ring_buffer_backend_exit(void);
 
 extern void _lib_ring_buffer_write(struct lttng_kernel_ring_buffer_backend *bufb,
@@ -189,6 +190,33 @@ int subbuffer_id_check_index(const struct lttng_kernel_ring_buffer_config *confi
 		return 0;
 }
 
+/*
+ * Lazy allocation is only implemented for per-cpu buffers backed by pages.
+ */
+static inline
+int lib_ring_buffer_backend_lazy(const struct lttng_kernel_ring_buffer_config *config,
+				 const struct channel_backend *chanb)
+{
+	return chanb->attr.lazy_alloc && config->backend == RING_BUFFER_PAGE
+		&& config->alloc == RING_BUFFER_ALLOC_PER_CPU;
+}
+
+/*
+ * Returns whether the pages of writer sub-buffer @idx can be written to.
+ * Until a lazily allocated buffer is populated, only the emergency sub-buffer
+ * (backend pages index 0) has pages. Pairs with the release store in
+ * lib_ring_buffer_backend_populate().
+ */
+static inline
+int lib_ring_buffer_backend_subbuf_ready(const struct lttng_kernel_ring_buffer_config *config,
+					 struct lttng_kernel_ring_buffer_backend *bufb,
+					 unsigned long idx)
+{
+	if (likely(lttng_smp_load_acquire(&bufb->populated)))
+		return 1;
+	return subbuffer_id_get_index(config, bufb->buf_wsb[idx].id) == 0;
+}
+
 static inline
 void lib_ring_buffer_backend_get_pages(const struct lttng_kernel_ring_buffer_config *config,
 			struct lttng_kernel_ring_buffer_ctx *ctx,
@@ -220,6 +248,40 @@ struct lttng_kernel_ring_buffer_backend_pages *
 	return ctx->priv.backend_pages;
 }
 
+/*
+ * Address of the (buf_size masked) @offset within sub-buffer @backend_pages.
+ * The vmap backend maps each sub-buffer contiguously, so the address is
+ * computed from the sub-buffer base rather than from the page array.
+ */
+static inline
+void *lib_ring_buffer_backend_write_addr(const struct lttng_kernel_ring_buffer_config *config,
+		struct channel_backend *chanb,
+		struct lttng_kernel_ring_buffer_backend_pages *backend_pages,
+		size_t offset)
+{
+	size_t sb_offset = offset & (chanb->subbuf_size - 1);
+
+	if (config->backend == RING_BUFFER_VMAP)
+		return backend_pages->virt + sb_offset;
+	return backend_pages->p[sb_offset >> PAGE_SHIFT].virt
+		+ (offset & ~PAGE_MASK);
+}
+
+/*
+ * Returns true if @len bytes can be written at @offset with a single copy.
+ * Reservations never cross a sub-buffer boundary, so this is always the case
+ * with the vmap backend. The page backend needs the slow path whenever the
+ * write crosses a page boundary.
+ */
+static inline
+bool lib_ring_buffer_backend_write_fits(const struct lttng_kernel_ring_buffer_config *config,
+		size_t offset, size_t len)
+{
+	if (config->backend == RING_BUFFER_VMAP)
+		return true;
+	return min_t(size_t, len, (-offset) & ~PAGE_MASK) == len;
+}
+
 /*
  * The ring buffer can count events recorded and overwritten per buffer,
  * but it is disabled by default due to its performance overhead.
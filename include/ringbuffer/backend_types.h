@@ -25,6 +25,7 @@ struct lttng_kernel_ring_buffer_backend_pages {
 	union v_atomic records_commit;	/* current records committed count */
 	union v_atomic records_unread;	/* records to read */
 	unsigned long data_size;	/* Amount of data to read from subbuf */
+	void *virt;			/* subbuf virtual address (vmap backend) */
 	struct lttng_kernel_ring_buffer_backend_page p[];
 };
 
@@ -62,11 +63,13 @@ struct lttng_kernel_ring_buffer_backend {
 	 */
 	struct lttng_kernel_ring_buffer_backend_pages **array;
 	unsigned int num_pages_per_subbuf;
+	void *virt;			/* Contiguous mapping (vmap backend) */
 
 	struct lttng_kernel_ring_buffer_channel *chan;		/* Associated channel */
 	int cpu;			/* This buffer's cpu. -1 if global. */
 	union v_atomic records_read;	/* Number of records read */
 	unsigned int allocated:1;	/* is buffer allocated ? */
+	int populated;			/* are all buffer pages allocated ? */
 };
 
 struct channel_backend {
@@ -97,6 +100,7 @@ struct channel_backend {
 	 * channel's streams is released.
 	 */
 	struct lttng_kernel_ring_buffer_config config; /* Ring buffer configuration */
+	struct lttng_kernel_ring_buffer_channel_attr attr; /* Channel attributes */
 	cpumask_var_t cpumask;		/* Allocated per-cpu buffers cpumask */
 	char name[NAME_MAX];		/* Channel name */
 };
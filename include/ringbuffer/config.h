@@ -108,6 +108,24 @@ struct lttng_kernel_ring_buffer_client_cb {
  *
  * RING_BUFFER_WAKEUP_NONE does not perform any wakeup whatsoever. The client
  * has the responsibility to perform wakeups.
+ *
+ * output:
+ *
+ * RING_BUFFER_READ lets readers consume whole sub-buffers with read(2). Each
+ * call copies as many complete, page-padded sub-buffers as fit in the user
+ * buffer, so a single system call can consume many packets.
+ *
+ * backend:
+ *
+ * RING_BUFFER_PAGE keeps an array of individual pages for each sub-buffer.
+ * Records crossing a page boundary are written by the out-of-line slow path.
+ *
+ * RING_BUFFER_VMAP allocates the same pages, but also maps the whole buffer
+ * into a virtually contiguous kernel area. Each sub-buffer is contiguous in
+ * that mapping, so writes never need to be split on page boundaries: the
+ * fast path is a single copy whatever the record size. It uses vmalloc
+ * address space, which is scarce on 32-bit architectures. It cannot be used
+ * with RING_BUFFER_SPLICE output, which gives the reader pages away.
  */
 struct lttng_kernel_ring_buffer_config {
 	enum {
@@ -125,13 +143,13 @@ struct lttng_kernel_ring_buffer_config {
 	enum {
 		RING_BUFFER_SPLICE,
 		RING_BUFFER_MMAP,
-		RING_BUFFER_READ,		/* TODO */
+		RING_BUFFER_READ,
 		RING_BUFFER_ITERATOR,
 		RING_BUFFER_NONE,
 	} output;
 	enum {
 		RING_BUFFER_PAGE,
-		RING_BUFFER_VMAP,		/* TODO */
+		RING_BUFFER_VMAP,
 		RING_BUFFER_STATIC,		/* TODO */
 	} backend;
 	enum {
@@ -157,6 +175,45 @@ struct lttng_kernel_ring_buffer_config {
 	struct lttng_kernel_ring_buffer_client_cb cb;
 };
 
+/*
+ * Channel attributes selected at channel creation time.
+ *
+ * Unlike the static configuration above, those attributes are not known
+ * when the client is compiled. They only affect channel setup and the
+ * slow paths, never the tracing fast path.
+ *
+ * huge_pages: back sub-buffers with huge pages (HPAGE_PMD_SIZE) when
+ *   sub-buffers are at least that large and the page allocator can
+ *   provide them. Falls back to order-0 pages otherwise.
+ *
+ * wakeup_watermark, wakeup_watermark_pct: wake up readers from the writer
+ *   as soon as this number of sub-buffers (or this percentage of the
+ *   sub-buffers) are ready for reading, once per consumer position
+ *   update. When both are set, the lowest one applies. 0 disables the
+ *   watermark. The read timer, if any, keeps running and bounds the wakeup
+ *   latency for data below the watermark.
+ *
+ * switch_timer_max_interval: enable the adaptive switch timer. Each buffer
+ *   switch timer period is then adjusted between the channel
+ *   switch_timer_interval and this value (in us), following the amount of
+ *   data written in the buffer between ticks. 0 keeps a fixed period.
+ *
+ * lazy_alloc: only allocate the first sub-buffer of each per-cpu buffer at
+ *   creation. The rest of the buffer pages are allocated from a workqueue the
+ *   first time the buffer is written to. Until then, the first sub-buffer
+ *   acts as an emergency sub-buffer, and records which do not fit in it are
+ *   accounted as lost. Only applies to the page backend with per-cpu
+ *   buffers.
+ */
+struct lttng_kernel_ring_buffer_channel_attr {
+	unsigned int huge_pages:1;
+	unsigned int lazy_alloc:1;
+	unsigned int compress:1;	/* LZ4 compression of delivered packets */
+	unsigned int wakeup_watermark;
+	unsigned int wakeup_watermark_pct;
+	unsigned int switch_timer_max_interval;
+};
+
 /*
  * ring buffer private context
  *
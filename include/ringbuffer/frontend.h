@@ -49,6 +49,9 @@
  * buf_addr is a pointer the the beginning of the preallocated buffer contiguous
  * address mapping. It is used only by RING_BUFFER_STATIC configuration. It can
  * be set to NULL for other backends.
+ *
+ * attr holds the channel attributes chosen at creation time. It can be set
+ * to NULL to use the defaults.
  */
 
 extern
@@ -57,7 +60,8 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 			       void *buf_addr,
 			       size_t subbuf_size, size_t num_subbuf,
 			       unsigned int switch_timer_interval,
-			       unsigned int read_timer_interval);
+			       unsigned int read_timer_interval,
+			       const struct lttng_kernel_ring_buffer_channel_attr *attr);
 
 /*
  * channel_destroy returns the private data pointer. It finalizes all channel's
@@ -130,6 +134,21 @@ static inline void lib_ring_buffer_put_next_subbuf(struct lttng_kernel_ring_buff
 						    buf->backend.chan));
 }
 
+/*
+ * Batched variants of lib_ring_buffer_get_next_subbuf/put_next_subbuf, holding
+ * up to *count consecutive sub-buffers starting at buf->cons_snapshot.
+ */
+extern int lib_ring_buffer_get_next_subbufs(struct lttng_kernel_ring_buffer *buf,
+					    unsigned long *count);
+extern void lib_ring_buffer_put_next_subbufs(struct lttng_kernel_ring_buffer *buf);
+
+/*
+ * Stream control area, letting mmap consumers drain the buffer without
+ * ioctls. See LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT.
+ */
+extern int lib_ring_buffer_ctrl_open(struct lttng_kernel_ring_buffer *buf);
+extern size_t lib_ring_buffer_ctrl_len(struct lttng_kernel_ring_buffer_channel *chan);
+
 extern void channel_reset(struct lttng_kernel_ring_buffer_channel *chan);
 extern void lib_ring_buffer_reset(struct lttng_kernel_ring_buffer *buf);
 
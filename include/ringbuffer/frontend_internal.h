@@ -74,7 +74,8 @@ unsigned long subbuf_index(unsigned long offset, struct lttng_kernel_ring_buffer
  * Last TSC comparison functions. Check if the current TSC overflows tsc_bits
  * bits from the last TSC read. When overflows are detected, the full 64-bit
  * timestamp counter should be written in the record header. Reads and writes
- * last_tsc atomically.
+ * last_tsc atomically. last_tsc_fits() checks whether readers can rebuild the
+ * current TSC from its @bits low-order bits.
  */
 
 #if (BITS_PER_LONG == 32)
@@ -107,6 +108,21 @@ int last_tsc_overflow(const struct lttng_kernel_ring_buffer_config *config,
 	else
 		return 0;
 }
+
+/*
+ * Only the bits above tsc_bits are saved: narrower timestamps cannot be
+ * checked.
+ */
+static inline
+int last_tsc_fits(const struct lttng_kernel_ring_buffer_config *config,
+		  struct lttng_kernel_ring_buffer *buf, u64 tsc,
+		  unsigned int bits)
+{
+	if (config->tsc_bits == 0 || config->tsc_bits == 64
+			|| bits < config->tsc_bits)
+		return 0;
+	return !last_tsc_overflow(config, buf, tsc);
+}
 #else
 static inline
 void save_last_tsc(const struct lttng_kernel_ring_buffer_config *config,
@@ -131,6 +147,16 @@ int last_tsc_overflow(const struct lttng_kernel_ring_buffer_config *config,
 	else
 		return 0;
 }
+
+static inline
+int last_tsc_fits(const struct lttng_kernel_ring_buffer_config *config,
+		  struct lttng_kernel_ring_buffer *buf, u64 tsc,
+		  unsigned int bits)
+{
+	if (config->tsc_bits == 0 || config->tsc_bits == 64)
+		return 0;
+	return !((tsc - v_read(config, &buf->last_tsc)) >> bits);
+}
 #endif
 
 extern
@@ -328,6 +354,12 @@ extern int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 				  struct channel_backend *chanb, int cpu);
 extern void lib_ring_buffer_free(struct lttng_kernel_ring_buffer *buf);
 
+/* Packet compression (ring_buffer_compress.c) */
+extern int lib_ring_buffer_compress_create(struct lttng_kernel_ring_buffer *buf, int cpu);
+extern void lib_ring_buffer_compress_free(struct lttng_kernel_ring_buffer *buf);
+extern void lib_ring_buffer_compress_deliver(struct lttng_kernel_ring_buffer *buf);
+extern void lib_ring_buffer_compress_consumed(struct lttng_kernel_ring_buffer *buf);
+
 /* Keep track of trap nesting inside ring buffer code */
 DECLARE_PER_CPU(unsigned int, lib_ring_buffer_nesting);
 
@@ -14,10 +14,13 @@
 
 #include <linux/kref.h>
 #include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
 #include <ringbuffer/config.h>
 #include <ringbuffer/backend_types.h>
 #include <lttng/prio_heap.h>	/* For per-CPU read-side iterator */
 #include <lttng/cpuhotplug.h>
+#include <lttng/kernel-version.h>
 
 /*
  * A switch is done during tracing or as a final flush after tracing (so it
@@ -53,7 +56,9 @@ struct lttng_kernel_ring_buffer_channel {
 	struct channel_backend backend;		/* Associated backend */
 
 	unsigned long switch_timer_interval;	/* Buffer flush (jiffies) */
+	unsigned long switch_timer_max_interval;	/* Adaptive flush bound (jiffies), 0: off */
 	unsigned long read_timer_interval;	/* Reader wakeup (jiffies) */
+	unsigned long wakeup_watermark;		/* Ready sub-buffers waking readers, 0: off */
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0))
 	struct lttng_cpuhp_node cpuhp_prepare;
 	struct lttng_cpuhp_node cpuhp_online;
@@ -102,6 +107,28 @@ struct lttng_kernel_ring_buffer_iter {
 	unsigned int read_open:1;	/* Opened for reading ? */
 };
 
+/*
+ * LZ4 compression of delivered packets, see ring_buffer_compress.c. Needs
+ * the LZ4 API of Linux 4.11: channels cannot request it otherwise.
+ */
+#if (IS_ENABLED(CONFIG_LZ4_COMPRESS) && \
+	LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,11,0))
+#define LTTNG_RING_BUFFER_COMPRESS
+#endif
+
+struct lttng_kernel_ring_buffer_compress {
+	struct lttng_kernel_ring_buffer *buf;	/* Compressed buffer */
+	struct irq_work pending;	/* Compression requested by a writer */
+	struct work_struct work;	/* Compresses the next packet to read */
+	struct mutex lock;		/* Protects the fields below */
+	void *wrkmem;			/* LZ4 work memory */
+	void *linear;			/* Linear copy of the packet (page backend) */
+	void *data;			/* Compressed packet */
+	size_t data_alloc;		/* Size of data */
+	size_t data_len;		/* Compressed packet size */
+	unsigned long offset;		/* Position of the compressed packet, -1UL if none */
+};
+
 /* ring buffer state */
 struct lttng_kernel_ring_buffer {
 	/* First 32 bytes cache-hot cacheline */
@@ -149,14 +176,28 @@ struct lttng_kernel_ring_buffer {
 	wait_queue_head_t read_wait;	/* reader buffer-level wait queue */
 	wait_queue_head_t write_wait;	/* writer buffer-level wait queue (for metadata only) */
 	struct irq_work wakeup_pending;		/* Pending wakeup irq work */
+	struct irq_work populate_pending;	/* Pending lazy allocation irq work */
+	struct work_struct populate_work;	/* Lazy allocation of the buffer pages */
+	int populate_queued;		/* lazy allocation requested */
 	int finalized;			/* buffer has been finalized */
+	int wakeup_watermark_hit;	/* watermark wakeup issued since last consume */
 	struct timer_list switch_timer;	/* timer for periodical switch */
+	unsigned long switch_timer_period;	/* current switch period (jiffies) */
+	unsigned long switch_timer_offset;	/* write offset at last switch tick */
 	struct timer_list read_timer;	/* timer for read poll */
 	raw_spinlock_t raw_tick_nohz_spinlock;	/* nohz entry lock/trylock */
 	struct lttng_kernel_ring_buffer_iter iter;	/* read-side iterator */
 	unsigned long get_subbuf_consumed;	/* Read-side consumed */
+	unsigned long get_subbuf_count;	/* Sub-buffers held by reader */
 	unsigned long prod_snapshot;	/* Producer count snapshot */
 	unsigned long cons_snapshot;	/* Consumer count snapshot */
+	void *ctrl_area;		/*
+					 * Consumer cursor page followed by
+					 * the control pages, shared with
+					 * user-space (mmap output only).
+					 */
+	struct lttng_kernel_ring_buffer_compress *compress;
+					/* Packet compression, NULL if off */
 	unsigned int get_subbuf:1,	/* Sub-buffer being held by reader */
 		switch_timer_enabled:1,	/* Protected by ring_buffer_nohz_lock */
 		read_timer_enabled:1,	/* Protected by ring_buffer_nohz_lock */
@@ -34,6 +34,8 @@ ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 		unsigned int flags, struct lttng_kernel_ring_buffer *buf);
 int lib_ring_buffer_mmap(struct file *filp, struct vm_area_struct *vma,
 		struct lttng_kernel_ring_buffer *buf);
+ssize_t lib_ring_buffer_subbuf_read(struct file *filp, char __user *user_buf,
+		size_t count, struct lttng_kernel_ring_buffer *buf);
 
 /* Ring Buffer ioctl() and ioctl numbers */
 long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
@@ -48,10 +50,115 @@ ssize_t vfs_lib_ring_buffer_file_splice_read(struct file *in, loff_t *ppos,
 loff_t vfs_lib_ring_buffer_no_llseek(struct file *file, loff_t offset,
 		int origin);
 int vfs_lib_ring_buffer_mmap(struct file *filp, struct vm_area_struct *vma);
+ssize_t vfs_lib_ring_buffer_subbuf_read(struct file *filp,
+		char __user *user_buf, size_t count, loff_t *ppos);
 ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 		struct pipe_inode_info *pipe, size_t len,
 		unsigned int flags);
 
+/*
+ * Stream control area.
+ *
+ * Streams using mmap output can expose a control area which lets a consumer
+ * drain the buffer without issuing ioctls in steady state. It is set up by
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT, which returns where its two
+ * parts live within the stream file mapping offsets:
+ *
+ * - The control pages (read-only mapping), which the tracer updates each time
+ *   a sub-buffer is delivered. Entry (pos / subbuf_size) % num_subbuf of
+ *   subbuf[] describes the packet starting at position "pos": it is ready to
+ *   be read when its "end" field equals pos + subbuf_size. Its content is
+ *   then found at "mmap_offset" within the data mapping, and "data_size"
+ *   bytes long (PAGE_ALIGN(data_size) when padded). In discard mode, the
+ *   whole data mapping can be accessed once the control area is set up.
+ * - The consumer cursor page (read-write mapping). In discard mode, the
+ *   tracer reads the cursor "consumed" position before it reuses a
+ *   sub-buffer, so storing the end position of the last packet read into it
+ *   releases the sub-buffers up to that position. Values which are not
+ *   sub-buffer aligned, move backwards, or go past the write position are
+ *   ignored.
+ *
+ * The position fields are free-running byte counts. The control pages are
+ * published with release semantic: a consumer must read "end" before the
+ * other fields of an entry (load-acquire). The cursor must not be mixed with
+ * the GET/PUT_SUBBUF ioctls on the same stream. In overwrite mode the control
+ * pages are informative only, as the tracer may overwrite any packet which is
+ * not held through the ioctl interface.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_CTRL_VERSION	1
+
+struct lttng_kernel_abi_ring_buffer_ctrl_subbuf {
+	uint64_t end;			/* Position of the end of the last delivered packet */
+	uint64_t commit_count;		/* Sub-buffer commit count at delivery */
+	uint64_t data_size;		/* Packet size, without padding */
+	uint64_t mmap_offset;		/* Packet offset within the data mapping */
+};
+
+struct lttng_kernel_abi_ring_buffer_ctrl {
+	uint32_t version;		/* LTTNG_KERNEL_ABI_RING_BUFFER_CTRL_VERSION */
+	uint32_t num_subbuf;
+	uint64_t subbuf_size;
+	uint64_t consumed;		/* Consumed position, as seen by the tracer */
+	struct lttng_kernel_abi_ring_buffer_ctrl_subbuf subbuf[];
+};
+
+struct lttng_kernel_abi_ring_buffer_cursor {
+	uint64_t consumed;		/* Written by the consumer */
+};
+
+struct lttng_kernel_abi_ring_buffer_ctrl_layout {
+	uint64_t ctrl_offset;		/* mmap offset of the control pages */
+	uint64_t ctrl_len;
+	uint64_t cursor_offset;		/* mmap offset of the cursor page */
+	uint64_t cursor_len;
+} __attribute__((packed));
+
+/*
+ * Batched sub-buffer access.
+ *
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUFS holds the consecutive
+ * sub-buffers ready for reading from the consumer position, up to "count" of
+ * them, and returns the position of the first one in "consumed". When "info"
+ * is non-zero, it points to a user-space array of "count" struct
+ * lttng_kernel_abi_ring_buffer_subbuf_info which is filled with the location
+ * and size of each sub-buffer held (the padded size is PAGE_ALIGN(data_size)).
+ * They are read through the data mapping at their mmap_offset, or with splice
+ * from file position i * subbuf_size for the i-th one, each splice call
+ * stopping at the end of a sub-buffer.
+ * LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUFS releases them all and moves
+ * the consumer position past them. In overwrite mode, at most one sub-buffer
+ * is held at a time.
+ */
+struct lttng_kernel_abi_ring_buffer_subbuf_info {
+	uint64_t mmap_offset;		/* Offset within the data mapping */
+	uint64_t data_size;		/* Sub-buffer size, without padding */
+} __attribute__((packed));
+
+struct lttng_kernel_abi_ring_buffer_subbufs {
+	uint64_t info;			/* User-space array, or 0 */
+	uint64_t consumed;		/* Out: position of the first sub-buffer */
+	uint32_t count;			/* In: maximum. Out: sub-buffers held */
+} __attribute__((packed));
+
+/*
+ * Compressed packet access.
+ *
+ * On channels created with LZ4 compression, the packets are compressed as
+ * they are delivered. LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_PACKET
+ * copies the compressed copy of the first sub-buffer held by the reader, a
+ * single LZ4 block holding the packet up to its unpadded size, to the
+ * user-space buffer "data" of "len" bytes, and returns its size in "len".
+ * It fails with ENOSPC, "len" holding the size needed, if it does not fit.
+ * LZ4_COMPRESSBOUND() of the maximum sub-buffer size is always enough.
+ */
+struct lttng_kernel_abi_ring_buffer_compressed {
+	uint64_t data;			/* User-space buffer */
+	uint64_t len;			/* In: size of data. Out: compressed size */
+} __attribute__((packed));
+
+long lib_ring_buffer_get_compressed_packet(struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_abi_ring_buffer_compressed __user *uarg);
+
 /*
  * Use LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF / LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUF to read and
  * consume sub-buffers sequentially.
@@ -120,6 +227,26 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
  * sub-buffer (can be parsed).
  */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_METADATA_CHECK	_IOR(0xF6, 0x12, uint32_t)
+/*
+ * Set up the stream control area (mmap output only) and return its layout
+ * within the stream file mapping offsets.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT	\
+	_IOR(0xF6, 0x13, struct lttng_kernel_abi_ring_buffer_ctrl_layout)
+/*
+ * Get exclusive read access to up to "count" consecutive sub-buffers ready
+ * for reading, starting at the consumer position.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUFS	\
+	_IOWR(0xF6, 0x14, struct lttng_kernel_abi_ring_buffer_subbufs)
+/* Release the sub-buffers held, move consumer forward past all of them. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUFS	_IO(0xF6, 0x15)
+/*
+ * Copy the LZ4 compressed copy of the first sub-buffer held to "data"
+ * (compressed channels only).
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_PACKET	\
+	_IOWR(0xF6, 0x16, struct lttng_kernel_abi_ring_buffer_compressed)
 
 #ifdef CONFIG_COMPAT
 /* Get a snapshot of the current ring buffer producer and consumer positions */
@@ -174,6 +301,27 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
  */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_METADATA_CHECK \
 	LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_METADATA_CHECK
+/*
+ * Set up the stream control area (mmap output only) and return its layout
+ * within the stream file mapping offsets.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_CTRL_LAYOUT	\
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT
+/*
+ * Get exclusive read access to up to "count" consecutive sub-buffers ready
+ * for reading, starting at the consumer position.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NEXT_SUBBUFS	\
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUFS
+/* Release the sub-buffers held, move consumer forward past all of them. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_PUT_NEXT_SUBBUFS	\
+	LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUFS
+/*
+ * Copy the LZ4 compressed copy of the first sub-buffer held to "data"
+ * (compressed channels only).
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_PACKET	\
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_PACKET
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LIB_LTTNG_KERNEL_ABI_RING_BUFFER_VFS_H */
@@ -12,6 +12,9 @@
 
 #include <lttng/kernel-version.h>
 #include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/sched.h>
+#include <linux/syscalls.h>
 
 #if LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(3,19,0)
 
@@ -35,4 +38,30 @@ inline int lttng_get_unused_fd(void)
 
 #endif /* #else #if LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(3,19,0) */
 
+#if LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,11,0)
+
+static
+inline int lttng_close_fd(unsigned int fd)
+{
+	return close_fd(fd);
+}
+
+#elif LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(3,7,0)
+
+static
+inline int lttng_close_fd(unsigned int fd)
+{
+	return __close_fd(current->files, fd);
+}
+
+#else /* #if LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,11,0) */
+
+static
+inline int lttng_close_fd(unsigned int fd)
+{
+	return sys_close(fd);
+}
+
+#endif /* #else #if LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,11,0) */
+
 #endif /* _LTTNG_WRAPPER_FILE_H */
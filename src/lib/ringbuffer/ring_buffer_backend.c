@@ -13,7 +13,11 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
+#include <linux/huge_mm.h>
 #include <linux/vmalloc.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/moduleparam.h>
 
 #include <wrapper/cpu.h>
 #include <wrapper/mm.h>
@@ -22,6 +26,239 @@
 #include <ringbuffer/backend.h>
 #include <ringbuffer/frontend.h>
 
+/*
+ * Populate @pages, starting at buffer page index @idx, with zeroed pages
+ * local to @node. When the channel asks for huge pages, try to allocate a
+ * whole huge page at each huge page aligned index, and fall back to a single
+ * order-0 page if the allocator cannot provide it.
+ *
+ * Returns the number of pages populated, 0 on allocation failure.
+ */
+static
+unsigned long lib_ring_buffer_backend_alloc_pages(struct channel_backend *chanb,
+		struct page **pages, unsigned long idx, unsigned long num_pages,
+		int node)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (chanb->attr.huge_pages && chanb->subbuf_size >= HPAGE_PMD_SIZE
+			&& !(idx & (HPAGE_PMD_NR - 1))
+			&& num_pages - idx >= HPAGE_PMD_NR) {
+		struct page *page;
+
+		page = alloc_pages_node(node,
+				GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY |
+				__GFP_ZERO | __GFP_COMP,
+				HPAGE_PMD_ORDER);
+		if (page) {
+			unsigned long i;
+
+			for (i = 0; i < HPAGE_PMD_NR; i++)
+				pages[idx + i] = nth_page(page, i);
+			return HPAGE_PMD_NR;
+		}
+	}
+#endif
+	pages[idx] = alloc_pages_node(node,
+			GFP_KERNEL | __GFP_NOWARN | __GFP_ZERO, 0);
+	return pages[idx] ? 1 : 0;
+}
+
+/*
+ * Free a buffer page. Huge pages are freed once, through their head page.
+ */
+static
+void lib_ring_buffer_backend_free_page(struct page *page)
+{
+	if (!PageCompound(page))
+		__free_page(page);
+	else if (PageHead(page))
+		__free_pages(page, compound_order(page));
+}
+
+/*
+ * Pool of buffer page sets.
+ *
+ * Allocating and zeroing the pages of every per-cpu buffer dominates channel
+ * creation time on large machines. Page sets of destroyed buffers are kept in
+ * this pool, up to pool_max_kb, and handed to buffers created later with the
+ * same geometry. Pages are cleared when they enter the pool, on the channel
+ * destruction path, so reusing them is cheap. The least recently pooled sets
+ * are evicted first.
+ */
+struct lib_ring_buffer_pool_entry {
+	struct list_head node;		/* pool_list, most recent first */
+	struct page **pages;		/* vmalloc'd array of num_pages */
+	unsigned long num_pages;
+	size_t subbuf_size;
+	int nid;
+	unsigned int huge_pages:1;
+};
+
+static LIST_HEAD(pool_list);
+static DEFINE_MUTEX(pool_mutex);	/* Protects pool_list and pool_pages */
+static unsigned long pool_pages;	/* Pages held or being added */
+
+static unsigned long pool_max_kb;
+module_param(pool_max_kb, ulong, 0644);
+MODULE_PARM_DESC(pool_max_kb, "Maximum memory kept in the buffer page pool, in kB (0: disabled)");
+
+static unsigned long pool_hits;
+module_param(pool_hits, ulong, 0444);
+MODULE_PARM_DESC(pool_hits, "Buffers whose pages were taken from the pool");
+
+static unsigned long pool_misses;
+module_param(pool_misses, ulong, 0444);
+MODULE_PARM_DESC(pool_misses, "Buffers allocated while the pool was enabled but held no matching pages");
+
+static
+void lib_ring_buffer_pool_free_entry(struct lib_ring_buffer_pool_entry *entry)
+{
+	unsigned long i;
+
+	for (i = 0; i < entry->num_pages; i++)
+		lib_ring_buffer_backend_free_page(entry->pages[i]);
+	vfree(entry->pages);
+	kfree(entry);
+}
+
+/*
+ * Take a set of @num_pages zeroed pages local to @nid from the pool. Returns
+ * the page array, owned by the caller, or NULL if no set matches.
+ */
+static
+struct page **lib_ring_buffer_pool_get(struct channel_backend *chanb,
+		unsigned long num_pages, int nid)
+{
+	struct lib_ring_buffer_pool_entry *entry, *found = NULL;
+	struct page **pages;
+
+	if (!READ_ONCE(pool_max_kb))
+		return NULL;
+	mutex_lock(&pool_mutex);
+	list_for_each_entry(entry, &pool_list, node) {
+		if (entry->num_pages == num_pages
+				&& entry->subbuf_size == chanb->subbuf_size
+				&& entry->nid == nid
+				&& entry->huge_pages == chanb->attr.huge_pages) {
+			found = entry;
+			break;
+		}
+	}
+	if (found) {
+		list_del(&found->node);
+		pool_pages -= num_pages;
+		pool_hits++;
+	} else {
+		pool_misses++;
+	}
+	mutex_unlock(&pool_mutex);
+	if (!found)
+		return NULL;
+	pages = found->pages;
+	kfree(found);
+	return pages;
+}
+
+/*
+ * Give a set of pages to the pool. On success, the pool owns @pages, which
+ * must be a vmalloc'd array. Returns false if the pool cannot take them.
+ */
+static
+bool lib_ring_buffer_pool_put(struct channel_backend *chanb,
+		struct page **pages, unsigned long num_pages, int nid)
+{
+	struct lib_ring_buffer_pool_entry *entry, *pos, *n;
+	unsigned long max_pages, i;
+	LIST_HEAD(evict);
+	bool fits;
+
+	max_pages = READ_ONCE(pool_max_kb) >> (PAGE_SHIFT - 10);
+	if (num_pages > max_pages)
+		return false;
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return false;
+	entry->pages = pages;
+	entry->num_pages = num_pages;
+	entry->subbuf_size = chanb->subbuf_size;
+	entry->nid = nid;
+	entry->huge_pages = chanb->attr.huge_pages;
+
+	/* Reserve room, evicting the oldest sets. */
+	mutex_lock(&pool_mutex);
+	list_for_each_entry_safe_reverse(pos, n, &pool_list, node) {
+		if (pool_pages + num_pages <= max_pages)
+			break;
+		list_move(&pos->node, &evict);
+		pool_pages -= pos->num_pages;
+	}
+	/* Sets being added concurrently cannot be evicted. */
+	fits = pool_pages + num_pages <= max_pages;
+	if (fits)
+		pool_pages += num_pages;
+	mutex_unlock(&pool_mutex);
+
+	list_for_each_entry_safe(pos, n, &evict, node)
+		lib_ring_buffer_pool_free_entry(pos);
+	if (!fits) {
+		kfree(entry);
+		return false;
+	}
+
+	/* Trace data must not leak into the next buffer using the pages. */
+	for (i = 0; i < num_pages; i++) {
+		clear_page(page_address(pages[i]));
+		cond_resched();
+	}
+
+	mutex_lock(&pool_mutex);
+	list_add(&entry->node, &pool_list);
+	mutex_unlock(&pool_mutex);
+	return true;
+}
+
+/*
+ * Give the pages of a buffer being freed to the pool. Returns false if the
+ * caller keeps ownership of the pages.
+ */
+static
+bool lib_ring_buffer_backend_pool_release(struct lttng_kernel_ring_buffer_backend *bufb,
+		unsigned long num_subbuf_alloc)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	unsigned long i, j, num_pages, page_idx = 0;
+	struct page **pages;
+
+	if (!READ_ONCE(pool_max_kb))
+		return false;
+	num_pages = num_subbuf_alloc * bufb->num_pages_per_subbuf;
+	pages = vmalloc(sizeof(*pages) * num_pages);
+	if (!pages)
+		return false;
+	for (i = 0; i < num_subbuf_alloc; i++)
+		for (j = 0; j < bufb->num_pages_per_subbuf; j++)
+			pages[page_idx++] = pfn_to_page(bufb->array[i]->p[j].pfn);
+	if (lib_ring_buffer_pool_put(chanb, pages, num_pages,
+			cpu_to_node(max(bufb->cpu, 0))))
+		return true;
+	vfree(pages);
+	return false;
+}
+
+/*
+ * Free the pool content. Called at module exit, when no buffer remains.
+ */
+void lib_ring_buffer_backend_exit(void)
+{
+	struct lib_ring_buffer_pool_entry *pos, *n;
+
+	list_for_each_entry_safe(pos, n, &pool_list, node) {
+		list_del(&pos->node);
+		lib_ring_buffer_pool_free_entry(pos);
+	}
+	pool_pages = 0;
+}
+
 /**
  * lib_ring_buffer_backend_allocate - allocate a channel buffer
  * @config: ring buffer instance configuration
@@ -39,11 +276,37 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 	struct channel_backend *chanb = &bufb->chan->backend;
 	unsigned long j, num_pages, num_pages_per_subbuf, page_idx = 0;
 	unsigned long subbuf_size, mmap_offset = 0;
-	unsigned long num_subbuf_alloc;
+	unsigned long num_subbuf_alloc, num_pages_alloc;
+	bool lazy = lib_ring_buffer_backend_lazy(config, chanb);
 	struct page **pages;
+	bool pooled = false;
 	unsigned long i;
 
 	num_pages = size >> PAGE_SHIFT;
+	num_pages_per_subbuf = num_pages >> get_count_order(num_subbuf);
+	subbuf_size = chanb->subbuf_size;
+	num_subbuf_alloc = num_subbuf;
+
+	if (extra_reader_sb) {
+		num_pages += num_pages_per_subbuf; /* Add pages for reader */
+		num_subbuf_alloc++;
+	}
+
+	/*
+	 * Lazily allocated buffers only get the pages of their emergency
+	 * sub-buffer here. See lib_ring_buffer_backend_populate().
+	 */
+	if (lazy) {
+		num_pages_alloc = num_pages_per_subbuf;
+	} else {
+		num_pages_alloc = num_pages;
+		pages = lib_ring_buffer_pool_get(chanb, num_pages,
+				cpu_to_node(max(bufb->cpu, 0)));
+		if (pages) {
+			pooled = true;
+			goto pages_ready;
+		}
+	}
 
 	/*
 	 * Verify that there is enough free pages available on the system for
@@ -52,7 +315,7 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 	 * and returns if there should be enough free pages based on the
 	 * current estimate.
 	 */
-	if (!wrapper_check_enough_free_pages(num_pages))
+	if (!wrapper_check_enough_free_pages(num_pages_alloc))
 		goto not_enough_pages;
 
 	/*
@@ -63,34 +326,33 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 	 */
 	wrapper_set_current_oom_origin();
 
-	num_pages_per_subbuf = num_pages >> get_count_order(num_subbuf);
-	subbuf_size = chanb->subbuf_size;
-	num_subbuf_alloc = num_subbuf;
-
-	if (extra_reader_sb) {
-		num_pages += num_pages_per_subbuf; /* Add pages for reader */
-		num_subbuf_alloc++;
-	}
-
-	pages = vmalloc_node(ALIGN(sizeof(*pages) * num_pages,
+	pages = vmalloc_node(ALIGN(sizeof(*pages) * num_pages_alloc,
 				   1 << INTERNODE_CACHE_SHIFT),
 			cpu_to_node(max(bufb->cpu, 0)));
 	if (unlikely(!pages))
 		goto pages_error;
 
+pages_ready:
+
 	bufb->array = lttng_kvmalloc_node(ALIGN(sizeof(*bufb->array)
 					 * num_subbuf_alloc,
 				  1 << INTERNODE_CACHE_SHIFT),
 			GFP_KERNEL | __GFP_NOWARN,
 			cpu_to_node(max(bufb->cpu, 0)));
-	if (unlikely(!bufb->array))
+	if (unlikely(!bufb->array)) {
+		if (pooled)
+			goto pool_array_error;
 		goto array_error;
+	}
 
-	for (i = 0; i < num_pages; i++) {
-		pages[i] = alloc_pages_node(cpu_to_node(max(bufb->cpu, 0)),
-				GFP_KERNEL | __GFP_NOWARN | __GFP_ZERO, 0);
-		if (unlikely(!pages[i]))
+	for (i = 0; !pooled && i < num_pages_alloc; ) {
+		unsigned long nr_alloc;
+
+		nr_alloc = lib_ring_buffer_backend_alloc_pages(chanb, pages, i,
+				num_pages_alloc, cpu_to_node(max(bufb->cpu, 0)));
+		if (unlikely(!nr_alloc))
 			goto depopulate;
+		i += nr_alloc;
 	}
 	bufb->num_pages_per_subbuf = num_pages_per_subbuf;
 
@@ -138,9 +400,9 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 	if (unlikely(!bufb->buf_cnt))
 		goto free_wsb;
 
-	/* Assign pages to page index */
+	/* Assign pages to page index. Pages not allocated yet are left NULL. */
 	for (i = 0; i < num_subbuf_alloc; i++) {
-		for (j = 0; j < num_pages_per_subbuf; j++) {
+		for (j = 0; page_idx < num_pages_alloc && j < num_pages_per_subbuf; j++) {
 			CHAN_WARN_ON(chanb, page_idx > num_pages);
 			bufb->array[i]->p[j].virt = page_address(pages[page_idx]);
 			bufb->array[i]->p[j].pfn = page_to_pfn(pages[page_idx]);
@@ -152,15 +414,32 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 		}
 	}
 
+	/*
+	 * The vmap backend maps all buffer pages in a virtually contiguous
+	 * area. Pages were assigned to sub-buffers in order, so each
+	 * sub-buffer is contiguous within this mapping.
+	 */
+	if (config->backend == RING_BUFFER_VMAP) {
+		bufb->virt = vmap(pages, num_pages, VM_MAP, PAGE_KERNEL);
+		if (unlikely(!bufb->virt))
+			goto free_cnt;
+		for (i = 0; i < num_subbuf_alloc; i++)
+			bufb->array[i]->virt = bufb->virt + i * subbuf_size;
+	}
+
 	/*
 	 * If kmalloc ever uses vmalloc underneath, make sure the buffer pages
 	 * will not fault.
 	 */
 	wrapper_vmalloc_sync_mappings();
-	wrapper_clear_current_oom_origin();
+	if (!pooled)
+		wrapper_clear_current_oom_origin();
 	vfree(pages);
+	bufb->populated = !lazy;
 	return 0;
 
+free_cnt:
+	lttng_kvfree(bufb->buf_cnt);
 free_wsb:
 	lttng_kvfree(bufb->buf_wsb);
 free_array:
@@ -168,15 +447,26 @@ free_array:
 		lttng_kvfree(bufb->array[i]);
 depopulate:
 	/* Free all allocated pages */
-	for (i = 0; (i < num_pages && pages[i]); i++)
-		__free_page(pages[i]);
+	for (i = 0; (i < num_pages_alloc && pages[i]); i++)
+		lib_ring_buffer_backend_free_page(pages[i]);
 	lttng_kvfree(bufb->array);
 array_error:
 	vfree(pages);
 pages_error:
-	wrapper_clear_current_oom_origin();
+	if (!pooled)
+		wrapper_clear_current_oom_origin();
 not_enough_pages:
 	return -ENOMEM;
+
+pool_array_error:
+	/* Hand the page set back to the pool, or free it if it is full. */
+	if (!lib_ring_buffer_pool_put(chanb, pages, num_pages,
+			cpu_to_node(max(bufb->cpu, 0)))) {
+		for (i = 0; i < num_pages; i++)
+			lib_ring_buffer_backend_free_page(pages[i]);
+		vfree(pages);
+	}
+	return -ENOMEM;
 }
 
 int lib_ring_buffer_backend_create(struct lttng_kernel_ring_buffer_backend *bufb,
@@ -192,20 +482,86 @@ int lib_ring_buffer_backend_create(struct lttng_kernel_ring_buffer_backend *bufb
 						chanb->extra_reader_sb);
 }
 
+/*
+ * Allocate the pages of a lazily allocated buffer, except those of its
+ * emergency sub-buffer which were allocated with the buffer. Called from
+ * process context the first time the buffer is written to. Writers start
+ * using the whole buffer once this returns 0.
+ */
+int lib_ring_buffer_backend_populate(struct lttng_kernel_ring_buffer_backend *bufb)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	unsigned long i, j, num_pages, num_subbuf_alloc, page_idx = 0;
+	int node = cpu_to_node(max(bufb->cpu, 0));
+	struct page **pages;
+
+	num_subbuf_alloc = chanb->num_subbuf;
+	if (chanb->extra_reader_sb)
+		num_subbuf_alloc++;
+	num_pages = (num_subbuf_alloc - 1) * bufb->num_pages_per_subbuf;
+
+	if (!wrapper_check_enough_free_pages(num_pages))
+		return -ENOMEM;
+	pages = vzalloc_node(sizeof(*pages) * num_pages, node);
+	if (!pages)
+		return -ENOMEM;
+	for (i = 0; i < num_pages; ) {
+		unsigned long nr_alloc;
+
+		nr_alloc = lib_ring_buffer_backend_alloc_pages(chanb, pages, i,
+				num_pages, node);
+		if (unlikely(!nr_alloc))
+			goto depopulate;
+		i += nr_alloc;
+	}
+
+	/* Backend pages index 0 is the emergency sub-buffer. */
+	for (i = 1; i < num_subbuf_alloc; i++) {
+		for (j = 0; j < bufb->num_pages_per_subbuf; j++) {
+			bufb->array[i]->p[j].virt = page_address(pages[page_idx]);
+			bufb->array[i]->p[j].pfn = page_to_pfn(pages[page_idx]);
+			page_idx++;
+		}
+	}
+	vfree(pages);
+	lttng_smp_store_release(&bufb->populated, 1);
+	return 0;
+
+depopulate:
+	for (i = 0; (i < num_pages && pages[i]); i++)
+		lib_ring_buffer_backend_free_page(pages[i]);
+	vfree(pages);
+	return -ENOMEM;
+}
+
 void lib_ring_buffer_backend_free(struct lttng_kernel_ring_buffer_backend *bufb)
 {
 	struct channel_backend *chanb = &bufb->chan->backend;
 	unsigned long i, j, num_subbuf_alloc;
+	bool pooled;
 
 	num_subbuf_alloc = chanb->num_subbuf;
 	if (chanb->extra_reader_sb)
 		num_subbuf_alloc++;
 
+	if (bufb->virt) {
+		vunmap(bufb->virt);
+		bufb->virt = NULL;
+	}
 	lttng_kvfree(bufb->buf_wsb);
 	lttng_kvfree(bufb->buf_cnt);
+	/* Only fully populated buffers can give their pages to the pool. */
+	pooled = bufb->populated
+		&& lib_ring_buffer_backend_pool_release(bufb, num_subbuf_alloc);
 	for (i = 0; i < num_subbuf_alloc; i++) {
-		for (j = 0; j < bufb->num_pages_per_subbuf; j++)
-			__free_page(pfn_to_page(bufb->array[i]->p[j].pfn));
+		for (j = 0; !pooled && j < bufb->num_pages_per_subbuf; j++) {
+			unsigned long pfn = bufb->array[i]->p[j].pfn;
+
+			/* Not populated yet (lazy allocation). */
+			if (!pfn)
+				continue;
+			lib_ring_buffer_backend_free_page(pfn_to_page(pfn));
+		}
 		lttng_kvfree(bufb->array[i]);
 	}
 	lttng_kvfree(bufb->array);
@@ -1044,6 +1400,16 @@ size_t lib_ring_buffer_read(struct lttng_kernel_ring_buffer_backend *bufb, size_
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
+	if (config->backend == RING_BUFFER_VMAP) {
+		id = bufb->buf_rsb.id;
+		sb_bindex = subbuffer_id_get_index(config, id);
+		rpages = bufb->array[sb_bindex];
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+			     && subbuffer_id_is_noref(config, id));
+		memcpy(dest, rpages->virt + (offset & (chanb->subbuf_size - 1)),
+		       len);
+		return orig_len;
+	}
 	for (;;) {
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_rsb.id;
@@ -1095,6 +1461,18 @@ int __lib_ring_buffer_copy_to_user(struct lttng_kernel_ring_buffer_backend *bufb
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
+	if (config->backend == RING_BUFFER_VMAP) {
+		id = bufb->buf_rsb.id;
+		sb_bindex = subbuffer_id_get_index(config, id);
+		rpages = bufb->array[sb_bindex];
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+			     && subbuffer_id_is_noref(config, id));
+		if (__copy_to_user(dest,
+			       rpages->virt + (offset & (chanb->subbuf_size - 1)),
+			       len))
+			return -EFAULT;
+		return 0;
+	}
 	for (;;) {
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_rsb.id;
@@ -1239,6 +1617,8 @@ void *lib_ring_buffer_read_offset_address(struct lttng_kernel_ring_buffer_backen
 	rpages = bufb->array[sb_bindex];
 	CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, id));
+	if (config->backend == RING_BUFFER_VMAP)
+		return rpages->virt + (offset & (chanb->subbuf_size - 1));
 	return rpages->p[index].virt + (offset & ~PAGE_MASK);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_read_offset_address);
@@ -1270,6 +1650,8 @@ void *lib_ring_buffer_offset_address(struct lttng_kernel_ring_buffer_backend *bu
 	rpages = bufb->array[sb_bindex];
 	CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, id));
+	if (config->backend == RING_BUFFER_VMAP)
+		return rpages->virt + (offset & (chanb->subbuf_size - 1));
 	return rpages->p[index].virt + (offset & ~PAGE_MASK);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_offset_address);
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR LGPL-2.1-only)
+ *
+ * ring_buffer_compress.c
+ *
+ * LZ4 compression of delivered packets.
+ *
+ * Each buffer of a channel created with the "compress" attribute owns a side
+ * buffer holding the compressed copy of one packet: the next one to be read.
+ * Delivering that packet queues an irq_work from the writer, which schedules
+ * the compression work on the writer cpu. Moving the consumer position
+ * schedules it again for the following packet. When the reader asks for the
+ * compressed copy of the sub-buffer it holds before the work got to it, the
+ * compression is done synchronously.
+ *
+ * Compression is limited to discard mode, where a delivered sub-buffer is not
+ * written to until it is consumed, so it can be read before the reader gets
+ * it.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+
+#include <ringbuffer/backend.h>
+#include <ringbuffer/frontend.h>
+#include <ringbuffer/frontend_internal.h>
+#include <ringbuffer/vfs.h>
+
+#ifdef LTTNG_RING_BUFFER_COMPRESS
+
+#include <linux/lz4.h>
+
+/*
+ * Check that the sub-buffer at position consumed is delivered and not
+ * consumed yet.
+ */
+static
+int compress_subbuf_delivered(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_ring_buffer_channel *chan,
+		unsigned long consumed)
+{
+	unsigned long consumed_idx, commit_count, write_offset;
+
+	if ((long) subbuf_trunc(consumed, chan)
+	    - (long) subbuf_trunc(atomic_long_read(&buf->consumed), chan) < 0)
+		return 0;
+	consumed_idx = subbuf_index(consumed, chan);
+	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
+	/* Read the commit count before the buffer data and write offset. */
+	smp_rmb();
+	write_offset = v_read(config, &buf->offset);
+	if (((commit_count - chan->backend.subbuf_size)
+	     & chan->commit_count_mask)
+	    - (buf_trunc(consumed, chan) >> chan->backend.num_subbuf_order)
+	    != 0)
+		return 0;
+	if (subbuf_trunc(write_offset, chan) - subbuf_trunc(consumed, chan) == 0)
+		return 0;
+	return 1;
+}
+
+/*
+ * Compress the sub-buffer at position consumed into the side buffer. Called
+ * with the compression lock held, on a delivered sub-buffer.
+ */
+static
+int compress_subbuf(struct lttng_kernel_ring_buffer *buf, unsigned long consumed)
+{
+	struct lttng_kernel_ring_buffer_compress *compress = buf->compress;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_ring_buffer_backend_pages *pages;
+	unsigned long idx, sb_bindex, data_size;
+	const char *src;
+	int len;
+
+	compress->offset = -1UL;
+	idx = subbuf_index(consumed, chan);
+	/* Discard mode: the reader uses the writer sub-buffer directly. */
+	sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_wsb[idx].id);
+	pages = buf->backend.array[sb_bindex];
+	data_size = pages->data_size;
+	if (config->backend == RING_BUFFER_VMAP) {
+		src = pages->virt;
+	} else {
+		unsigned long copied, i;
+
+		for (i = 0, copied = 0; copied < data_size; i++) {
+			unsigned long len_page = min_t(unsigned long,
+					data_size - copied, PAGE_SIZE);
+
+			memcpy(compress->linear + copied, pages->p[i].virt,
+			       len_page);
+			copied += len_page;
+		}
+		src = compress->linear;
+	}
+	len = LZ4_compress_default(src, compress->data, data_size,
+			compress->data_alloc, compress->wrkmem);
+	if (!len)
+		return -EIO;
+	/*
+	 * The sub-buffer may have been consumed, and written to again,
+	 * while it was being compressed.
+	 */
+	smp_rmb();
+	if ((long) subbuf_trunc(consumed, chan)
+	    - (long) subbuf_trunc(atomic_long_read(&buf->consumed), chan) < 0)
+		return -EAGAIN;
+	compress->data_len = len;
+	compress->offset = subbuf_trunc(consumed, chan);
+	return 0;
+}
+
+static
+void lib_ring_buffer_compress_work(struct work_struct *work)
+{
+	struct lttng_kernel_ring_buffer_compress *compress =
+		container_of(work, struct lttng_kernel_ring_buffer_compress, work);
+	struct lttng_kernel_ring_buffer *buf = compress->buf;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed;
+
+	mutex_lock(&compress->lock);
+	consumed = atomic_long_read(&buf->consumed);
+	if (compress->offset != subbuf_trunc(consumed, chan)
+			&& compress_subbuf_delivered(config, buf, chan, consumed))
+		(void) compress_subbuf(buf, consumed);
+	mutex_unlock(&compress->lock);
+}
+
+static
+void lib_ring_buffer_compress_pending(struct irq_work *entry)
+{
+	struct lttng_kernel_ring_buffer_compress *compress =
+		container_of(entry, struct lttng_kernel_ring_buffer_compress, pending);
+
+	/* Runs on the writer cpu. */
+	schedule_work(&compress->work);
+}
+
+int lib_ring_buffer_compress_create(struct lttng_kernel_ring_buffer *buf, int cpu)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	struct lttng_kernel_ring_buffer_compress *compress;
+	size_t subbuf_size = chan->backend.subbuf_size;
+	int node = cpu_to_node(max(cpu, 0));
+
+	if (subbuf_size > LZ4_MAX_INPUT_SIZE)
+		return -EINVAL;
+	compress = kzalloc_node(sizeof(*compress), GFP_KERNEL, node);
+	if (!compress)
+		return -ENOMEM;
+	compress->data_alloc = LZ4_compressBound(subbuf_size);
+	compress->data = vmalloc_node(compress->data_alloc, node);
+	if (!compress->data)
+		goto error;
+	compress->wrkmem = vmalloc_node(LZ4_MEM_COMPRESS, node);
+	if (!compress->wrkmem)
+		goto error;
+	if (chan->backend.config.backend != RING_BUFFER_VMAP) {
+		compress->linear = vmalloc_node(subbuf_size, node);
+		if (!compress->linear)
+			goto error;
+	}
+	compress->buf = buf;
+	compress->offset = -1UL;
+	mutex_init(&compress->lock);
+	init_irq_work(&compress->pending, lib_ring_buffer_compress_pending);
+	INIT_WORK(&compress->work, lib_ring_buffer_compress_work);
+	buf->compress = compress;
+	return 0;
+
+error:
+	vfree(compress->linear);
+	vfree(compress->wrkmem);
+	vfree(compress->data);
+	kfree(compress);
+	return -ENOMEM;
+}
+
+void lib_ring_buffer_compress_free(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_compress *compress = buf->compress;
+
+	if (!compress)
+		return;
+	irq_work_sync(&compress->pending);
+	cancel_work_sync(&compress->work);
+	vfree(compress->linear);
+	vfree(compress->wrkmem);
+	vfree(compress->data);
+	kfree(compress);
+	buf->compress = NULL;
+}
+
+/*
+ * Called by the writer delivering a sub-buffer, possibly from NMI context.
+ */
+void lib_ring_buffer_compress_deliver(struct lttng_kernel_ring_buffer *buf)
+{
+	irq_work_queue(&buf->compress->pending);
+}
+
+/*
+ * Called after the consumer position moved forward.
+ */
+void lib_ring_buffer_compress_consumed(struct lttng_kernel_ring_buffer *buf)
+{
+	schedule_work(&buf->compress->work);
+}
+
+/**
+ * lib_ring_buffer_get_compressed_packet - copy the compressed packet to user-space
+ * @buf: ring buffer
+ * @uarg: user-space struct lttng_kernel_abi_ring_buffer_compressed
+ *
+ * Copies the LZ4 compressed copy of the first sub-buffer held by the reader
+ * (whole packet, up to its unpadded size). Returns -ENOSPC, with the
+ * compressed size in "len", if it does not fit.
+ */
+long lib_ring_buffer_get_compressed_packet(struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_abi_ring_buffer_compressed __user *uarg)
+{
+	struct lttng_kernel_ring_buffer_compress *compress = buf->compress;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	struct lttng_kernel_abi_ring_buffer_compressed arg;
+	unsigned long consumed;
+	long ret = 0;
+
+	if (!compress || !buf->get_subbuf)
+		return -EINVAL;
+	if (copy_from_user(&arg, uarg, sizeof(arg)))
+		return -EFAULT;
+	consumed = buf->get_subbuf_consumed;
+	mutex_lock(&compress->lock);
+	if (compress->offset != subbuf_trunc(consumed, chan)) {
+		/* Held by the reader: cannot be consumed under us. */
+		ret = compress_subbuf(buf, consumed);
+		if (ret)
+			goto end;
+	}
+	if (arg.len < compress->data_len) {
+		ret = -ENOSPC;
+	} else if (copy_to_user((void __user *) (unsigned long) arg.data,
+				compress->data, compress->data_len)) {
+		ret = -EFAULT;
+		goto end;
+	}
+	arg.len = compress->data_len;
+	if (copy_to_user(uarg, &arg, sizeof(arg)))
+		ret = -EFAULT;
+end:
+	mutex_unlock(&compress->lock);
+	return ret;
+}
+
+#else /* #ifdef LTTNG_RING_BUFFER_COMPRESS */
+
+int lib_ring_buffer_compress_create(struct lttng_kernel_ring_buffer *buf, int cpu)
+{
+	return -EOPNOTSUPP;
+}
+
+void lib_ring_buffer_compress_free(struct lttng_kernel_ring_buffer *buf)
+{
+}
+
+void lib_ring_buffer_compress_deliver(struct lttng_kernel_ring_buffer *buf)
+{
+}
+
+void lib_ring_buffer_compress_consumed(struct lttng_kernel_ring_buffer *buf)
+{
+}
+
+long lib_ring_buffer_get_compressed_packet(struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_abi_ring_buffer_compressed __user *uarg)
+{
+	return -EINVAL;
+}
+
+#endif /* #else #ifdef LTTNG_RING_BUFFER_COMPRESS */
@@ -40,6 +40,7 @@
 #include <linux/delay.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
+#include <linux/highmem.h>
 #include <asm/cacheflush.h>
 
 #include <ringbuffer/config.h>
@@ -47,6 +48,7 @@
 #include <ringbuffer/frontend.h>
 #include <ringbuffer/iterator.h>
 #include <ringbuffer/nohz.h>
+#include <ringbuffer/vfs.h>
 #include <wrapper/atomic.h>
 #include <wrapper/cpu.h>
 #include <wrapper/kref.h>
@@ -86,6 +88,153 @@ static
 void _lib_ring_buffer_switch_remote(struct lttng_kernel_ring_buffer *buf,
 		enum switch_mode mode);
 
+static
+struct lttng_kernel_abi_ring_buffer_ctrl *lib_ring_buffer_ctrl(struct lttng_kernel_ring_buffer *buf)
+{
+	void *area = READ_ONCE(buf->ctrl_area);
+
+	if (!area)
+		return NULL;
+	return area + PAGE_SIZE;
+}
+
+static
+void lib_ring_buffer_ctrl_set_consumed(struct lttng_kernel_ring_buffer *buf,
+				       unsigned long consumed)
+{
+	struct lttng_kernel_abi_ring_buffer_ctrl *ctrl = lib_ring_buffer_ctrl(buf);
+
+	if (ctrl)
+		WRITE_ONCE(ctrl->consumed, consumed);
+}
+
+/*
+ * Publish the sub-buffer being delivered in the control pages. Must be called
+ * with exclusive sub-buffer access, after the data size has been set by the
+ * buffer_end callback.
+ */
+static
+void lib_ring_buffer_ctrl_deliver(const struct lttng_kernel_ring_buffer_config *config,
+				  struct lttng_kernel_ring_buffer *buf,
+				  struct lttng_kernel_ring_buffer_channel *chan,
+				  unsigned long offset,
+				  unsigned long commit_count,
+				  unsigned long idx)
+{
+	struct lttng_kernel_abi_ring_buffer_ctrl_subbuf *entry;
+	struct lttng_kernel_abi_ring_buffer_ctrl *ctrl;
+	unsigned long sb_bindex;
+
+	if (config->output != RING_BUFFER_MMAP)
+		return;
+	ctrl = lib_ring_buffer_ctrl(buf);
+	if (!ctrl)
+		return;
+	entry = &ctrl->subbuf[idx];
+	sb_bindex = subbuffer_id_get_index(config,
+					   buf->backend.buf_wsb[idx].id);
+	WRITE_ONCE(entry->commit_count, commit_count);
+	WRITE_ONCE(entry->data_size,
+		   lib_ring_buffer_get_data_size(config, buf, idx));
+	WRITE_ONCE(entry->mmap_offset,
+		   buf->backend.array[sb_bindex]->mmap_offset);
+	/* Order entry content before the end position, which flags it ready. */
+	smp_wmb();
+	WRITE_ONCE(entry->end,
+		   subbuf_trunc(offset, chan) + chan->backend.subbuf_size);
+}
+
+/*
+ * Read the consumed position, first moving it forward to the position stored
+ * by the consumer in the cursor page, if any. Only discard mode honors the
+ * cursor: in overwrite mode the consumed position is pushed by writers, and
+ * sub-buffers are handed to the reader by exchange.
+ *
+ * The cursor is user-controlled: positions which are not sub-buffer aligned,
+ * move backwards or go beyond the write position @offset are ignored.
+ */
+static
+unsigned long lib_ring_buffer_ctrl_pull_consumed(const struct lttng_kernel_ring_buffer_config *config,
+						 struct lttng_kernel_ring_buffer *buf,
+						 struct lttng_kernel_ring_buffer_channel *chan,
+						 unsigned long offset)
+{
+	struct lttng_kernel_abi_ring_buffer_cursor *cursor;
+	unsigned long consumed, consumed_new;
+
+	consumed = atomic_long_read(&buf->consumed);
+	if (config->output != RING_BUFFER_MMAP
+			|| config->mode != RING_BUFFER_DISCARD)
+		return consumed;
+	cursor = READ_ONCE(buf->ctrl_area);
+	if (likely(!cursor))
+		return consumed;
+	consumed_new = (unsigned long) READ_ONCE(cursor->consumed);
+	if (subbuf_offset(consumed_new, chan)
+			|| (long) (consumed_new - consumed) <= 0
+			|| (long) (subbuf_trunc(offset, chan) - consumed_new) < 0)
+		return consumed;
+	while ((long) consumed - (long) consumed_new < 0)
+		consumed = atomic_long_cmpxchg(&buf->consumed, consumed,
+					       consumed_new);
+	lib_ring_buffer_ctrl_set_consumed(buf, consumed);
+	return consumed;
+}
+
+/**
+ * lib_ring_buffer_ctrl_len - Length of the stream control pages
+ * @chan: Channel.
+ */
+size_t lib_ring_buffer_ctrl_len(struct lttng_kernel_ring_buffer_channel *chan)
+{
+	return PAGE_ALIGN(sizeof(struct lttng_kernel_abi_ring_buffer_ctrl)
+		+ chan->backend.num_subbuf
+			* sizeof(struct lttng_kernel_abi_ring_buffer_ctrl_subbuf));
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_ctrl_len);
+
+/**
+ * lib_ring_buffer_ctrl_open - Set up the stream control area
+ * @buf: Ring buffer.
+ *
+ * Allocates the consumer cursor page and control pages of an mmap output
+ * buffer, if not already done. Sub-buffers delivered before this call are
+ * not published in the control pages, so it should be set up before tracing
+ * starts. Returns 0 on success, negative error value otherwise.
+ */
+int lib_ring_buffer_ctrl_open(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_abi_ring_buffer_cursor *cursor;
+	struct lttng_kernel_abi_ring_buffer_ctrl *ctrl;
+	void *area;
+
+	if (config->output != RING_BUFFER_MMAP)
+		return -EINVAL;
+	if (READ_ONCE(buf->ctrl_area))
+		return 0;
+	area = vmalloc_user(PAGE_SIZE + lib_ring_buffer_ctrl_len(chan));
+	if (!area)
+		return -ENOMEM;
+	cursor = area;
+	ctrl = area + PAGE_SIZE;
+	ctrl->version = LTTNG_KERNEL_ABI_RING_BUFFER_CTRL_VERSION;
+	ctrl->num_subbuf = chan->backend.num_subbuf;
+	ctrl->subbuf_size = chan->backend.subbuf_size;
+	ctrl->consumed = atomic_long_read(&buf->consumed);
+	cursor->consumed = ctrl->consumed;
+	/*
+	 * The control area is updated by the tracer, which can run in
+	 * page fault handlers and NMI context.
+	 */
+	wrapper_vmalloc_sync_mappings();
+	if (cmpxchg(&buf->ctrl_area, NULL, area) != NULL)
+		vfree(area);	/* Lost race with concurrent open. */
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_ctrl_open);
+
 static
 int lib_ring_buffer_poll_deliver(const struct lttng_kernel_ring_buffer_config *config,
 				 struct lttng_kernel_ring_buffer *buf,
@@ -93,7 +242,8 @@ int lib_ring_buffer_poll_deliver(const struct lttng_kernel_ring_buffer_config *c
 {
 	unsigned long consumed_old, consumed_idx, commit_count, write_offset;
 
-	consumed_old = atomic_long_read(&buf->consumed);
+	consumed_old = lib_ring_buffer_ctrl_pull_consumed(config, buf, chan,
+			v_read(config, &buf->offset));
 	consumed_idx = subbuf_index(consumed_old, chan);
 	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
 	/*
@@ -135,11 +285,16 @@ void lib_ring_buffer_free(struct lttng_kernel_ring_buffer *buf)
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 
 	irq_work_sync(&buf->wakeup_pending);
+	irq_work_sync(&buf->populate_pending);
+	cancel_work_sync(&buf->populate_work);
+	lib_ring_buffer_compress_free(buf);
 
 	lib_ring_buffer_print_errors(chan, buf, buf->backend.cpu);
 	lttng_kvfree(buf->commit_hot);
 	lttng_kvfree(buf->commit_cold);
 	lttng_kvfree(buf->ts_end);
+	vfree(buf->ctrl_area);
+	buf->ctrl_area = NULL;
 
 	lib_ring_buffer_backend_free(&buf->backend);
 }
@@ -172,6 +327,16 @@ void lib_ring_buffer_reset(struct lttng_kernel_ring_buffer *buf)
 		buf->ts_end[i] = 0;
 	}
 	atomic_long_set(&buf->consumed, 0);
+	buf->wakeup_watermark_hit = 0;
+	if (buf->ctrl_area) {
+		struct lttng_kernel_abi_ring_buffer_cursor *cursor = buf->ctrl_area;
+		struct lttng_kernel_abi_ring_buffer_ctrl *ctrl = lib_ring_buffer_ctrl(buf);
+
+		WRITE_ONCE(cursor->consumed, 0);
+		WRITE_ONCE(ctrl->consumed, 0);
+		for (i = 0; i < chan->backend.num_subbuf; i++)
+			WRITE_ONCE(ctrl->subbuf[i].end, 0);
+	}
 	atomic_set(&buf->record_disabled, 0);
 	v_set(config, &buf->last_tsc, 0);
 	lib_ring_buffer_backend_reset(&buf->backend);
@@ -222,6 +387,49 @@ static void lib_ring_buffer_pending_wakeup_chan(struct irq_work *entry)
 	wake_up_interruptible(&chan->read_wait);
 }
 
+static void lib_ring_buffer_populate_work(struct work_struct *work)
+{
+	struct lttng_kernel_ring_buffer *buf = container_of(work, struct lttng_kernel_ring_buffer,
+						   populate_work);
+
+	if (lib_ring_buffer_backend_populate(&buf->backend)) {
+		printk_ratelimited(KERN_WARNING
+		       "LTTng: ring buffer %s, cpu %d: cannot allocate buffer pages, "
+		       "retrying on the next sub-buffer switch\n",
+		       buf->backend.chan->backend.name, buf->backend.cpu);
+		/* Let a later sub-buffer switch request the allocation again. */
+		WRITE_ONCE(buf->populate_queued, 0);
+	}
+}
+
+/*
+ * Writers may run in NMI context, where work cannot be queued directly.
+ */
+static void lib_ring_buffer_pending_populate(struct irq_work *entry)
+{
+	struct lttng_kernel_ring_buffer *buf = container_of(entry, struct lttng_kernel_ring_buffer,
+						   populate_pending);
+	schedule_work(&buf->populate_work);
+}
+
+/*
+ * Lazily allocated buffers request the allocation of their pages from their
+ * first sub-buffer switch, which is performed by their first reserve. Until
+ * the pages are there, only the emergency sub-buffer can be switched to.
+ * Returns whether writer sub-buffer @sb_index can be switched to.
+ */
+static
+int lib_ring_buffer_lazy_populate(const struct lttng_kernel_ring_buffer_config *config,
+				  struct lttng_kernel_ring_buffer *buf,
+				  unsigned long sb_index)
+{
+	if (likely(lttng_smp_load_acquire(&buf->backend.populated)))
+		return 1;
+	if (!READ_ONCE(buf->populate_queued) && !xchg(&buf->populate_queued, 1))
+		irq_work_queue(&buf->populate_pending);
+	return lib_ring_buffer_backend_subbuf_ready(config, &buf->backend, sb_index);
+}
+
 /*
  * Must be called under cpu hotplug protection.
  */
@@ -285,23 +493,35 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 	init_waitqueue_head(&buf->read_wait);
 	init_waitqueue_head(&buf->write_wait);
 	init_irq_work(&buf->wakeup_pending, lib_ring_buffer_pending_wakeup_buf);
+	init_irq_work(&buf->populate_pending, lib_ring_buffer_pending_populate);
+	INIT_WORK(&buf->populate_work, lib_ring_buffer_populate_work);
 	raw_spin_lock_init(&buf->raw_tick_nohz_spinlock);
 
+	if (chanb->attr.compress) {
+		ret = lib_ring_buffer_compress_create(buf, cpu);
+		if (ret)
+			goto free_ts_end;
+	}
+
 	/*
 	 * Write the subbuffer header for first subbuffer so we know the total
-	 * duration of data gathering.
+	 * duration of data gathering. Lazily allocated buffers leave it to
+	 * their first writer, which then starts from offset 0 through the
+	 * reserve slow path and requests the page allocation from there.
 	 */
-	subbuf_header_size = config->cb.subbuffer_header_size();
-	v_set(config, &buf->offset, subbuf_header_size);
-	subbuffer_id_clear_noref(config, &buf->backend.buf_wsb[0].id);
-	tsc = config->cb.ring_buffer_clock_read(buf->backend.chan);
-	config->cb.buffer_begin(buf, tsc, 0);
-	v_add(config, subbuf_header_size, &buf->commit_hot[0].cc);
+	if (!lib_ring_buffer_backend_lazy(config, chanb)) {
+		subbuf_header_size = config->cb.subbuffer_header_size();
+		v_set(config, &buf->offset, subbuf_header_size);
+		subbuffer_id_clear_noref(config, &buf->backend.buf_wsb[0].id);
+		tsc = config->cb.ring_buffer_clock_read(buf->backend.chan);
+		config->cb.buffer_begin(buf, tsc, 0);
+		v_add(config, subbuf_header_size, &buf->commit_hot[0].cc);
+	}
 
 	if (config->cb.buffer_create) {
 		ret = config->cb.buffer_create(buf, priv, cpu, chanb->name);
 		if (ret)
-			goto free_init;
+			goto free_compress;
 	}
 
 	/*
@@ -321,7 +541,9 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 	return 0;
 
 	/* Error handling */
-free_init:
+free_compress:
+	lib_ring_buffer_compress_free(buf);
+free_ts_end:
 	lttng_kvfree(buf->ts_end);
 free_commit_cold:
 	lttng_kvfree(buf->commit_cold);
@@ -332,24 +554,57 @@ free_chanbuf:
 	return ret;
 }
 
+/*
+ * Adaptive switch timer: stretch the period of buffers which would flush
+ * packets mostly made of padding (less than 1/8 of a sub-buffer written since
+ * the last tick), and shorten it back when they fill at least half a
+ * sub-buffer per tick.
+ */
+static
+void lib_ring_buffer_adapt_switch_timer(const struct lttng_kernel_ring_buffer_config *config,
+					struct lttng_kernel_ring_buffer *buf,
+					struct lttng_kernel_ring_buffer_channel *chan)
+{
+	unsigned long written;
+
+	written = v_read(config, &buf->offset) - buf->switch_timer_offset;
+
+	if (written < (chan->backend.subbuf_size >> 3))
+		buf->switch_timer_period = min(buf->switch_timer_period << 1,
+					       chan->switch_timer_max_interval);
+	else if (written >= (chan->backend.subbuf_size >> 1))
+		buf->switch_timer_period = max(buf->switch_timer_period >> 1,
+					       chan->switch_timer_interval);
+}
+
 static void switch_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
 {
 	struct lttng_kernel_ring_buffer *buf = lttng_from_timer(buf, t, switch_timer);
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 
+	if (chan->switch_timer_max_interval)
+		lib_ring_buffer_adapt_switch_timer(config, buf, chan);
+
 	/*
 	 * Only flush buffers periodically if readers are active.
 	 */
 	if (atomic_long_read(&buf->active_readers))
 		lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
 
+	/*
+	 * Sample the offset after the switch, so the padding it adds is not
+	 * counted as written by the next tick.
+	 */
+	if (chan->switch_timer_max_interval)
+		buf->switch_timer_offset = v_read(config, &buf->offset);
+
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
 		lttng_mod_timer_pinned(&buf->switch_timer,
-				 jiffies + chan->switch_timer_interval);
+				 jiffies + buf->switch_timer_period);
 	else
 		mod_timer(&buf->switch_timer,
-			  jiffies + chan->switch_timer_interval);
+			  jiffies + buf->switch_timer_period);
 }
 
 /*
@@ -368,7 +623,9 @@ static void lib_ring_buffer_start_switch_timer(struct lttng_kernel_ring_buffer *
 		flags = LTTNG_TIMER_PINNED;
 
 	lttng_timer_setup(&buf->switch_timer, switch_buffer_timer, flags, buf);
-	buf->switch_timer.expires = jiffies + chan->switch_timer_interval;
+	buf->switch_timer_period = chan->switch_timer_interval;
+	buf->switch_timer_offset = v_read(config, &buf->offset);
+	buf->switch_timer.expires = jiffies + buf->switch_timer_period;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
 		add_timer_on(&buf->switch_timer, buf->backend.cpu);
@@ -821,6 +1078,27 @@ static void channel_free(struct lttng_kernel_ring_buffer_channel *chan)
 	kfree(chan);
 }
 
+/*
+ * Resolve the wakeup watermark attributes into a number of sub-buffers.
+ */
+static
+unsigned long channel_wakeup_watermark(struct lttng_kernel_ring_buffer_channel *chan,
+				       const struct lttng_kernel_ring_buffer_channel_attr *attr)
+{
+	unsigned long num_subbuf = chan->backend.num_subbuf;
+	unsigned long watermark = attr->wakeup_watermark;
+
+	if (attr->wakeup_watermark_pct) {
+		unsigned long pct_watermark;
+
+		pct_watermark = max_t(unsigned long, 1,
+			num_subbuf * attr->wakeup_watermark_pct / 100);
+		if (!watermark || pct_watermark < watermark)
+			watermark = pct_watermark;
+	}
+	return min(watermark, num_subbuf);
+}
+
 /**
  * channel_create - Create channel.
  * @config: ring buffer instance configuration
@@ -835,6 +1113,7 @@ static void channel_free(struct lttng_kernel_ring_buffer_channel *chan)
  *                         padding to let readers get those sub-buffers.
  *                         Used for live streaming.
  * @read_timer_interval: Time interval (in us) to wake up pending readers.
+ * @attr: channel attributes, NULL for defaults.
  *
  * Holds cpu hotplug.
  * Returns NULL on failure.
@@ -843,7 +1122,8 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 		   const char *name, void *priv, void *buf_addr,
 		   size_t subbuf_size,
 		   size_t num_subbuf, unsigned int switch_timer_interval,
-		   unsigned int read_timer_interval)
+		   unsigned int read_timer_interval,
+		   const struct lttng_kernel_ring_buffer_channel_attr *attr)
 {
 	int ret;
 	struct lttng_kernel_ring_buffer_channel *chan;
@@ -856,6 +1136,10 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 	if (!chan)
 		return NULL;
 
+	/* Needed by the backend buffer allocation. */
+	if (attr)
+		chan->backend.attr = *attr;
+
 	ret = channel_backend_init(&chan->backend, name, config, priv,
 				   subbuf_size, num_subbuf);
 	if (ret)
@@ -867,7 +1151,14 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 
 	chan->commit_count_mask = (~0UL >> chan->backend.num_subbuf_order);
 	chan->switch_timer_interval = usecs_to_jiffies(switch_timer_interval);
+	if (chan->switch_timer_interval
+			&& chan->backend.attr.switch_timer_max_interval)
+		chan->switch_timer_max_interval =
+			max(chan->switch_timer_interval,
+			    usecs_to_jiffies(chan->backend.attr.switch_timer_max_interval));
 	chan->read_timer_interval = usecs_to_jiffies(read_timer_interval);
+	chan->wakeup_watermark = channel_wakeup_watermark(chan,
+			&chan->backend.attr);
 	kref_init(&chan->ref);
 	init_waitqueue_head(&chan->read_wait);
 	init_waitqueue_head(&chan->hp_wait);
@@ -1193,6 +1484,12 @@ void lib_ring_buffer_move_consumer(struct lttng_kernel_ring_buffer *buf,
 	while ((long) consumed - (long) consumed_new < 0)
 		consumed = atomic_long_cmpxchg(&buf->consumed, consumed,
 					       consumed_new);
+	lib_ring_buffer_ctrl_set_consumed(buf, consumed);
+	/* Re-arm the watermark wakeup. */
+	WRITE_ONCE(buf->wakeup_watermark_hit, 0);
+	/* Compress the next packet to read, if already delivered. */
+	if (buf->compress)
+		lib_ring_buffer_compress_consumed(buf);
 	/* Wake-up the metadata producer */
 	wake_up_interruptible(&buf->write_wait);
 }
@@ -1207,7 +1504,8 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 	struct lttng_kernel_ring_buffer_backend_pages *pages;
 	unsigned long sb_bindex, id, i, nr_pages;
 
-	if (config->output != RING_BUFFER_MMAP)
+	if (config->output != RING_BUFFER_MMAP
+			&& config->backend != RING_BUFFER_VMAP)
 		return;
 
 	/*
@@ -1222,6 +1520,15 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 	id = buf->backend.buf_rsb.id;
 	sb_bindex = subbuffer_id_get_index(config, id);
 	pages = buf->backend.array[sb_bindex];
+	/*
+	 * The vmap backend writes through its own kernel alias, which
+	 * must be written back before the sub-buffer pages are read
+	 * through any other mapping (linear, splice or user-space).
+	 */
+	if (config->backend == RING_BUFFER_VMAP)
+		flush_kernel_vmap_range(pages->virt, chan->backend.subbuf_size);
+	if (config->output != RING_BUFFER_MMAP)
+		return;
 	nr_pages = buf->backend.num_pages_per_subbuf;
 	for (i = 0; i < nr_pages; i++) {
 		struct lttng_kernel_ring_buffer_backend_page *backend_page;
@@ -1239,45 +1546,17 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 }
 #endif
 
-/**
- * lib_ring_buffer_get_subbuf - get exclusive access to subbuffer for reading
- * @buf: ring buffer
- * @consumed: consumed count indicating the position where to read
- *
- * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
- * data to read at consumed position, or 0 if the get operation succeeds.
- * Busy-loop trying to get data if the tick_nohz sequence lock is held.
+/*
+ * Order the reader's commit count loads before its loads of the buffer data
+ * and write offset.
  */
-int lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
-			       unsigned long consumed)
+static
+void lib_ring_buffer_read_commit_barrier(const struct lttng_kernel_ring_buffer_config *config,
+					 struct lttng_kernel_ring_buffer *buf)
 {
-	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
-	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
-	unsigned long consumed_cur, consumed_idx, commit_count, write_offset;
-	int ret;
-	int finalized;
-
-	if (buf->get_subbuf) {
-		/*
-		 * Reader is trying to get a subbuffer twice.
-		 */
-		CHAN_WARN_ON(chan, 1);
-		return -EBUSY;
-	}
-retry:
-	finalized = LTTNG_READ_ONCE(buf->finalized);
-	/*
-	 * Read finalized before counters.
-	 */
-	smp_rmb();
-	consumed_cur = atomic_long_read(&buf->consumed);
-	consumed_idx = subbuf_index(consumed, chan);
-	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
 	/*
-	 * Make sure we read the commit count before reading the buffer
-	 * data and the write offset. Correct consumed offset ordering
-	 * wrt commit count is insured by the use of cmpxchg to update
-	 * the consumed offset.
+	 * Correct consumed offset ordering wrt commit count is insured by the
+	 * use of cmpxchg to update the consumed offset.
 	 * smp_call_function_single can fail if the remote CPU is offline,
 	 * this is OK because then there is no wmb to execute there.
 	 * If our thread is executing on the same CPU as the on the buffers
@@ -1335,6 +1614,47 @@ retry:
 		 */
 		smp_rmb();
 	}
+}
+
+/**
+ * lib_ring_buffer_get_subbuf - get exclusive access to subbuffer for reading
+ * @buf: ring buffer
+ * @consumed: consumed count indicating the position where to read
+ *
+ * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
+ * data to read at consumed position, or 0 if the get operation succeeds.
+ * Busy-loop trying to get data if the tick_nohz sequence lock is held.
+ */
+int lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
+			       unsigned long consumed)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed_cur, consumed_idx, commit_count, write_offset;
+	int ret;
+	int finalized;
+
+	if (buf->get_subbuf) {
+		/*
+		 * Reader is trying to get a subbuffer twice.
+		 */
+		CHAN_WARN_ON(chan, 1);
+		return -EBUSY;
+	}
+retry:
+	finalized = LTTNG_READ_ONCE(buf->finalized);
+	/*
+	 * Read finalized before counters.
+	 */
+	smp_rmb();
+	consumed_cur = atomic_long_read(&buf->consumed);
+	consumed_idx = subbuf_index(consumed, chan);
+	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
+	/*
+	 * Make sure we read the commit count before reading the buffer
+	 * data and the write offset.
+	 */
+	lib_ring_buffer_read_commit_barrier(config, buf);
 
 	write_offset = v_read(config, &buf->offset);
 
@@ -1379,6 +1699,7 @@ retry:
 	subbuffer_id_clear_noref(config, &buf->backend.buf_rsb.id);
 
 	buf->get_subbuf_consumed = consumed;
+	buf->get_subbuf_count = 1;
 	buf->get_subbuf = 1;
 
 	lib_ring_buffer_flush_read_subbuf_dcache(config, chan, buf);
@@ -1421,6 +1742,7 @@ void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf)
 	}
 	consumed = buf->get_subbuf_consumed;
 	buf->get_subbuf = 0;
+	buf->get_subbuf_count = 0;
 
 	/*
 	 * Clear the records_unread counter. (overruns counter)
@@ -1456,6 +1778,118 @@ void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf)
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_put_subbuf);
 
+/**
+ * lib_ring_buffer_get_next_subbufs - get exclusive access to the next ready subbuffers
+ * @buf: ring buffer
+ * @count: in: maximum number of subbuffers to get, out: number of subbuffers held
+ *
+ * Gets the consecutive subbuffers starting at the consumer position
+ * (buf->cons_snapshot) which are ready for reading, with a single memory
+ * barrier sequence for the whole batch. They are released together by
+ * lib_ring_buffer_put_next_subbufs(). In overwrite mode, the reader owns a
+ * single subbuffer at a time, so at most one subbuffer is held.
+ *
+ * Returns the same values as lib_ring_buffer_get_next_subbuf(), or -EINVAL if
+ * @count is 0.
+ */
+int lib_ring_buffer_get_next_subbufs(struct lttng_kernel_ring_buffer *buf,
+				     unsigned long *count)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed, consumed_idx, commit_count, nr, max_nr, first_id;
+	int ret;
+
+	if (!*count)
+		return -EINVAL;
+	ret = lib_ring_buffer_get_next_subbuf(buf);
+	if (ret)
+		return ret;
+	if (config->mode == RING_BUFFER_OVERWRITE)
+		max_nr = 1;
+	else
+		max_nr = min_t(unsigned long, *count,
+			(buf->prod_snapshot - buf->cons_snapshot)
+				>> chan->backend.subbuf_size_order);
+
+	/*
+	 * Subbuffers before the produced position snapshot are not written to
+	 * by the writer head. In discard mode, they cannot be reclaimed by
+	 * writers until the consumer position moves past them.
+	 */
+	for (nr = 1; nr < max_nr; nr++) {
+		consumed = buf->cons_snapshot + (nr << chan->backend.subbuf_size_order);
+		consumed_idx = subbuf_index(consumed, chan);
+		commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
+		if (((commit_count - chan->backend.subbuf_size)
+		     & chan->commit_count_mask)
+		    - (buf_trunc(consumed, chan)
+		       >> chan->backend.num_subbuf_order)
+		    != 0)
+			break;
+	}
+	if (nr > 1) {
+		unsigned long i;
+
+		lib_ring_buffer_read_commit_barrier(config, buf);
+		first_id = buf->backend.buf_rsb.id;
+		for (i = 1; i < nr; i++) {
+			consumed = buf->cons_snapshot + (i << chan->backend.subbuf_size_order);
+			consumed_idx = subbuf_index(consumed, chan);
+			buf->backend.buf_rsb.id = buf->backend.buf_wsb[consumed_idx].id;
+			lib_ring_buffer_flush_read_subbuf_dcache(config, chan, buf);
+		}
+		buf->backend.buf_rsb.id = first_id;
+	}
+	buf->get_subbuf_count = nr;
+	*count = nr;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_next_subbufs);
+
+/**
+ * lib_ring_buffer_put_next_subbufs - release subbuffers, move consumer forward
+ * @buf: ring buffer
+ *
+ * Releases the subbuffers held by lib_ring_buffer_get_next_subbufs(), or by
+ * lib_ring_buffer_get_next_subbuf().
+ */
+void lib_ring_buffer_put_next_subbufs(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
+	struct lttng_kernel_ring_buffer_channel *chan = bufb->chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long i, nr = buf->get_subbuf_count;
+
+	if (!buf->get_subbuf) {
+		/*
+		 * Reader puts subbuffers it did not get.
+		 */
+		CHAN_WARN_ON(chan, 1);
+		return;
+	}
+	/*
+	 * Clear the records_unread counters of the subbuffers following the
+	 * first one. lib_ring_buffer_put_subbuf() takes care of the first.
+	 */
+	for (i = 1; i < nr; i++) {
+		unsigned long consumed_idx, sb_bindex;
+
+		consumed_idx = subbuf_index(buf->cons_snapshot
+				+ (i << chan->backend.subbuf_size_order), chan);
+		sb_bindex = subbuffer_id_get_index(config,
+				bufb->buf_wsb[consumed_idx].id);
+		v_add(config, v_read(config,
+				     &bufb->array[sb_bindex]->records_unread),
+		      &bufb->records_read);
+		v_set(config, &bufb->array[sb_bindex]->records_unread, 0);
+	}
+	lib_ring_buffer_put_subbuf(buf);
+	lib_ring_buffer_move_consumer(buf, subbuf_align(buf->cons_snapshot, chan)
+			+ ((nr - 1) << chan->backend.subbuf_size_order));
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_put_next_subbufs);
+
 /*
  * cons_offset is an iterator on all subbuffer offsets between the reader
  * position and the writer position. (inclusive)
@@ -1807,6 +2241,10 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 
 		/* Test new buffer integrity */
 		sb_index = subbuf_index(offsets->begin, chan);
+		/* Lazily allocated sub-buffer without pages yet. */
+		if (!lib_ring_buffer_backend_subbuf_ready(config, &buf->backend,
+				sb_index))
+			return -1;
 		commit_count = v_read(config,
 				&buf->commit_cold[sb_index].cc_sb);
 		reserve_commit_diff =
@@ -1817,8 +2255,8 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 			/* Next subbuffer not being written to. */
 			if (unlikely(config->mode != RING_BUFFER_OVERWRITE &&
 				subbuf_trunc(offsets->begin, chan)
-				 - subbuf_trunc((unsigned long)
-				     atomic_long_read(&buf->consumed), chan)
+				 - subbuf_trunc(lib_ring_buffer_ctrl_pull_consumed(config,
+						buf, chan, offsets->begin), chan)
 				>= chan->backend.buf_size)) {
 				/*
 				 * We do not overwrite non consumed buffers
@@ -2048,6 +2486,14 @@ retry:
 				 + config->cb.subbuffer_header_size();
 		/* Test new buffer integrity */
 		sb_index = subbuf_index(offsets->begin, chan);
+		if (unlikely(!lib_ring_buffer_lazy_populate(config, buf, sb_index))) {
+			/*
+			 * Lazily allocated buffer still filling its emergency
+			 * sub-buffer: record is lost.
+			 */
+			v_inc(config, &buf->records_lost_full);
+			return -ENOBUFS;
+		}
 		/*
 		 * Read buf->offset before buf->commit_cold[sb_index].cc_sb.
 		 * lib_ring_buffer_check_deliver() has the matching
@@ -2077,8 +2523,8 @@ retry:
 			/* Next subbuffer not being written to. */
 			if (unlikely(config->mode != RING_BUFFER_OVERWRITE &&
 				subbuf_trunc(offsets->begin, chan)
-				 - subbuf_trunc((unsigned long)
-				     atomic_long_read(&buf->consumed), chan)
+				 - subbuf_trunc(lib_ring_buffer_ctrl_pull_consumed(config,
+						buf, chan, offsets->begin), chan)
 				>= chan->backend.buf_size)) {
 				/*
 				 * We do not overwrite non consumed buffers
@@ -2274,6 +2720,28 @@ void deliver_count_events(const struct lttng_kernel_ring_buffer_config *config,
 }
 #endif /* #else LTTNG_RING_BUFFER_COUNT_EVENTS */
 
+/*
+ * Returns whether the sub-buffer delivered at @offset brings the number of
+ * sub-buffers ready for reading to the wakeup watermark. Only the first
+ * delivery reaching it after each consumer position update wakes the reader.
+ */
+static
+bool lib_ring_buffer_wakeup_watermark_reached(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_ring_buffer_channel *chan,
+		unsigned long offset)
+{
+	unsigned long ready;
+
+	ready = (subbuf_align(offset, chan)
+		 - subbuf_trunc(atomic_long_read(&buf->consumed), chan))
+			>> chan->backend.subbuf_size_order;
+	if (ready < chan->wakeup_watermark)
+		return false;
+	if (READ_ONCE(buf->wakeup_watermark_hit))
+		return false;
+	return !xchg(&buf->wakeup_watermark_hit, 1);
+}
 
 void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_config *config,
 				   struct lttng_kernel_ring_buffer *buf,
@@ -2357,6 +2825,10 @@ void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_co
 		lib_ring_buffer_set_noref_offset(config, &buf->backend, idx,
 						 buf_trunc_val(offset, chan));
 
+		/* Publish the delivered sub-buffer to the control pages. */
+		lib_ring_buffer_ctrl_deliver(config, buf, chan, offset,
+					     commit_count, idx);
+
 		/*
 		 * Order set_noref and record counter updates before the
 		 * end of subbuffer exclusive access. Orders with
@@ -2375,11 +2847,23 @@ void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_co
 		lib_ring_buffer_vmcore_check_deliver(config, buf,
 						 commit_count, idx);
 
+		if (buf->compress)
+			lib_ring_buffer_compress_deliver(buf);
+
 		/*
 		 * RING_BUFFER_WAKEUP_BY_WRITER uses an irq_work to issue
-		 * the wakeups.
+		 * the wakeups. With a wakeup watermark, the writer issues
+		 * them only once enough sub-buffers are ready, whatever
+		 * the wakeup mode.
 		 */
-		if (config->wakeup == RING_BUFFER_WAKEUP_BY_WRITER
+		if (chan->wakeup_watermark) {
+			if (atomic_long_read(&buf->active_readers)
+			    && lib_ring_buffer_wakeup_watermark_reached(config,
+						buf, chan, offset)) {
+				irq_work_queue(&buf->wakeup_pending);
+				irq_work_queue(&chan->wakeup_pending);
+			}
+		} else if (config->wakeup == RING_BUFFER_WAKEUP_BY_WRITER
 		    && atomic_long_read(&buf->active_readers)
 		    && lib_ring_buffer_poll_deliver(config, buf, chan)) {
 			irq_work_queue(&buf->wakeup_pending);
@@ -2403,6 +2887,7 @@ module_init(init_lib_ring_buffer_frontend);
 
 void __exit exit_lib_ring_buffer_frontend(void)
 {
+	lib_ring_buffer_backend_exit();
 }
 
 module_exit(exit_lib_ring_buffer_frontend);
@@ -12,11 +12,56 @@
 
 #include <linux/module.h>
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/huge_mm.h>
+#include <linux/pfn_t.h>
 
 #include <ringbuffer/backend.h>
 #include <ringbuffer/frontend.h>
 #include <ringbuffer/vfs.h>
 
+/*
+ * Get the backend pages mapped at @offset in the buffer data mapping if the
+ * reader owns them, NULL otherwise. The reader owns the reader sub-buffer and,
+ * in discard mode, the sub-buffers following it held by
+ * lib_ring_buffer_get_next_subbufs(). Once the control area is set up, the
+ * reader accesses delivered sub-buffers in place, which it may do in discard
+ * mode only: all sub-buffers are mapped then. Sub-buffers are laid out in the
+ * mapping in backend pages index order.
+ */
+static
+struct lttng_kernel_ring_buffer_backend_pages *
+lib_ring_buffer_mmap_get_pages(struct lttng_kernel_ring_buffer *buf,
+			       unsigned long offset)
+{
+	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
+	struct lttng_kernel_ring_buffer_channel *chan = bufb->chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long sb_bindex, i, nr;
+
+	sb_bindex = offset >> chan->backend.subbuf_size_order;
+	if (sb_bindex >= chan->backend.num_subbuf + chan->backend.extra_reader_sb)
+		return NULL;
+	if (sb_bindex == subbuffer_id_get_index(config, bufb->buf_rsb.id))
+		return bufb->array[sb_bindex];
+	if (config->mode != RING_BUFFER_DISCARD)
+		return NULL;
+	if (READ_ONCE(buf->ctrl_area))
+		return bufb->array[sb_bindex];
+	if (!buf->get_subbuf)
+		return NULL;
+	nr = READ_ONCE(buf->get_subbuf_count);
+	for (i = 1; i < nr; i++) {
+		unsigned long idx;
+
+		idx = subbuf_index(buf->cons_snapshot
+				+ (i << chan->backend.subbuf_size_order), chan);
+		if (sb_bindex == subbuffer_id_get_index(config, bufb->buf_wsb[idx].id))
+			return bufb->array[sb_bindex];
+	}
+	return NULL;
+}
+
 /*
  * fault() vm_op implementation for ring buffer file mapping.
  */
@@ -29,31 +74,23 @@ static int lib_ring_buffer_fault_compat(struct vm_area_struct *vma, struct vm_fa
 {
 	struct lttng_kernel_ring_buffer *buf = vma->vm_private_data;
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
-	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_ring_buffer_backend_pages *rpages;
 	pgoff_t pgoff = vmf->pgoff;
-	unsigned long *pfnp;
-	void **virt;
-	unsigned long offset, sb_bindex;
+	unsigned long offset, pfn;
 
 	/*
 	 * Verify that faults are only done on the range of pages owned by the
 	 * reader.
 	 */
 	offset = pgoff << PAGE_SHIFT;
-	sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_rsb.id);
-	if (!(offset >= buf->backend.array[sb_bindex]->mmap_offset
-	      && offset < buf->backend.array[sb_bindex]->mmap_offset +
-			  buf->backend.chan->backend.subbuf_size))
+	rpages = lib_ring_buffer_mmap_get_pages(buf, offset);
+	if (!rpages)
 		return VM_FAULT_SIGBUS;
-	/*
-	 * ring_buffer_read_get_pfn() gets the page frame number for the
-	 * current reader's pages.
-	 */
-	pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, offset, &virt);
-	if (!*pfnp)
+	pfn = rpages->p[(offset & (chan->backend.subbuf_size - 1)) >> PAGE_SHIFT].pfn;
+	if (!pfn)
 		return VM_FAULT_SIGBUS;
-	get_page(pfn_to_page(*pfnp));
-	vmf->page = pfn_to_page(*pfnp);
+	get_page(pfn_to_page(pfn));
+	vmf->page = pfn_to_page(pfn);
 
 	return 0;
 }
@@ -78,13 +115,105 @@ static int lib_ring_buffer_fault(struct vm_area_struct *vma, struct vm_fault *vm
 }
 #endif /* #else #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,11,0)) */
 
+#if (defined(CONFIG_TRANSPARENT_HUGEPAGE) && \
+	LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,2,0))
+#define LTTNG_RING_BUFFER_HUGE_FAULT
+
+/*
+ * Map the huge page backing the faulting address with a single PMD. Only
+ * possible when the PMD-aligned range covers a whole huge page of the
+ * reader's sub-buffer, which requires user-space to map the buffer at a
+ * PMD-aligned address. Fall back to page-sized faults otherwise.
+ */
+static vm_fault_t lib_ring_buffer_huge_fault_pmd(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct lttng_kernel_ring_buffer *buf = vma->vm_private_data;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	struct lttng_kernel_ring_buffer_backend_pages *rpages;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	unsigned long offset, pfn;
+	struct page *page;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	offset = (haddr - vma->vm_start) + (vma->vm_pgoff << PAGE_SHIFT);
+	if (offset & ~HPAGE_PMD_MASK)
+		return VM_FAULT_FALLBACK;
+	if ((offset & (chan->backend.subbuf_size - 1)) + HPAGE_PMD_SIZE
+			> chan->backend.subbuf_size)
+		return VM_FAULT_FALLBACK;
+	rpages = lib_ring_buffer_mmap_get_pages(buf, offset);
+	if (!rpages)
+		return VM_FAULT_FALLBACK;
+	pfn = rpages->p[(offset & (chan->backend.subbuf_size - 1)) >> PAGE_SHIFT].pfn;
+	if (!pfn)
+		return VM_FAULT_FALLBACK;
+	page = pfn_to_page(pfn);
+	if (!PageHead(page) || compound_order(page) != HPAGE_PMD_ORDER)
+		return VM_FAULT_FALLBACK;
+	return vmf_insert_pfn_pmd(vmf, __pfn_to_pfn_t(pfn, 0),
+			vmf->flags & FAULT_FLAG_WRITE);
+}
+
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,6,0))
+static vm_fault_t lib_ring_buffer_huge_fault(struct vm_fault *vmf,
+		unsigned int order)
+{
+	if (order != HPAGE_PMD_ORDER)
+		return VM_FAULT_FALLBACK;
+	return lib_ring_buffer_huge_fault_pmd(vmf);
+}
+#else /* #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,6,0)) */
+static vm_fault_t lib_ring_buffer_huge_fault(struct vm_fault *vmf,
+		enum page_entry_size pe_size)
+{
+	if (pe_size != PE_SIZE_PMD)
+		return VM_FAULT_FALLBACK;
+	return lib_ring_buffer_huge_fault_pmd(vmf);
+}
+#endif /* #else #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,6,0)) */
+#endif /* #if (defined(CONFIG_TRANSPARENT_HUGEPAGE) && ... */
+
 /*
  * vm_ops for ring buffer file mappings.
  */
 static const struct vm_operations_struct lib_ring_buffer_mmap_ops = {
 	.fault = lib_ring_buffer_fault,
+#ifdef LTTNG_RING_BUFFER_HUGE_FAULT
+	.huge_fault = lib_ring_buffer_huge_fault,
+#endif
 };
 
+/*
+ * Map either the consumer cursor page (writable) or the control pages
+ * (read-only) of the stream control area. They follow the buffer data in the
+ * file mapping offsets.
+ */
+static int lib_ring_buffer_mmap_ctrl(struct lttng_kernel_ring_buffer *buf,
+				     struct vm_area_struct *vma,
+				     unsigned long mmap_buf_len)
+{
+	unsigned long length = vma->vm_end - vma->vm_start;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	void *area = READ_ONCE(buf->ctrl_area);
+
+	if (!area)
+		return -EINVAL;
+	if (vma->vm_pgoff == mmap_buf_len >> PAGE_SHIFT) {
+		if (length != PAGE_SIZE)
+			return -EINVAL;
+		return remap_vmalloc_range(vma, area, 0);
+	}
+	if (vma->vm_pgoff != (mmap_buf_len >> PAGE_SHIFT) + 1
+			|| length != lib_ring_buffer_ctrl_len(chan))
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, area, 1);
+}
+
 /**
  *	lib_ring_buffer_mmap_buf: - mmap channel buffer to process address space
  *	@buf: ring buffer to map
@@ -109,11 +238,24 @@ static int lib_ring_buffer_mmap_buf(struct lttng_kernel_ring_buffer *buf,
 	if (chan->backend.extra_reader_sb)
 		mmap_buf_len += chan->backend.subbuf_size;
 
+	if (vma->vm_pgoff)
+		return lib_ring_buffer_mmap_ctrl(buf, vma, mmap_buf_len);
+
 	if (length != mmap_buf_len)
 		return -EINVAL;
 
 	vma->vm_ops = &lib_ring_buffer_mmap_ops;
 	vma->vm_flags |= VM_DONTEXPAND;
+#ifdef LTTNG_RING_BUFFER_HUGE_FAULT
+	/*
+	 * Huge PMDs are inserted by pfn, which requires a mixed map. Mark the
+	 * mapping as huge page eligible so it does not depend on the
+	 * transparent hugepage "always" policy.
+	 */
+	if (chan->backend.attr.huge_pages
+			&& chan->backend.subbuf_size >= HPAGE_PMD_SIZE)
+		vma->vm_flags |= VM_MIXEDMAP | VM_HUGEPAGE;
+#endif
 	vma->vm_private_data = buf;
 
 	return 0;
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR LGPL-2.1-only)
+ *
+ * ring_buffer_read.c
+ *
+ * Ring buffer read(2) of whole sub-buffers (RING_BUFFER_READ output).
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+
+#include <wrapper/uaccess.h>
+#include <ringbuffer/backend.h>
+#include <ringbuffer/frontend.h>
+#include <ringbuffer/vfs.h>
+
+/*
+ * Get the next sub-buffer, waiting for one to be ready unless the file is in
+ * non-blocking mode. Returns 0 on success, -ENODATA at end of stream, or a
+ * negative error.
+ */
+static
+int subbuf_read_get_next(struct file *filp, struct lttng_kernel_ring_buffer *buf,
+		int wait)
+{
+	int ret, error;
+
+	ret = lib_ring_buffer_get_next_subbuf(buf);
+	if (ret != -EAGAIN || !wait)
+		return ret;
+	if (filp->f_flags & O_NONBLOCK)
+		return -EAGAIN;
+	error = wait_event_interruptible(buf->read_wait,
+			((ret = lib_ring_buffer_get_next_subbuf(buf)), ret != -EAGAIN));
+	if (error)
+		return error;
+	return ret;
+}
+
+/**
+ * lib_ring_buffer_subbuf_read - read whole sub-buffers to user-space
+ * @filp: the file
+ * @user_buf: user-space destination buffer
+ * @count: size of @user_buf
+ * @buf: ring buffer to read from
+ *
+ * Consume as many complete sub-buffers as fit in @user_buf. Each sub-buffer
+ * is copied up to its page-aligned size, as reported by
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_PADDED_SUBBUF_SIZE, and sub-buffers are
+ * laid out back to back in @user_buf. Only waits for data when none has been
+ * copied yet.
+ *
+ * Returns the number of bytes read, 0 at end of stream, -EAGAIN if no
+ * sub-buffer is ready in non-blocking mode, or -EINVAL if the next sub-buffer
+ * does not fit in @count bytes (see
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_MAX_SUBBUF_SIZE).
+ */
+ssize_t lib_ring_buffer_subbuf_read(struct file *filp, char __user *user_buf,
+		size_t count, struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	size_t read_count = 0;
+	int ret;
+
+	if (config->output != RING_BUFFER_READ)
+		return -EINVAL;
+	if (lib_ring_buffer_channel_is_disabled(chan))
+		return -EIO;
+
+	might_sleep();
+	if (!lttng_access_ok(VERIFY_WRITE, user_buf, count))
+		return -EFAULT;
+
+	for (;;) {
+		unsigned long len;
+
+		ret = subbuf_read_get_next(filp, buf, !read_count);
+		if (ret)
+			break;
+		len = PAGE_ALIGN(lib_ring_buffer_get_read_data_size(config, buf));
+		if (len > count - read_count) {
+			/* Keep the sub-buffer for the next read. */
+			lib_ring_buffer_put_subbuf(buf);
+			ret = -EINVAL;
+			break;
+		}
+		if (__lib_ring_buffer_copy_to_user(&buf->backend,
+				buf->cons_snapshot, user_buf + read_count, len)) {
+			lib_ring_buffer_put_subbuf(buf);
+			ret = -EFAULT;
+			break;
+		}
+		lib_ring_buffer_put_next_subbuf(buf);
+		read_count += len;
+	}
+
+	if (read_count)
+		return read_count;
+	if (ret == -ENODATA)
+		return 0;	/* End of stream. */
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_subbuf_read);
+
+/**
+ *	vfs_lib_ring_buffer_subbuf_read - read file op
+ *	@filp: the file
+ *	@user_buf: user-space destination buffer
+ *	@count: size of @user_buf
+ *	@ppos: file position (unused, the stream is not seekable)
+ *
+ *	Calls upon lib_ring_buffer_subbuf_read() to consume sub-buffers.
+ */
+ssize_t vfs_lib_ring_buffer_subbuf_read(struct file *filp,
+		char __user *user_buf, size_t count, loff_t *ppos)
+{
+	struct lttng_kernel_ring_buffer *buf = filp->private_data;
+
+	return lib_ring_buffer_subbuf_read(filp, user_buf, count, buf);
+}
+EXPORT_SYMBOL_GPL(vfs_lib_ring_buffer_subbuf_read);
@@ -89,6 +89,31 @@ static void lib_ring_buffer_page_release(struct splice_pipe_desc *spd,
 	__free_page(spd->pages[i]);
 }
 
+/*
+ * Get the backend pages of sub-buffer @i among those held by the reader: the
+ * reader sub-buffer, then the sub-buffers following it held by
+ * lib_ring_buffer_get_next_subbufs().
+ */
+static
+struct lttng_kernel_ring_buffer_backend_pages *
+lib_ring_buffer_splice_get_pages(struct lttng_kernel_ring_buffer *buf,
+				 unsigned long i)
+{
+	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
+	struct lttng_kernel_ring_buffer_channel *chan = bufb->chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long id, idx;
+
+	if (!i) {
+		id = bufb->buf_rsb.id;
+	} else {
+		idx = subbuf_index(buf->cons_snapshot
+				+ (i << chan->backend.subbuf_size_order), chan);
+		id = bufb->buf_wsb[idx].id;
+	}
+	return bufb->array[subbuffer_id_get_index(config, id)];
+}
+
 /*
  *	subbuf_splice_actor - splice up to one subbuf's worth of data
  */
@@ -114,8 +139,9 @@ static int subbuf_splice_actor(struct file *in,
 		.ops = &ring_buffer_pipe_buf_ops,
 		.spd_release = lib_ring_buffer_page_release,
 	};
+	struct lttng_kernel_ring_buffer_backend_pages *rpages;
 	unsigned long consumed_old, roffset;
-	unsigned long bytes_avail;
+	unsigned long bytes_avail, subbuf;
 
 	/*
 	 * Check that a GET_SUBBUF ioctl has been done before.
@@ -126,10 +152,14 @@ static int subbuf_splice_actor(struct file *in,
 
 	/*
 	 * Adjust read len, if longer than what is available.
-	 * Max read size is 1 subbuffer due to get_subbuf/put_subbuf for
-	 * protection.
+	 * Max read size is the end of the subbuffer at the file position,
+	 * among those held by get_subbuf(s)/put_subbuf(s) for protection.
 	 */
-	bytes_avail = chan->backend.subbuf_size;
+	subbuf = *ppos >> chan->backend.subbuf_size_order;
+	if (subbuf && subbuf >= buf->get_subbuf_count)
+		return 0;
+	rpages = lib_ring_buffer_splice_get_pages(buf, subbuf);
+	bytes_avail = chan->backend.subbuf_size - subbuf_offset(*ppos, chan);
 	WARN_ON(bytes_avail > chan->backend.buf_size);
 	len = min_t(size_t, len, bytes_avail);
 	subbuf_pages = bytes_avail >> PAGE_SHIFT;
@@ -141,7 +171,7 @@ static int subbuf_splice_actor(struct file *in,
 
 	for (; spd.nr_pages < nr_pages; spd.nr_pages++) {
 		unsigned int this_len;
-		unsigned long *pfnp, new_pfn;
+		unsigned long *pfnp, new_pfn, index;
 		struct page *new_page;
 		void **virt;
 
@@ -161,7 +191,9 @@ static int subbuf_splice_actor(struct file *in,
 			break;
 		new_pfn = page_to_pfn(new_page);
 		this_len = PAGE_SIZE - poff;
-		pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, roffset, &virt);
+		index = (roffset & (chan->backend.subbuf_size - 1)) >> PAGE_SHIFT;
+		pfnp = &rpages->p[index].pfn;
+		virt = &rpages->p[index].virt;
 		spd.pages[spd.nr_pages] = pfn_to_page(*pfnp);
 		*pfnp = new_pfn;
 		*virt = page_address(new_page);
@@ -191,6 +223,12 @@ ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 
 	if (config->output != RING_BUFFER_SPLICE)
 		return -EINVAL;
+	/* The vmap alias would keep pointing to the pages given away. */
+	if (config->backend == RING_BUFFER_VMAP)
+		return -EINVAL;
+	/* Tail pages of a huge page cannot be given away one by one. */
+	if (chan->backend.attr.huge_pages)
+		return -EINVAL;
 
 	/*
 	 * We require ppos and length to be page-aligned for performance reasons
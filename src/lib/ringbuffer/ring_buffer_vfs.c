@@ -167,6 +167,83 @@ unsigned int vfs_lib_ring_buffer_poll(struct file *filp, poll_table *wait)
 	return lib_ring_buffer_poll(filp, wait, buf);
 }
 
+static
+long lib_ring_buffer_ioctl_get_next_subbufs(struct file *filp,
+		struct lttng_kernel_ring_buffer *buf, void __user *uarg)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_abi_ring_buffer_subbuf_info __user *uinfo;
+	struct lttng_kernel_abi_ring_buffer_subbufs subbufs;
+	unsigned long count, i;
+	int ret;
+
+	if (copy_from_user(&subbufs, uarg, sizeof(subbufs)))
+		return -EFAULT;
+	count = subbufs.count;
+	ret = lib_ring_buffer_get_next_subbufs(buf, &count);
+	if (ret)
+		return ret;
+	/* Set file position to zero at each successful "get" */
+	filp->f_pos = 0;
+	uinfo = (struct lttng_kernel_abi_ring_buffer_subbuf_info __user *)
+			(unsigned long) subbufs.info;
+	for (i = 0; uinfo && i < count; i++) {
+		struct lttng_kernel_abi_ring_buffer_subbuf_info info;
+		unsigned long id, sb_bindex;
+
+		if (config->mode == RING_BUFFER_OVERWRITE) {
+			id = buf->backend.buf_rsb.id;
+		} else {
+			unsigned long idx;
+
+			idx = subbuf_index(buf->cons_snapshot
+					+ (i << chan->backend.subbuf_size_order), chan);
+			id = buf->backend.buf_wsb[idx].id;
+		}
+		sb_bindex = subbuffer_id_get_index(config, id);
+		info.mmap_offset = buf->backend.array[sb_bindex]->mmap_offset;
+		info.data_size = buf->backend.array[sb_bindex]->data_size;
+		if (copy_to_user(&uinfo[i], &info, sizeof(info)))
+			goto fault;
+	}
+	subbufs.consumed = buf->cons_snapshot;
+	subbufs.count = count;
+	if (copy_to_user(uarg, &subbufs, sizeof(subbufs)))
+		goto fault;
+	return 0;
+
+fault:
+	/* Release without consuming, so the data can be read again. */
+	lib_ring_buffer_put_subbuf(buf);
+	return -EFAULT;
+}
+
+static
+long lib_ring_buffer_get_ctrl_layout(struct lttng_kernel_ring_buffer *buf,
+		unsigned long arg)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	struct lttng_kernel_abi_ring_buffer_ctrl_layout layout;
+	unsigned long mmap_buf_len;
+	int ret;
+
+	ret = lib_ring_buffer_ctrl_open(buf);
+	if (ret)
+		return ret;
+	mmap_buf_len = chan->backend.buf_size;
+	if (chan->backend.extra_reader_sb)
+		mmap_buf_len += chan->backend.subbuf_size;
+	memset(&layout, 0, sizeof(layout));
+	layout.cursor_offset = mmap_buf_len;
+	layout.cursor_len = PAGE_SIZE;
+	layout.ctrl_offset = mmap_buf_len + PAGE_SIZE;
+	layout.ctrl_len = lib_ring_buffer_ctrl_len(chan);
+	if (copy_to_user((void __user *) arg, &layout, sizeof(layout)))
+		return -EFAULT;
+	return 0;
+}
+
 long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 		unsigned long arg, struct lttng_kernel_ring_buffer *buf)
 {
@@ -266,6 +343,17 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	case LTTNG_KERNEL_ABI_RING_BUFFER_CLEAR:
 		lib_ring_buffer_clear(buf);
 		return 0;
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUFS:
+		return lib_ring_buffer_ioctl_get_next_subbufs(filp, buf,
+				(void __user *) arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUFS:
+		lib_ring_buffer_put_next_subbufs(buf);
+		return 0;
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT:
+		return lib_ring_buffer_get_ctrl_layout(buf, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_PACKET:
+		return lib_ring_buffer_get_compressed_packet(buf,
+				(void __user *) arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -420,6 +508,18 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_CLEAR:
 		lib_ring_buffer_clear(buf);
 		return 0;
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NEXT_SUBBUFS:
+		return lib_ring_buffer_ioctl_get_next_subbufs(filp, buf,
+				compat_ptr(arg));
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_PUT_NEXT_SUBBUFS:
+		lib_ring_buffer_put_next_subbufs(buf);
+		return 0;
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_CTRL_LAYOUT:
+		return lib_ring_buffer_get_ctrl_layout(buf,
+				(unsigned long) compat_ptr(arg));
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_PACKET:
+		return lib_ring_buffer_get_compressed_packet(buf,
+				compat_ptr(arg));
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -441,6 +541,7 @@ const struct file_operations lib_ring_buffer_file_operations = {
 	.open = vfs_lib_ring_buffer_open,
 	.release = vfs_lib_ring_buffer_release,
 	.poll = vfs_lib_ring_buffer_poll,
+	.read = vfs_lib_ring_buffer_subbuf_read,
 	.splice_read = vfs_lib_ring_buffer_splice_read,
 	.mmap = vfs_lib_ring_buffer_mmap,
 	.unlocked_ioctl = vfs_lib_ring_buffer_ioctl,
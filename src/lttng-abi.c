@@ -484,6 +484,34 @@ static const struct file_operations lttng_proc_ops = {
 };
 #endif
 
+/*
+ * Per-cpu channel transport names, indexed by enum lttng_kernel_abi_output,
+ * enum lttng_kernel_abi_backend and overwrite mode.
+ */
+static const char *lttng_abi_transport_names[][2][2] = {
+	[LTTNG_KERNEL_ABI_SPLICE] = {
+		[LTTNG_KERNEL_ABI_BACKEND_PAGE] = {
+			"relay-discard", "relay-overwrite",
+		},
+	},
+	[LTTNG_KERNEL_ABI_MMAP] = {
+		[LTTNG_KERNEL_ABI_BACKEND_PAGE] = {
+			"relay-discard-mmap", "relay-overwrite-mmap",
+		},
+		[LTTNG_KERNEL_ABI_BACKEND_VMAP] = {
+			"relay-discard-mmap-vmap", "relay-overwrite-mmap-vmap",
+		},
+	},
+	[LTTNG_KERNEL_ABI_READ] = {
+		[LTTNG_KERNEL_ABI_BACKEND_PAGE] = {
+			"relay-discard-read", "relay-overwrite-read",
+		},
+		[LTTNG_KERNEL_ABI_BACKEND_VMAP] = {
+			"relay-discard-read-vmap", "relay-overwrite-read-vmap",
+		},
+	},
+};
+
 static
 int lttng_abi_create_channel(struct file *session_file,
 			     struct lttng_kernel_abi_channel *chan_param,
@@ -492,11 +520,101 @@ int lttng_abi_create_channel(struct file *session_file,
 	struct lttng_kernel_session *session = session_file->private_data;
 	const struct file_operations *fops = NULL;
 	const char *transport_name;
+	struct lttng_kernel_ring_buffer_channel_attr attr = {};
 	struct lttng_kernel_channel_buffer *chan;
 	struct file *chan_file;
 	int chan_fd;
 	int ret = 0;
 
+	switch (chan_param->backend) {
+	case LTTNG_KERNEL_ABI_BACKEND_PAGE:
+		break;
+	case LTTNG_KERNEL_ABI_BACKEND_VMAP:
+		/* Metadata channels only exist with the page backend. */
+		if (channel_type != PER_CPU_CHANNEL)
+			return -EINVAL;
+		/*
+		 * Splice hands the reader pages over to the pipe and swaps
+		 * new ones in, which the vmap alias would not follow.
+		 */
+		if (chan_param->output == LTTNG_KERNEL_ABI_SPLICE)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	switch (chan_param->huge_pages) {
+	case 0:
+		break;
+	case 1:
+		/*
+		 * Splice gives away single pages of the compound huge page
+		 * allocations, and read output gains nothing from them.
+		 */
+		if (chan_param->output != LTTNG_KERNEL_ABI_MMAP)
+			return -EINVAL;
+		attr.huge_pages = 1;
+		break;
+	default:
+		return -EINVAL;
+	}
+	switch (chan_param->lazy_alloc) {
+	case 0:
+		break;
+	case 1:
+		/* Lazy allocation needs the page backend and per-cpu buffers. */
+		if (channel_type != PER_CPU_CHANNEL
+				|| chan_param->backend != LTTNG_KERNEL_ABI_BACKEND_PAGE)
+			return -EINVAL;
+		attr.lazy_alloc = 1;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (chan_param->event_id_remap > 1
+			|| (chan_param->event_id_remap && channel_type != PER_CPU_CHANNEL))
+		return -EINVAL;
+	switch (chan_param->event_header) {
+	case LTTNG_KERNEL_ABI_EVENT_HEADER_AUTO:
+		break;
+	case LTTNG_KERNEL_ABI_EVENT_HEADER_COMPACT:
+		lttng_fallthrough;
+	case LTTNG_KERNEL_ABI_EVENT_HEADER_LARGE:
+		lttng_fallthrough;
+	case LTTNG_KERNEL_ABI_EVENT_HEADER_VARLEN:
+		if (channel_type != PER_CPU_CHANNEL)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (chan_param->sticky_ctx > 1
+			|| (chan_param->sticky_ctx && channel_type != PER_CPU_CHANNEL))
+		return -EINVAL;
+	switch (chan_param->compression) {
+	case LTTNG_KERNEL_ABI_COMPRESSION_NONE:
+		break;
+	case LTTNG_KERNEL_ABI_COMPRESSION_LZ4:
+#ifdef LTTNG_RING_BUFFER_COMPRESS
+		/*
+		 * Packets are compressed once delivered, which needs them to
+		 * stay untouched until consumed: discard mode only.
+		 */
+		if (channel_type != PER_CPU_CHANNEL || chan_param->overwrite)
+			return -EINVAL;
+		attr.compress = 1;
+		break;
+#else
+		return -EINVAL;
+#endif
+	default:
+		return -EINVAL;
+	}
+	if (chan_param->wakeup_watermark_pct > 100)
+		return -EINVAL;
+	attr.wakeup_watermark = chan_param->wakeup_watermark;
+	attr.wakeup_watermark_pct = chan_param->wakeup_watermark_pct;
+	attr.switch_timer_max_interval = chan_param->switch_timer_max_interval;
 	chan_fd = lttng_get_unused_fd();
 	if (chan_fd < 0) {
 		ret = chan_fd;
@@ -520,15 +638,10 @@ int lttng_abi_create_channel(struct file *session_file,
 	}
 	switch (channel_type) {
 	case PER_CPU_CHANNEL:
-		if (chan_param->output == LTTNG_KERNEL_ABI_SPLICE) {
-			transport_name = chan_param->overwrite ?
-				"relay-overwrite" : "relay-discard";
-		} else if (chan_param->output == LTTNG_KERNEL_ABI_MMAP) {
-			transport_name = chan_param->overwrite ?
-				"relay-overwrite-mmap" : "relay-discard-mmap";
-		} else {
+		if (chan_param->output >= ARRAY_SIZE(lttng_abi_transport_names))
 			return -EINVAL;
-		}
+		transport_name = lttng_abi_transport_names[chan_param->output]
+				[chan_param->backend][!!chan_param->overwrite];
 		break;
 	case METADATA_CHANNEL:
 		if (chan_param->output == LTTNG_KERNEL_ABI_SPLICE)
@@ -555,7 +668,9 @@ int lttng_abi_create_channel(struct file *session_file,
 				  chan_param->num_subbuf,
 				  chan_param->switch_timer_interval,
 				  chan_param->read_timer_interval,
-				  channel_type);
+				  &attr, chan_param->event_id_remap,
+				  chan_param->event_header,
+				  chan_param->sticky_ctx, channel_type);
 	if (!chan) {
 		ret = -EINVAL;
 		goto chan_error;
@@ -832,6 +947,7 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				(struct lttng_kernel_abi_old_channel __user *) arg,
 				sizeof(struct lttng_kernel_abi_old_channel)))
 			return -EFAULT;
+		memset(&chan_param, 0, sizeof(chan_param));
 		chan_param.overwrite = old_chan_param.overwrite;
 		chan_param.subbuf_size = old_chan_param.subbuf_size;
 		chan_param.num_subbuf = old_chan_param.num_subbuf;
@@ -867,6 +983,7 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				(struct lttng_kernel_abi_old_channel __user *) arg,
 				sizeof(struct lttng_kernel_abi_old_channel)))
 			return -EFAULT;
+		memset(&chan_param, 0, sizeof(chan_param));
 		chan_param.overwrite = old_chan_param.overwrite;
 		chan_param.subbuf_size = old_chan_param.subbuf_size;
 		chan_param.num_subbuf = old_chan_param.num_subbuf;
@@ -1326,6 +1443,12 @@ long lttng_metadata_ring_buffer_ioctl(struct file *filp,
 			goto err;
 		break;
 	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUFS:
+		/*
+		 * Metadata is output into the ring buffer one packet at a
+		 * time by GET_NEXT_SUBBUF.
+		 */
+		return -ENOSYS;
 	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_SUBBUF:
 	{
 		/*
@@ -1436,6 +1559,12 @@ long lttng_metadata_ring_buffer_compat_ioctl(struct file *filp,
 			goto err;
 		break;
 	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUFS:
+		/*
+		 * Metadata is output into the ring buffer one packet at a
+		 * time by GET_NEXT_SUBBUF.
+		 */
+		return -ENOSYS;
 	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_SUBBUF:
 	{
 		/*
@@ -2668,6 +2797,8 @@ long lttng_event_recorder_event_ioctl(struct file *file, unsigned int cmd, unsig
 	case LTTNG_KERNEL_ABI_ADD_CALLSITE:
 		return lttng_event_add_callsite(&event_recorder->parent,
 			(struct lttng_kernel_abi_event_callsite __user *) arg);
+	case LTTNG_KERNEL_ABI_EVENT_FIELDS:
+		return -EINVAL;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -2687,6 +2818,12 @@ long lttng_event_recorder_event_ioctl(struct file *file, unsigned int cmd, unsig
  *		Enable recording for this event (weak enable)
  *	LTTNG_KERNEL_ABI_DISABLE
  *		Disable recording for this event (strong disable)
+ *	LTTNG_KERNEL_ABI_EVENT_SAMPLING
+ *		Record only a sample of the hits of the events
+ *	LTTNG_KERNEL_ABI_EVENT_SAMPLING_STATS
+ *		Get the number of hits skipped by sampling
+ *	LTTNG_KERNEL_ABI_EVENT_FIELDS
+ *		Record only some payload fields of the events
  */
 static
 long lttng_event_recorder_enabler_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
@@ -2716,6 +2853,33 @@ long lttng_event_recorder_enabler_ioctl(struct file *file, unsigned int cmd, uns
 			(struct lttng_kernel_abi_filter_bytecode __user *) arg);
 	case LTTNG_KERNEL_ABI_ADD_CALLSITE:
 		return -EINVAL;
+	case LTTNG_KERNEL_ABI_EVENT_SAMPLING:
+	{
+		struct lttng_kernel_abi_event_sampling sampling_param;
+
+		if (copy_from_user(&sampling_param,
+				(struct lttng_kernel_abi_event_sampling __user *) arg,
+				sizeof(sampling_param)))
+			return -EFAULT;
+		if (validate_zeroed_padding(sampling_param.padding,
+				sizeof(sampling_param.padding)))
+			return -EINVAL;
+		return lttng_event_enabler_set_sampling(event_enabler, &sampling_param);
+	}
+	case LTTNG_KERNEL_ABI_EVENT_SAMPLING_STATS:
+	{
+		struct lttng_kernel_abi_event_sampling_stats stats;
+
+		memset(&stats, 0, sizeof(stats));
+		lttng_event_enabler_sampling_stats(event_enabler, &stats);
+		if (copy_to_user((struct lttng_kernel_abi_event_sampling_stats __user *) arg,
+				&stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
+	case LTTNG_KERNEL_ABI_EVENT_FIELDS:
+		return lttng_event_enabler_set_fields(event_enabler,
+			(struct lttng_kernel_abi_event_fields __user *) arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -2769,6 +2933,116 @@ static int put_u32(uint32_t val, unsigned long arg)
 	return put_user(val, (uint32_t __user *) arg);
 }
 
+/*
+ * Fill the packet index record of the sub-buffer currently held by the
+ * reader.
+ */
+static int lttng_stream_fill_packet_index(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_abi_packet_index *index)
+{
+	const struct lttng_kernel_channel_buffer_ops *ops = buf->backend.chan->backend.priv_ops;
+	uint64_t ts_begin, ts_end, ed, cs, ps, si, id, seq;
+
+	if (ops->priv->timestamp_begin(config, buf, &ts_begin) < 0
+			|| ops->priv->timestamp_end(config, buf, &ts_end) < 0
+			|| ops->priv->events_discarded(config, buf, &ed) < 0
+			|| ops->priv->content_size(config, buf, &cs) < 0
+			|| ops->priv->packet_size(config, buf, &ps) < 0
+			|| ops->priv->stream_id(config, buf, &si) < 0
+			|| ops->priv->instance_id(config, buf, &id) < 0
+			|| ops->priv->sequence_number(config, buf, &seq) < 0)
+		return -ENOSYS;
+	memset(index, 0, sizeof(*index));
+	index->version = LTTNG_KERNEL_ABI_PACKET_INDEX_VERSION;
+	index->offset = buf->get_subbuf_consumed;
+	index->timestamp_begin = ts_begin;
+	index->timestamp_end = ts_end;
+	index->events_discarded = ed;
+	index->content_size = cs;
+	index->packet_size = ps;
+	index->stream_id = si;
+	index->stream_instance_id = id;
+	index->seq_num = seq;
+	return 0;
+}
+
+static long lttng_stream_get_packet_index(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		unsigned long arg)
+{
+	struct lttng_kernel_abi_packet_index index;
+	int ret;
+
+	if (!buf->get_subbuf)
+		return -EINVAL;
+	ret = lttng_stream_fill_packet_index(config, buf, &index);
+	if (ret)
+		return ret;
+	if (copy_to_user((struct lttng_kernel_abi_packet_index __user *) arg,
+			&index, sizeof(index)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Walk the sub-buffers ready for reading from the consumer position, getting
+ * and putting each of them in turn to read its packet header. The consumer
+ * position is left untouched.
+ */
+static long lttng_stream_get_packet_index_batch(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		unsigned long arg)
+{
+	struct lttng_kernel_abi_packet_index_batch __user *ubatch =
+		(struct lttng_kernel_abi_packet_index_batch __user *) arg;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	struct lttng_kernel_abi_packet_index __user *uentries;
+	struct lttng_kernel_abi_packet_index_batch batch;
+	struct lttng_kernel_abi_packet_index index;
+	unsigned long consumed, produced;
+	uint32_t count = 0;
+	int ret;
+
+	/*
+	 * Getting a sub-buffer in overwrite mode exchanges it with the reader
+	 * sub-buffer: peeking at the packets past the first one would reorder
+	 * the buffer.
+	 */
+	if (config->mode == RING_BUFFER_OVERWRITE)
+		return -EINVAL;
+	if (copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+	/* The reader must not hold a sub-buffer. */
+	if (buf->get_subbuf)
+		return -EBUSY;
+	uentries = (struct lttng_kernel_abi_packet_index __user *)
+			(unsigned long) batch.entries;
+	ret = lib_ring_buffer_snapshot(buf, &consumed, &produced);
+	if (ret)
+		return ret;
+	for (; count < batch.count && (long) (produced - consumed) > 0;
+			consumed += chan->backend.subbuf_size) {
+		ret = lib_ring_buffer_get_subbuf(buf, consumed);
+		if (ret)
+			break;
+		ret = lttng_stream_fill_packet_index(config, buf, &index);
+		lib_ring_buffer_put_subbuf(buf);
+		if (ret)
+			return ret;
+		if (copy_to_user(&uentries[count], &index, sizeof(index)))
+			return -EFAULT;
+		count++;
+	}
+	/* Report packets already indexed rather than a late overrun. */
+	if (!count && ret)
+		return ret;
+	batch.count = count;
+	if (copy_to_user(ubatch, &batch, sizeof(batch)))
+		return -EFAULT;
+	return 0;
+}
+
 static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 		unsigned int cmd, unsigned long arg)
 {
@@ -2863,6 +3137,10 @@ static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 			goto error;
 		return put_u64(id, arg);
 	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_PACKET_INDEX:
+		return lttng_stream_get_packet_index(config, buf, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_PACKET_INDEX_BATCH:
+		return lttng_stream_get_packet_index_batch(config, buf, arg);
 	default:
 		return lib_ring_buffer_file_operations.unlocked_ioctl(filp,
 				cmd, arg);
@@ -2967,6 +3245,10 @@ static long lttng_stream_ring_buffer_compat_ioctl(struct file *filp,
 			goto error;
 		return put_u64(id, arg);
 	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_PACKET_INDEX:
+		return lttng_stream_get_packet_index(config, buf, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_PACKET_INDEX_BATCH:
+		return lttng_stream_get_packet_index_batch(config, buf, arg);
 	default:
 		return lib_ring_buffer_file_operations.compat_ioctl(filp,
 				cmd, arg);
@@ -2986,6 +3268,8 @@ static void lttng_stream_override_ring_buffer_fops(void)
 		lib_ring_buffer_file_operations.release;
 	lttng_stream_ring_buffer_file_operations.poll =
 		lib_ring_buffer_file_operations.poll;
+	lttng_stream_ring_buffer_file_operations.read =
+		lib_ring_buffer_file_operations.read;
 	lttng_stream_ring_buffer_file_operations.splice_read =
 		lib_ring_buffer_file_operations.splice_read;
 	lttng_stream_ring_buffer_file_operations.mmap =
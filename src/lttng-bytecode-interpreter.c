@@ -11,7 +11,9 @@
 #include <wrapper/uaccess.h>
 #include <wrapper/objtool.h>
 #include <wrapper/types.h>
+#include <wrapper/rcu.h>
 #include <linux/swab.h>
+#include <linux/hash.h>
 
 #include <lttng/lttng-bytecode.h>
 #include <lttng/string-utils.h>
@@ -452,6 +454,58 @@ end:
 	return ret;
 }
 
+/* Load an integer field with a specialized LOAD_FIELD_<type> instruction. */
+static int load_field_integer(bytecode_opcode_t load_op, const char *ptr, int64_t *v)
+{
+	switch (load_op) {
+	case BYTECODE_OP_LOAD_FIELD_S8:
+		*v = *(int8_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_S16:
+		*v = *(int16_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_S32:
+		*v = *(int32_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_S64:
+		*v = *(int64_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U8:
+		*v = *(uint8_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U16:
+		*v = *(uint16_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U32:
+		*v = *(uint32_t *) ptr;
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U64:
+		*v = *(uint64_t *) ptr;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Binary search of v in a table of sorted, disjoint ranges. */
+static bool bytecode_ranges_match(const struct bytecode_range *ranges,
+		unsigned int nr_ranges, int64_t v)
+{
+	unsigned int lo = 0, hi = nr_ranges;
+
+	/* Find the number of ranges starting at or before v. */
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) >> 1;
+
+		if (v < ranges[mid].min)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo && v <= ranges[lo - 1].max;
+}
+
 static int dynamic_load_field(struct estack_entry *stack_top)
 {
 	int ret;
@@ -910,6 +964,10 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 		[ BYTECODE_OP_UNARY_BIT_NOT ] = &&LABEL_BYTECODE_OP_UNARY_BIT_NOT,
 
 		[ BYTECODE_OP_RETURN_S64 ] = &&LABEL_BYTECODE_OP_RETURN_S64,
+
+		/* internal */
+		[ BYTECODE_OP_CMP_FIELD_IMM_S64 ] = &&LABEL_BYTECODE_OP_CMP_FIELD_IMM_S64,
+		[ BYTECODE_OP_FIELD_IN_RANGES_S64 ] = &&LABEL_BYTECODE_OP_FIELD_IN_RANGES_S64,
 	};
 #endif /* #ifndef INTERPRETER_USE_SWITCH */
 
@@ -1813,6 +1871,68 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 			PO;
 		}
 
+		OP(BYTECODE_OP_CMP_FIELD_IMM_S64):
+		{
+			struct cmp_field_imm_op *insn = (struct cmp_field_imm_op *) pc;
+			const char *ptr = &interpreter_stack_data[insn->offset];
+			int64_t v;
+			int res;
+
+			dbg_printk("op compare field offset %u with immediate\n",
+				(unsigned int) insn->offset);
+			ret = load_field_integer(insn->load_op, ptr, &v);
+			if (ret)
+				goto end;
+			switch (insn->cmp_op) {
+			case BYTECODE_OP_EQ_S64:
+				res = (v == insn->v);
+				break;
+			case BYTECODE_OP_NE_S64:
+				res = (v != insn->v);
+				break;
+			case BYTECODE_OP_GT_S64:
+				res = (v > insn->v);
+				break;
+			case BYTECODE_OP_LT_S64:
+				res = (v < insn->v);
+				break;
+			case BYTECODE_OP_GE_S64:
+				res = (v >= insn->v);
+				break;
+			case BYTECODE_OP_LE_S64:
+				res = (v <= insn->v);
+				break;
+			default:
+				ret = -EINVAL;
+				goto end;
+			}
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = res;
+			estack_ax_t = REG_S64;
+			next_pc += sizeof(struct cmp_field_imm_op);
+			PO;
+		}
+
+		OP(BYTECODE_OP_FIELD_IN_RANGES_S64):
+		{
+			struct field_in_ranges_op *insn = (struct field_in_ranges_op *) pc;
+			const struct bytecode_range *ranges =
+				(const struct bytecode_range *) &bytecode->data[insn->table];
+			int64_t v;
+
+			dbg_printk("op field offset %u in %u ranges\n",
+				(unsigned int) insn->offset, (unsigned int) insn->nr_ranges);
+			ret = load_field_integer(insn->load_op,
+					&interpreter_stack_data[insn->offset], &v);
+			if (ret)
+				goto end;
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = bytecode_ranges_match(ranges, insn->nr_ranges, v);
+			estack_ax_t = REG_S64;
+			next_pc += sizeof(struct field_in_ranges_op);
+			PO;
+		}
+
 	END_OP
 end:
 	/* No need to prepare output if an error occurred. */
@@ -1846,20 +1966,60 @@ end:
 }
 LTTNG_STACK_FRAME_NON_STANDARD(lttng_bytecode_interpret);
 
+static
+bool filter_set_match(const struct lttng_kernel_filter_set *set,
+		const char *interpreter_stack_data)
+{
+	unsigned int mask = (1U << set->bits) - 1, i;
+	int64_t v;
+
+	if (load_field_integer(set->load_op, &interpreter_stack_data[set->offset], &v))
+		return false;
+	if (!v)
+		return set->accept_zero;
+	for (i = hash_64((u64) v, set->bits); set->values[i]; i = (i + 1) & mask) {
+		if (set->values[i] == v)
+			return true;
+	}
+	return false;
+}
+
 /*
  * Return LTTNG_KERNEL_EVENT_FILTER_ACCEPT or LTTNG_KERNEL_EVENT_FILTER_REJECT.
  */
 int lttng_kernel_interpret_event_filter(const struct lttng_kernel_event_common *event,
 		const char *interpreter_stack_data,
 		struct lttng_kernel_probe_ctx *probe_ctx,
-		void *event_filter_ctx __attribute__((unused)))
+		void *event_filter_ctx)
 {
+	const struct lttng_kernel_event_filter_ctx *filter_ctx = event_filter_ctx;
 	struct lttng_kernel_bytecode_runtime *filter_bc_runtime;
 	struct list_head *filter_bytecode_runtime_head = &event->priv->filter_bytecode_runtime_head;
 	struct lttng_kernel_bytecode_filter_ctx bytecode_filter_ctx;
+	const struct lttng_kernel_filter_set *filter_set;
 	bool filter_record = false;
 
+	/* All the enabled filters compare one field with constants. */
+	filter_set = lttng_rcu_dereference(event->priv->filter_set);
+	if (filter_set && likely(!filter_ctx || !(filter_set->payload_fields
+			& ~filter_ctx->payload_fields))) {
+		if (filter_set_match(filter_set, interpreter_stack_data))
+			return LTTNG_KERNEL_EVENT_FILTER_ACCEPT;
+		else
+			return LTTNG_KERNEL_EVENT_FILTER_REJECT;
+	}
+
 	list_for_each_entry_rcu(filter_bc_runtime, filter_bytecode_runtime_head, node) {
+		/* Another filter of the event runs the same bytecode. */
+		if (READ_ONCE(filter_bc_runtime->duplicate))
+			continue;
+		/*
+		 * Bytecode linked after the probe laid out the stack may read
+		 * fields which are not there: handle it as not linked yet.
+		 */
+		if (unlikely(filter_ctx && (filter_bc_runtime->payload_fields
+				& ~filter_ctx->payload_fields)))
+			continue;
 		if (likely(filter_bc_runtime->interpreter_func(filter_bc_runtime,
 				interpreter_stack_data, probe_ctx, &bytecode_filter_ctx) == LTTNG_KERNEL_BYTECODE_INTERPRETER_OK)) {
 			if (unlikely(bytecode_filter_ctx.result == LTTNG_KERNEL_BYTECODE_FILTER_ACCEPT)) {
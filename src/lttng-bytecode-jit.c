@@ -0,0 +1,1069 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-bytecode-jit.c
+ *
+ * LTTng modules bytecode x86-64 JIT compiler.
+ *
+ * Translates specialized and optimized filter bytecode into native code.
+ * Only integer expressions are compiled: loads of integer payload fields,
+ * integer literals, comparisons, range lookups, bitwise and logical
+ * operators. Bytecode
+ * using anything else (strings, contexts, doubles, dynamic loads) is left
+ * to the interpreter.
+ *
+ * The interpreter register stack is mapped on the native code: ax is held
+ * in rax, bx in rdx, and the entries below are spilled to the stack frame.
+ * Its depth at each instruction is known at compile time. The generated
+ * function takes the interpreter stack data in rdi and returns 1 (accept),
+ * 0 (reject) or -1 (error).
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+
+#include <lttng/lttng-bytecode.h>
+#include <lttng/kernel-version.h>
+
+#if defined(CONFIG_LTTNG_BYTECODE_JIT) && defined(CONFIG_X86_64) && \
+	!defined(CONFIG_CFI_CLANG) && defined(CONFIG_KALLSYMS) && \
+	(LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,2,0))
+
+#include <asm/cpufeature.h>
+#include <wrapper/kallsyms.h>
+
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,10,0))
+#include <linux/execmem.h>
+#endif
+
+static bool bytecode_jit = true;
+module_param(bytecode_jit, bool, 0644);
+MODULE_PARM_DESC(bytecode_jit, "Compile filter bytecode to native code (0: use the interpreter)");
+
+/* Register stack entries, excluding the 2 dummy ones. */
+#define JIT_STACK_LEN		(INTERPRETER_STACK_LEN - 2)
+#define JIT_FRAME_SIZE		(JIT_STACK_LEN * sizeof(int64_t))
+
+/* Upper bound of the native code emitted per bytecode byte. */
+#define JIT_MAX_INSN_LEN	32
+#define JIT_PROLOGUE_LEN	16
+#define JIT_EPILOGUE_LEN	16
+
+/* Labels following the bytecode offsets. */
+enum jit_label {
+	JIT_LABEL_ERROR = 0,
+	JIT_LABEL_EPILOGUE,
+	NR_JIT_LABELS,
+};
+
+enum jit_reg_type {
+	JIT_REG_INTEGER,
+	JIT_REG_PAYLOAD_ROOT,
+	JIT_REG_OBJECT,
+};
+
+struct jit_reg {
+	enum jit_reg_type type;
+	enum object_type object_type;
+};
+
+struct jit_fixup {
+	uint32_t pos;		/* Offset of the rel32 field */
+	uint32_t target;	/* Bytecode offset or label */
+};
+
+struct jit_ctx {
+	struct bytecode_runtime *bytecode;
+	uint8_t *buf;
+	size_t len, alloc_len;
+	int error;
+
+	int top;		/* Number of register stack entries */
+	struct jit_reg reg[JIT_STACK_LEN];
+
+	int *native_offset;	/* Native offset of bytecode offsets and labels */
+	int *target_top;	/* Stack depth at jump targets, -1 if none */
+	struct jit_fixup *fixups;
+	unsigned int nr_fixups, max_fixups;
+	int return_thunk_pos;	/* Offset of the return thunk rel32, or -1 */
+};
+
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,10,0))
+static void *(*execmem_alloc_sym)(enum execmem_type type, size_t size);
+static void (*execmem_free_sym)(void *ptr);
+#else
+static void *(*module_alloc_sym)(unsigned long size);
+static void (*module_memfree_sym)(void *region);
+#endif
+static int (*set_memory_ro_sym)(unsigned long addr, int numpages);
+static int (*set_memory_rw_sym)(unsigned long addr, int numpages);
+static int (*set_memory_x_sym)(unsigned long addr, int numpages);
+static int (*set_memory_nx_sym)(unsigned long addr, int numpages);
+static unsigned long return_thunk;
+
+/*
+ * The executable memory allocator and page permission helpers are not
+ * exported to modules.
+ */
+static
+int jit_lookup_symbols(void)
+{
+	if (set_memory_x_sym)
+		return 0;
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,10,0))
+	execmem_alloc_sym = (void *) kallsyms_lookup_funcptr("execmem_alloc");
+	execmem_free_sym = (void *) kallsyms_lookup_funcptr("execmem_free");
+	if (!execmem_alloc_sym || !execmem_free_sym)
+		goto error;
+#else
+	module_alloc_sym = (void *) kallsyms_lookup_funcptr("module_alloc");
+	module_memfree_sym = (void *) kallsyms_lookup_funcptr("module_memfree");
+	if (!module_alloc_sym || !module_memfree_sym)
+		goto error;
+#endif
+#ifdef X86_FEATURE_RETHUNK
+	/* Returns go through the return thunk selected at boot. */
+	if (cpu_feature_enabled(X86_FEATURE_RETHUNK)) {
+		unsigned long *thunk_ptr;
+
+		thunk_ptr = (unsigned long *) kallsyms_lookup_dataptr("x86_return_thunk");
+		if (thunk_ptr)
+			return_thunk = *thunk_ptr;
+		else
+			return_thunk = kallsyms_lookup_funcptr("__x86_return_thunk");
+		if (!return_thunk)
+			goto error;
+	}
+#endif
+	set_memory_ro_sym = (void *) kallsyms_lookup_funcptr("set_memory_ro");
+	set_memory_rw_sym = (void *) kallsyms_lookup_funcptr("set_memory_rw");
+	set_memory_nx_sym = (void *) kallsyms_lookup_funcptr("set_memory_nx");
+	set_memory_x_sym = (void *) kallsyms_lookup_funcptr("set_memory_x");
+	if (!set_memory_ro_sym || !set_memory_rw_sym || !set_memory_nx_sym
+			|| !set_memory_x_sym)
+		goto error;
+	return 0;
+
+error:
+	set_memory_x_sym = NULL;
+	printk_once(KERN_WARNING "LTTng: bytecode: JIT symbol lookup failed, using the interpreter.\n");
+	return -ENOSYS;
+}
+
+static
+void *jit_alloc_exec(size_t size)
+{
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,10,0))
+	return execmem_alloc_sym(EXECMEM_BPF, size);
+#else
+	return module_alloc_sym(size);
+#endif
+}
+
+/*
+ * The allocator does not reset the page permissions on free on every
+ * kernel version, and set_memory_ro() also applies to the direct map
+ * alias of the pages on x86: make the image writable and non-executable
+ * again before giving it back.
+ */
+static
+void jit_free_exec(void *image, size_t size)
+{
+	set_memory_nx_sym((unsigned long) image, size >> PAGE_SHIFT);
+	set_memory_rw_sym((unsigned long) image, size >> PAGE_SHIFT);
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(6,10,0))
+	execmem_free_sym(image);
+#else
+	module_memfree_sym(image);
+#endif
+}
+
+static
+void emit_bytes(struct jit_ctx *ctx, const uint8_t *bytes, size_t len)
+{
+	if (ctx->len + len > ctx->alloc_len) {
+		ctx->error = -E2BIG;
+		return;
+	}
+	memcpy(&ctx->buf[ctx->len], bytes, len);
+	ctx->len += len;
+}
+
+#define EMIT(ctx, ...)						\
+	do {							\
+		const uint8_t __bytes[] = { __VA_ARGS__ };	\
+								\
+		emit_bytes(ctx, __bytes, sizeof(__bytes));	\
+	} while (0)
+
+static
+void emit_u32(struct jit_ctx *ctx, uint32_t v)
+{
+	emit_bytes(ctx, (const uint8_t *) &v, sizeof(v));
+}
+
+static
+void emit_u64(struct jit_ctx *ctx, uint64_t v)
+{
+	emit_bytes(ctx, (const uint8_t *) &v, sizeof(v));
+}
+
+/*
+ * Emit a jump instruction with a rel32 operand to a bytecode offset or a
+ * label, resolved once all the code is emitted.
+ */
+static
+void emit_jump(struct jit_ctx *ctx, const uint8_t *opcode, size_t len,
+		uint32_t target)
+{
+	emit_bytes(ctx, opcode, len);
+	if (ctx->error)
+		return;
+	if (ctx->nr_fixups >= ctx->max_fixups) {
+		ctx->error = -E2BIG;
+		return;
+	}
+	ctx->fixups[ctx->nr_fixups].pos = ctx->len;
+	ctx->fixups[ctx->nr_fixups].target = target;
+	ctx->nr_fixups++;
+	emit_u32(ctx, 0);
+}
+
+static
+void emit_jmp(struct jit_ctx *ctx, uint32_t target)
+{
+	static const uint8_t jmp[] = { 0xe9 };
+
+	emit_jump(ctx, jmp, sizeof(jmp), target);
+}
+
+static
+uint32_t jit_label(struct jit_ctx *ctx, enum jit_label label)
+{
+	return ctx->bytecode->len + label;
+}
+
+/* Frame slot of register stack entry idx, below bx. */
+static
+uint8_t jit_slot(int idx)
+{
+	return (uint8_t) -(int8_t) ((idx + 1) * sizeof(int64_t));
+}
+
+/* Push a new entry: the caller loads it into rax. */
+static
+int jit_push(struct jit_ctx *ctx, enum jit_reg_type type)
+{
+	if (ctx->top >= JIT_STACK_LEN)
+		return -EINVAL;
+	if (ctx->top >= 2) {
+		/* mov [rbp + slot], rdx */
+		EMIT(ctx, 0x48, 0x89, 0x55, jit_slot(ctx->top - 2));
+	}
+	if (ctx->top >= 1) {
+		/* mov rdx, rax */
+		EMIT(ctx, 0x48, 0x89, 0xc2);
+	}
+	ctx->reg[ctx->top].type = type;
+	ctx->top++;
+	return 0;
+}
+
+/* Reload bx from the frame after popping an entry. */
+static
+void jit_reload_bx(struct jit_ctx *ctx)
+{
+	if (ctx->top >= 3) {
+		/* mov rdx, [rbp + slot] */
+		EMIT(ctx, 0x48, 0x8b, 0x55, jit_slot(ctx->top - 3));
+	}
+}
+
+/* Binary operator: the result, computed in rax, replaces ax and bx. */
+static
+int jit_pop_binary(struct jit_ctx *ctx)
+{
+	if (ctx->top < 2)
+		return -EINVAL;
+	jit_reload_bx(ctx);
+	ctx->top--;
+	ctx->reg[ctx->top - 1].type = JIT_REG_INTEGER;
+	return 0;
+}
+
+/* Drop ax: bx becomes ax. */
+static
+int jit_pop(struct jit_ctx *ctx)
+{
+	if (ctx->top < 1)
+		return -EINVAL;
+	if (ctx->top >= 2) {
+		/* mov rax, rdx */
+		EMIT(ctx, 0x48, 0x89, 0xd0);
+	}
+	jit_reload_bx(ctx);
+	ctx->top--;
+	return 0;
+}
+
+static
+bool jit_integer_operands(struct jit_ctx *ctx, int nr)
+{
+	int i;
+
+	if (ctx->top < nr)
+		return false;
+	for (i = ctx->top - nr; i < ctx->top; i++) {
+		if (ctx->reg[i].type != JIT_REG_INTEGER)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Record the stack depth expected at a jump target. The validator
+ * guarantees that all the paths reaching it agree.
+ */
+static
+int jit_set_target(struct jit_ctx *ctx, uint32_t target, int top)
+{
+	if (target >= ctx->bytecode->len)
+		return -EINVAL;
+	if (ctx->target_top[target] >= 0 && ctx->target_top[target] != top)
+		return -EINVAL;
+	ctx->target_top[target] = top;
+	return 0;
+}
+
+static
+int jit_emit_compare(struct jit_ctx *ctx, uint8_t setcc)
+{
+	if (!jit_integer_operands(ctx, 2))
+		return -EOPNOTSUPP;
+	/* cmp rdx, rax ; setcc al ; movzx eax, al */
+	EMIT(ctx, 0x48, 0x39, 0xc2);
+	EMIT(ctx, 0x0f, setcc, 0xc0);
+	EMIT(ctx, 0x0f, 0xb6, 0xc0);
+	return jit_pop_binary(ctx);
+}
+
+static
+int jit_emit_bitwise(struct jit_ctx *ctx, uint8_t opcode)
+{
+	if (!jit_integer_operands(ctx, 2))
+		return -EOPNOTSUPP;
+	/* <op> rax, rdx */
+	EMIT(ctx, 0x48, opcode, 0xd0);
+	return jit_pop_binary(ctx);
+}
+
+static
+int jit_emit_shift(struct jit_ctx *ctx, uint8_t modrm)
+{
+	static const uint8_t ja[] = { 0x0f, 0x87 };
+
+	if (!jit_integer_operands(ctx, 2))
+		return -EOPNOTSUPP;
+	/* Shift counts outside [0, 63] are errors: cmp rax, 63 ; ja error */
+	EMIT(ctx, 0x48, 0x83, 0xf8, 0x3f);
+	emit_jump(ctx, ja, sizeof(ja), jit_label(ctx, JIT_LABEL_ERROR));
+	/* mov rcx, rax ; mov rax, rdx ; shr/shl rax, cl */
+	EMIT(ctx, 0x48, 0x89, 0xc1);
+	EMIT(ctx, 0x48, 0x89, 0xd0);
+	EMIT(ctx, 0x48, 0xd3, modrm);
+	return jit_pop_binary(ctx);
+}
+
+static
+int jit_emit_get_index(struct jit_ctx *ctx, uint64_t index)
+{
+	struct bytecode_runtime *bytecode = ctx->bytecode;
+	const struct bytecode_get_index_data *gid;
+	struct jit_reg *reg;
+
+	if (ctx->top < 1)
+		return -EINVAL;
+	if (index + sizeof(*gid) > bytecode->data_len)
+		return -EINVAL;
+	gid = (const struct bytecode_get_index_data *) &bytecode->data[index];
+	if (gid->offset > S32_MAX)
+		return -EOPNOTSUPP;
+	reg = &ctx->reg[ctx->top - 1];
+	switch (reg->type) {
+	case JIT_REG_PAYLOAD_ROOT:
+		/* String fields are loaded by the interpreter. */
+		if (gid->elem.type == OBJECT_TYPE_STRING)
+			return -EOPNOTSUPP;
+		/* add rax, offset */
+		EMIT(ctx, 0x48, 0x05);
+		emit_u32(ctx, (uint32_t) gid->offset);
+		break;
+	case JIT_REG_OBJECT:
+		switch (reg->object_type) {
+		case OBJECT_TYPE_ARRAY:
+			/* mov rax, [rax + 8] ; add rax, offset */
+			EMIT(ctx, 0x48, 0x8b, 0x40, sizeof(unsigned long));
+			EMIT(ctx, 0x48, 0x05);
+			emit_u32(ctx, (uint32_t) gid->offset);
+			break;
+		case OBJECT_TYPE_SEQUENCE:
+		{
+			static const uint8_t jae[] = { 0x0f, 0x83 };
+
+			if (gid->elem.len > S32_MAX)
+				return -EOPNOTSUPP;
+			/* mov rcx, [rax] ; imul rcx, rcx, elem_len */
+			EMIT(ctx, 0x48, 0x8b, 0x08);
+			EMIT(ctx, 0x48, 0x69, 0xc9);
+			emit_u32(ctx, (uint32_t) gid->elem.len);
+			/* mov esi, offset ; cmp rsi, rcx ; jae error */
+			EMIT(ctx, 0xbe);
+			emit_u32(ctx, (uint32_t) gid->offset);
+			EMIT(ctx, 0x48, 0x39, 0xce);
+			emit_jump(ctx, jae, sizeof(jae), jit_label(ctx, JIT_LABEL_ERROR));
+			/* mov rax, [rax + 8] ; add rax, rsi */
+			EMIT(ctx, 0x48, 0x8b, 0x40, sizeof(unsigned long));
+			EMIT(ctx, 0x48, 0x01, 0xf0);
+			break;
+		}
+		default:
+			return -EOPNOTSUPP;
+		}
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+	reg->type = JIT_REG_OBJECT;
+	reg->object_type = gid->elem.type;
+	return 0;
+}
+
+/*
+ * Load an integer into rax. modrm selects the memory operand: [rax] (0x00)
+ * or [rdi + disp32] (0x87), the caller then emits the displacement.
+ */
+static
+int jit_emit_load(struct jit_ctx *ctx, bytecode_opcode_t op, uint8_t modrm)
+{
+	switch (op) {
+	case BYTECODE_OP_LOAD_FIELD_S8:
+		/* movsx rax, byte [mem] */
+		EMIT(ctx, 0x48, 0x0f, 0xbe, modrm);
+		break;
+	case BYTECODE_OP_LOAD_FIELD_S16:
+		/* movsx rax, word [mem] */
+		EMIT(ctx, 0x48, 0x0f, 0xbf, modrm);
+		break;
+	case BYTECODE_OP_LOAD_FIELD_S32:
+		/* movsxd rax, dword [mem] */
+		EMIT(ctx, 0x48, 0x63, modrm);
+		break;
+	case BYTECODE_OP_LOAD_FIELD_S64:
+	case BYTECODE_OP_LOAD_FIELD_U64:
+		/* mov rax, [mem] */
+		EMIT(ctx, 0x48, 0x8b, modrm);
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U8:
+		/* movzx eax, byte [mem] */
+		EMIT(ctx, 0x0f, 0xb6, modrm);
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U16:
+		/* movzx eax, word [mem] */
+		EMIT(ctx, 0x0f, 0xb7, modrm);
+		break;
+	case BYTECODE_OP_LOAD_FIELD_U32:
+		/* mov eax, [mem] */
+		EMIT(ctx, 0x8b, modrm);
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+	return 0;
+}
+
+/* Load the integer pointed to by rax into rax. */
+static
+int jit_emit_load_field(struct jit_ctx *ctx, bytecode_opcode_t op)
+{
+	int ret;
+
+	if (ctx->top < 1 || ctx->reg[ctx->top - 1].type != JIT_REG_OBJECT)
+		return -EOPNOTSUPP;
+	ret = jit_emit_load(ctx, op, 0x00);
+	if (ret)
+		return ret;
+	ctx->reg[ctx->top - 1].type = JIT_REG_INTEGER;
+	return 0;
+}
+
+static
+uint8_t jit_setcc(bytecode_opcode_t cmp_op)
+{
+	switch (cmp_op) {
+	case BYTECODE_OP_EQ_S64:
+		return 0x94;	/* sete */
+	case BYTECODE_OP_NE_S64:
+		return 0x95;	/* setne */
+	case BYTECODE_OP_GT_S64:
+		return 0x9f;	/* setg */
+	case BYTECODE_OP_LT_S64:
+		return 0x9c;	/* setl */
+	case BYTECODE_OP_GE_S64:
+		return 0x9d;	/* setge */
+	case BYTECODE_OP_LE_S64:
+		return 0x9e;	/* setle */
+	default:
+		return 0;
+	}
+}
+
+/* Compare a payload field with an immediate, see the optimizer. */
+static
+int jit_emit_cmp_field_imm(struct jit_ctx *ctx, const struct cmp_field_imm_op *insn)
+{
+	uint8_t setcc = jit_setcc(insn->cmp_op);
+	int ret;
+
+	if (!setcc)
+		return -EINVAL;
+	ret = jit_push(ctx, JIT_REG_INTEGER);
+	if (ret)
+		return ret;
+	/* load rax, [rdi + offset] */
+	ret = jit_emit_load(ctx, insn->load_op, 0x87);
+	if (ret)
+		return ret;
+	emit_u32(ctx, insn->offset);
+	if (insn->v >= S32_MIN && insn->v <= S32_MAX) {
+		/* cmp rax, simm32 */
+		EMIT(ctx, 0x48, 0x3d);
+		emit_u32(ctx, (uint32_t) insn->v);
+	} else {
+		/* movabs rcx, imm64 ; cmp rax, rcx */
+		EMIT(ctx, 0x48, 0xb9);
+		emit_u64(ctx, (uint64_t) insn->v);
+		EMIT(ctx, 0x48, 0x39, 0xc8);
+	}
+	/* setcc al ; movzx eax, al */
+	EMIT(ctx, 0x0f, setcc, 0xc0);
+	EMIT(ctx, 0x0f, 0xb6, 0xc0);
+	return 0;
+}
+
+/* Resolve a rel8 jump emitted at pos (offset of its operand). */
+static
+void jit_patch_rel8(struct jit_ctx *ctx, size_t pos, size_t target)
+{
+	if (ctx->error)
+		return;
+	ctx->buf[pos] = (uint8_t) (target - (pos + 1));
+}
+
+/*
+ * Binary search of a payload field in a table of ranges, see the
+ * optimizer. Uses the scratch registers rcx, rsi and r8 to r11.
+ */
+static
+int jit_emit_field_in_ranges(struct jit_ctx *ctx, const struct field_in_ranges_op *insn)
+{
+	const struct bytecode_range *ranges =
+		(const struct bytecode_range *) &ctx->bytecode->data[insn->table];
+	size_t loop, found, less, done, store;
+	int ret;
+
+	ret = jit_push(ctx, JIT_REG_INTEGER);
+	if (ret)
+		return ret;
+	/* load rax, [rdi + offset] */
+	ret = jit_emit_load(ctx, insn->load_op, 0x87);
+	if (ret)
+		return ret;
+	emit_u32(ctx, insn->offset);
+	/* movabs rsi, ranges ; xor ecx, ecx (lo) ; mov r8d, nr_ranges (hi) */
+	EMIT(ctx, 0x48, 0xbe);
+	emit_u64(ctx, (uint64_t) (unsigned long) ranges);
+	EMIT(ctx, 0x31, 0xc9);
+	EMIT(ctx, 0x41, 0xb8);
+	emit_u32(ctx, insn->nr_ranges);
+	/* Count the ranges starting at or before the value. */
+	loop = ctx->len;
+	/* cmp rcx, r8 ; jae done */
+	EMIT(ctx, 0x4c, 0x39, 0xc1);
+	EMIT(ctx, 0x73, 0x00);
+	found = ctx->len - 1;
+	/* lea r9, [rcx + r8] ; shr r9, 1 ; mov r10, r9 ; shl r10, 4 */
+	EMIT(ctx, 0x4e, 0x8d, 0x0c, 0x01);
+	EMIT(ctx, 0x49, 0xd1, 0xe9);
+	EMIT(ctx, 0x4d, 0x89, 0xca);
+	EMIT(ctx, 0x49, 0xc1, 0xe2, 0x04);
+	/* cmp rax, [rsi + r10] (min) ; jl less */
+	EMIT(ctx, 0x4a, 0x3b, 0x04, 0x16);
+	EMIT(ctx, 0x7c, 0x00);
+	less = ctx->len - 1;
+	/* lea rcx, [r9 + 1] ; jmp loop */
+	EMIT(ctx, 0x49, 0x8d, 0x49, 0x01);
+	EMIT(ctx, 0xeb, 0x00);
+	jit_patch_rel8(ctx, ctx->len - 1, loop);
+	/* less: mov r8, r9 ; jmp loop */
+	jit_patch_rel8(ctx, less, ctx->len);
+	EMIT(ctx, 0x4d, 0x89, 0xc8);
+	EMIT(ctx, 0xeb, 0x00);
+	jit_patch_rel8(ctx, ctx->len - 1, loop);
+	/* done: xor r11d, r11d ; test rcx, rcx ; jz store */
+	done = ctx->len;
+	jit_patch_rel8(ctx, found, done);
+	EMIT(ctx, 0x45, 0x31, 0xdb);
+	EMIT(ctx, 0x48, 0x85, 0xc9);
+	EMIT(ctx, 0x74, 0x00);
+	store = ctx->len - 1;
+	/* shl rcx, 4 ; cmp rax, [rsi + rcx - 8] (max of the last) ; setle r11b */
+	EMIT(ctx, 0x48, 0xc1, 0xe1, 0x04);
+	EMIT(ctx, 0x48, 0x3b, 0x44, 0x0e, 0xf8);
+	EMIT(ctx, 0x41, 0x0f, 0x9e, 0xc3);
+	/* store: mov eax, r11d */
+	jit_patch_rel8(ctx, store, ctx->len);
+	EMIT(ctx, 0x44, 0x89, 0xd8);
+	return 0;
+}
+
+static
+void jit_emit_prologue(struct jit_ctx *ctx)
+{
+#ifdef X86_FEATURE_IBT
+	/* Indirect branch target. */
+	if (cpu_feature_enabled(X86_FEATURE_IBT))
+		EMIT(ctx, 0xf3, 0x0f, 0x1e, 0xfa);	/* endbr64 */
+#endif
+	/* push rbp ; mov rbp, rsp ; sub rsp, JIT_FRAME_SIZE */
+	EMIT(ctx, 0x55);
+	EMIT(ctx, 0x48, 0x89, 0xe5);
+	EMIT(ctx, 0x48, 0x83, 0xec, JIT_FRAME_SIZE);
+}
+
+static
+void jit_emit_epilogue(struct jit_ctx *ctx)
+{
+	struct bytecode_runtime *bytecode = ctx->bytecode;
+
+	ctx->native_offset[bytecode->len + JIT_LABEL_ERROR] = ctx->len;
+	/* mov eax, -1 */
+	EMIT(ctx, 0xb8, 0xff, 0xff, 0xff, 0xff);
+	ctx->native_offset[bytecode->len + JIT_LABEL_EPILOGUE] = ctx->len;
+	/* leave */
+	EMIT(ctx, 0xc9);
+	if (return_thunk) {
+		/* jmp return_thunk, resolved at installation. */
+		EMIT(ctx, 0xe9);
+		ctx->return_thunk_pos = ctx->len;
+		emit_u32(ctx, 0);
+	} else {
+		/* ret */
+		EMIT(ctx, 0xc3);
+	}
+	/* int3: stop straight-line speculation. */
+	EMIT(ctx, 0xcc);
+}
+
+static
+int jit_emit_insn(struct jit_ctx *ctx, char *pc, char **next_pc)
+{
+	struct bytecode_runtime *bytecode = ctx->bytecode;
+	bytecode_opcode_t op = *(bytecode_opcode_t *) pc;
+	int ret;
+
+	switch (op) {
+	case BYTECODE_OP_RETURN:
+	case BYTECODE_OP_RETURN_S64:
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		/* test rax, rax ; setne al ; movzx eax, al ; jmp epilogue */
+		EMIT(ctx, 0x48, 0x85, 0xc0);
+		EMIT(ctx, 0x0f, 0x95, 0xc0);
+		EMIT(ctx, 0x0f, 0xb6, 0xc0);
+		emit_jmp(ctx, jit_label(ctx, JIT_LABEL_EPILOGUE));
+		/* Not reached by fall-through. */
+		ctx->top = -1;
+		*next_pc = pc + sizeof(struct return_op);
+		return 0;
+
+	case BYTECODE_OP_EQ_S64:
+	case BYTECODE_OP_NE_S64:
+	case BYTECODE_OP_GT_S64:
+	case BYTECODE_OP_LT_S64:
+	case BYTECODE_OP_GE_S64:
+	case BYTECODE_OP_LE_S64:
+		ret = jit_emit_compare(ctx, jit_setcc(op));
+		break;
+
+	case BYTECODE_OP_BIT_AND:
+		ret = jit_emit_bitwise(ctx, 0x21);
+		break;
+	case BYTECODE_OP_BIT_OR:
+		ret = jit_emit_bitwise(ctx, 0x09);
+		break;
+	case BYTECODE_OP_BIT_XOR:
+		ret = jit_emit_bitwise(ctx, 0x31);
+		break;
+	case BYTECODE_OP_BIT_RSHIFT:
+		ret = jit_emit_shift(ctx, 0xe8);	/* shr */
+		break;
+	case BYTECODE_OP_BIT_LSHIFT:
+		ret = jit_emit_shift(ctx, 0xe0);	/* shl */
+		break;
+
+	case BYTECODE_OP_UNARY_BIT_NOT:
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		/* not rax */
+		EMIT(ctx, 0x48, 0xf7, 0xd0);
+		*next_pc = pc + sizeof(struct unary_op);
+		return 0;
+	case BYTECODE_OP_UNARY_PLUS_S64:
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		*next_pc = pc + sizeof(struct unary_op);
+		return 0;
+	case BYTECODE_OP_UNARY_MINUS_S64:
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		/* neg rax */
+		EMIT(ctx, 0x48, 0xf7, 0xd8);
+		*next_pc = pc + sizeof(struct unary_op);
+		return 0;
+	case BYTECODE_OP_UNARY_NOT_S64:
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		/* test rax, rax ; sete al ; movzx eax, al */
+		EMIT(ctx, 0x48, 0x85, 0xc0);
+		EMIT(ctx, 0x0f, 0x94, 0xc0);
+		EMIT(ctx, 0x0f, 0xb6, 0xc0);
+		*next_pc = pc + sizeof(struct unary_op);
+		return 0;
+
+	case BYTECODE_OP_AND:
+	{
+		struct logical_op *insn = (struct logical_op *) pc;
+		static const uint8_t jz[] = { 0x0f, 0x84 };
+
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		if (insn->skip_offset <= pc - bytecode->code)
+			return -EINVAL;
+		ret = jit_set_target(ctx, insn->skip_offset, ctx->top);
+		if (ret)
+			return ret;
+		/* If ax is 0, skip and evaluate to 0: test rax, rax ; jz skip */
+		EMIT(ctx, 0x48, 0x85, 0xc0);
+		emit_jump(ctx, jz, sizeof(jz), insn->skip_offset);
+		ret = jit_pop(ctx);
+		*next_pc = pc + sizeof(struct logical_op);
+		return ret;
+	}
+	case BYTECODE_OP_OR:
+	{
+		struct logical_op *insn = (struct logical_op *) pc;
+
+		if (!jit_integer_operands(ctx, 1))
+			return -EOPNOTSUPP;
+		if (insn->skip_offset <= pc - bytecode->code)
+			return -EINVAL;
+		ret = jit_set_target(ctx, insn->skip_offset, ctx->top);
+		if (ret)
+			return ret;
+		/*
+		 * If ax is nonzero, skip and evaluate to 1:
+		 * test rax, rax ; jz 1f ; mov eax, 1 ; jmp skip ; 1:
+		 */
+		EMIT(ctx, 0x48, 0x85, 0xc0);
+		EMIT(ctx, 0x74, 0x0a);
+		EMIT(ctx, 0xb8, 0x01, 0x00, 0x00, 0x00);
+		emit_jmp(ctx, insn->skip_offset);
+		ret = jit_pop(ctx);
+		*next_pc = pc + sizeof(struct logical_op);
+		return ret;
+	}
+
+	case BYTECODE_OP_LOAD_FIELD_REF_S64:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+		struct field_ref *ref = (struct field_ref *) insn->data;
+
+		ret = jit_push(ctx, JIT_REG_INTEGER);
+		if (ret)
+			return ret;
+		/* mov rax, [rdi + offset] */
+		EMIT(ctx, 0x48, 0x8b, 0x87);
+		emit_u32(ctx, ref->offset);
+		*next_pc = pc + sizeof(struct load_op) + sizeof(struct field_ref);
+		return 0;
+	}
+	case BYTECODE_OP_LOAD_S64:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+		int64_t v = ((struct literal_numeric *) insn->data)->v;
+
+		ret = jit_push(ctx, JIT_REG_INTEGER);
+		if (ret)
+			return ret;
+		if (v >= S32_MIN && v <= S32_MAX) {
+			/* mov rax, simm32 */
+			EMIT(ctx, 0x48, 0xc7, 0xc0);
+			emit_u32(ctx, (uint32_t) v);
+		} else {
+			/* movabs rax, imm64 */
+			EMIT(ctx, 0x48, 0xb8);
+			emit_u64(ctx, (uint64_t) v);
+		}
+		*next_pc = pc + sizeof(struct load_op) + sizeof(struct literal_numeric);
+		return 0;
+	}
+	case BYTECODE_OP_CAST_NOP:
+		*next_pc = pc + sizeof(struct cast_op);
+		return 0;
+
+	case BYTECODE_OP_GET_PAYLOAD_ROOT:
+		ret = jit_push(ctx, JIT_REG_PAYLOAD_ROOT);
+		if (ret)
+			return ret;
+		/* mov rax, rdi */
+		EMIT(ctx, 0x48, 0x89, 0xf8);
+		*next_pc = pc + sizeof(struct load_op);
+		return 0;
+	case BYTECODE_OP_GET_INDEX_U16:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+		struct get_index_u16 *index = (struct get_index_u16 *) insn->data;
+
+		*next_pc = pc + sizeof(struct load_op) + sizeof(struct get_index_u16);
+		return jit_emit_get_index(ctx, index->index);
+	}
+	case BYTECODE_OP_GET_INDEX_U64:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+		struct get_index_u64 *index = (struct get_index_u64 *) insn->data;
+
+		*next_pc = pc + sizeof(struct load_op) + sizeof(struct get_index_u64);
+		return jit_emit_get_index(ctx, index->index);
+	}
+	case BYTECODE_OP_LOAD_FIELD_S8:
+	case BYTECODE_OP_LOAD_FIELD_S16:
+	case BYTECODE_OP_LOAD_FIELD_S32:
+	case BYTECODE_OP_LOAD_FIELD_S64:
+	case BYTECODE_OP_LOAD_FIELD_U8:
+	case BYTECODE_OP_LOAD_FIELD_U16:
+	case BYTECODE_OP_LOAD_FIELD_U32:
+	case BYTECODE_OP_LOAD_FIELD_U64:
+		*next_pc = pc + sizeof(struct load_op);
+		return jit_emit_load_field(ctx, op);
+
+	case BYTECODE_OP_CMP_FIELD_IMM_S64:
+		*next_pc = pc + sizeof(struct cmp_field_imm_op);
+		return jit_emit_cmp_field_imm(ctx, (struct cmp_field_imm_op *) pc);
+	case BYTECODE_OP_FIELD_IN_RANGES_S64:
+		*next_pc = pc + sizeof(struct field_in_ranges_op);
+		return jit_emit_field_in_ranges(ctx, (struct field_in_ranges_op *) pc);
+
+	default:
+		dbg_printk("JIT: unsupported op %s (%u)\n",
+			lttng_bytecode_print_op(op), (unsigned int) op);
+		return -EOPNOTSUPP;
+	}
+	*next_pc = pc + sizeof(struct binary_op);
+	return ret;
+}
+
+static
+int jit_emit(struct jit_ctx *ctx)
+{
+	struct bytecode_runtime *bytecode = ctx->bytecode;
+	char *pc, *next_pc, *start_pc = bytecode->code;
+	unsigned int i;
+	int ret;
+
+	jit_emit_prologue(ctx);
+	for (pc = start_pc; pc - start_pc < bytecode->len; pc = next_pc) {
+		int offset = pc - start_pc;
+
+		if (ctx->target_top[offset] >= 0) {
+			/* Jump target: all paths must agree on the stack depth. */
+			if (ctx->top >= 0 && ctx->top != ctx->target_top[offset])
+				return -EINVAL;
+			ctx->top = ctx->target_top[offset];
+			if (!jit_integer_operands(ctx, 1))
+				return -EOPNOTSUPP;
+		} else if (ctx->top < 0) {
+			/* Unreachable code. */
+			return -EINVAL;
+		}
+		ctx->native_offset[offset] = ctx->len;
+		ret = jit_emit_insn(ctx, pc, &next_pc);
+		if (ret)
+			return ret;
+		if (ctx->error)
+			return ctx->error;
+	}
+	/* Falling off the end of the bytecode is an error. */
+	if (ctx->top >= 0)
+		emit_jmp(ctx, jit_label(ctx, JIT_LABEL_ERROR));
+	jit_emit_epilogue(ctx);
+	if (ctx->error)
+		return ctx->error;
+
+	for (i = 0; i < ctx->nr_fixups; i++) {
+		struct jit_fixup *fixup = &ctx->fixups[i];
+		int target = ctx->native_offset[fixup->target];
+		int32_t rel;
+
+		if (target < 0)
+			return -EINVAL;
+		rel = target - (int) (fixup->pos + sizeof(int32_t));
+		memcpy(&ctx->buf[fixup->pos], &rel, sizeof(rel));
+	}
+	return 0;
+}
+
+static
+int jit_install(struct jit_ctx *ctx)
+{
+	size_t size = PAGE_ALIGN(ctx->len);
+	uint8_t *image;
+
+	image = jit_alloc_exec(size);
+	if (!image)
+		return -ENOMEM;
+	if (ctx->return_thunk_pos >= 0) {
+		long rel = (long) return_thunk
+			- (long) (image + ctx->return_thunk_pos + sizeof(int32_t));
+		int32_t rel32 = rel;
+
+		if (rel != rel32) {
+			jit_free_exec(image, size);
+			return -ERANGE;
+		}
+		memcpy(&ctx->buf[ctx->return_thunk_pos], &rel32, sizeof(rel32));
+	}
+	memset(image, 0xcc, size);	/* int3 */
+	memcpy(image, ctx->buf, ctx->len);
+	if (set_memory_ro_sym((unsigned long) image, size >> PAGE_SHIFT)
+			|| set_memory_x_sym((unsigned long) image, size >> PAGE_SHIFT)) {
+		jit_free_exec(image, size);
+		return -EPERM;
+	}
+	ctx->bytecode->jit_func = (void *) image;
+	ctx->bytecode->jit_len = size;
+	return 0;
+}
+
+/*
+ * Compile validated and specialized filter bytecode. On error, the
+ * bytecode is left to the interpreter.
+ */
+int lttng_bytecode_jit_compile(struct bytecode_runtime *bytecode)
+{
+	struct jit_ctx ctx;
+	size_t nr_offsets = bytecode->len + NR_JIT_LABELS;
+	size_t i;
+	int ret;
+
+	if (!READ_ONCE(bytecode_jit)
+			|| bytecode->p.type != LTTNG_KERNEL_BYTECODE_TYPE_FILTER)
+		return -EOPNOTSUPP;
+	ret = jit_lookup_symbols();
+	if (ret)
+		return ret;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.bytecode = bytecode;
+	ctx.return_thunk_pos = -1;
+	ctx.alloc_len = JIT_PROLOGUE_LEN + JIT_EPILOGUE_LEN
+			+ (size_t) bytecode->len * JIT_MAX_INSN_LEN;
+	/* At most one jump per instruction, plus the final one. */
+	ctx.max_fixups = bytecode->len + 1;
+	ctx.buf = kmalloc(ctx.alloc_len, GFP_KERNEL);
+	ctx.native_offset = kmalloc_array(nr_offsets, sizeof(int), GFP_KERNEL);
+	ctx.target_top = kmalloc_array(bytecode->len, sizeof(int), GFP_KERNEL);
+	ctx.fixups = kmalloc_array(ctx.max_fixups, sizeof(*ctx.fixups), GFP_KERNEL);
+	if (!ctx.buf || !ctx.native_offset || !ctx.target_top || !ctx.fixups) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	for (i = 0; i < nr_offsets; i++)
+		ctx.native_offset[i] = -1;
+	for (i = 0; i < bytecode->len; i++)
+		ctx.target_top[i] = -1;
+
+	ret = jit_emit(&ctx);
+	if (ret) {
+		dbg_printk("JIT: bytecode not compiled (%d)\n", ret);
+		goto end;
+	}
+	ret = jit_install(&ctx);
+	if (ret)
+		goto end;
+	dbg_printk("JIT: compiled %u bytes of bytecode to %zu bytes\n",
+		(unsigned int) bytecode->len, ctx.len);
+end:
+	kfree(ctx.fixups);
+	kfree(ctx.target_top);
+	kfree(ctx.native_offset);
+	kfree(ctx.buf);
+	return ret;
+}
+
+void lttng_bytecode_jit_free(struct bytecode_runtime *bytecode)
+{
+	if (!bytecode->jit_func)
+		return;
+	jit_free_exec((void *) bytecode->jit_func, bytecode->jit_len);
+	bytecode->jit_func = NULL;
+	bytecode->jit_len = 0;
+}
+
+/*
+ * Runtime entry point of compiled filter bytecode. Clearing the
+ * bytecode_jit parameter falls back to the interpreter right away.
+ */
+int lttng_bytecode_jit_interpret(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx)
+{
+	struct bytecode_runtime *bytecode = container_of(kernel_bytecode, struct bytecode_runtime, p);
+	struct lttng_kernel_bytecode_filter_ctx *filter_ctx =
+		(struct lttng_kernel_bytecode_filter_ctx *) caller_ctx;
+	int ret;
+
+	if (unlikely(!READ_ONCE(bytecode_jit)))
+		return lttng_bytecode_interpret(kernel_bytecode,
+				interpreter_stack_data, lttng_probe_ctx, caller_ctx);
+	ret = bytecode->jit_func(interpreter_stack_data);
+	if (unlikely(ret < 0))
+		return LTTNG_KERNEL_BYTECODE_INTERPRETER_ERROR;
+	if (ret)
+		filter_ctx->result = LTTNG_KERNEL_BYTECODE_FILTER_ACCEPT;
+	else
+		filter_ctx->result = LTTNG_KERNEL_BYTECODE_FILTER_REJECT;
+	return LTTNG_KERNEL_BYTECODE_INTERPRETER_OK;
+}
+
+#else /* CONFIG_LTTNG_BYTECODE_JIT && CONFIG_X86_64 && ... */
+
+int lttng_bytecode_jit_compile(struct bytecode_runtime *bytecode)
+{
+	return -EOPNOTSUPP;
+}
+
+void lttng_bytecode_jit_free(struct bytecode_runtime *bytecode)
+{
+}
+
+int lttng_bytecode_jit_interpret(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx)
+{
+	return lttng_bytecode_interpret(kernel_bytecode, interpreter_stack_data,
+			lttng_probe_ctx, caller_ctx);
+}
+
+#endif /* CONFIG_LTTNG_BYTECODE_JIT && CONFIG_X86_64 && ... */
@@ -0,0 +1,849 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-bytecode-optimize.c
+ *
+ * LTTng modules bytecode peephole optimizer.
+ *
+ * Rewrites specialized bytecode in a single forward pass:
+ *
+ * - integer literals combined by S64 comparators and unary operators are
+ *   folded into a single literal,
+ * - CAST_NOP and UNARY_PLUS_S64 are removed,
+ * - logical operators applied to a literal are resolved: the branch which
+ *   can never execute is removed,
+ * - "load integer payload field, load literal, compare" sequences are
+ *   fused into a BYTECODE_OP_CMP_FIELD_IMM_S64 instruction, executed in a
+ *   single dispatch,
+ * - AND and OR of such comparisons on the same field, as generated for
+ *   allow-lists ("pid == 12 || pid == 57 || ...") and intervals, are
+ *   merged into a BYTECODE_OP_FIELD_IN_RANGES_S64 instruction: a binary
+ *   search in a table of ranges appended to the runtime data.
+ *
+ * Bitwise operators are not folded: they produce REG_U64 values, and
+ * replacing them by a REG_S64 literal could change the register types
+ * checked at merge points.
+ *
+ * A sequence is only rewritten when no jump targets one of its
+ * instructions other than the first one. The rewritten bytecode is checked
+ * by the validator again, and the original bytecode is kept if it fails.
+ */
+
+#include <linux/slab.h>
+#include <wrapper/limits.h>
+
+#include <lttng/lttng-bytecode.h>
+
+struct opt_insn {
+	char *pc;		/* Position in the rewritten code */
+	bytecode_opcode_t op;
+	uint16_t target;	/* Original jump target of AND/OR */
+
+	/* Integer payload field load, see opt_mark_field(). */
+	bool field;
+	unsigned int field_start;	/* Index of its first instruction */
+	bytecode_opcode_t load_op;
+	uint16_t field_offset;
+
+	/* Ranges of a FIELD_IN_RANGES_S64, added to the data once final. */
+	struct bytecode_range *ranges;
+	unsigned int nr_ranges;
+};
+
+/* Values of a field accepted by an instruction, see opt_range_term(). */
+struct opt_term {
+	bytecode_opcode_t load_op;
+	uint16_t offset;
+	const struct bytecode_range *ranges;
+	unsigned int nr_ranges;
+	struct bytecode_range buf[2];
+};
+
+/* Keep the table within the interpreter data limit. */
+#define OPT_MAX_RANGES	(INTERPRETER_MAX_DATA_LEN / sizeof(struct bytecode_range) / 4)
+
+struct opt_ctx {
+	struct bytecode_runtime *bytecode;
+	char *out;		/* Rewritten code */
+	size_t out_len;
+	struct opt_insn *insn;	/* Rewritten instructions */
+	unsigned int nr_insn;
+	unsigned int floor;	/* First instruction a rewrite can start at */
+	int *map;		/* Original offset to rewritten offset, or -1 */
+	unsigned int *nr_jumps;	/* Jumps targeting each original offset */
+	bool changed;
+};
+
+/*
+ * Length of a specialized instruction, or a negative error value for
+ * instructions the optimizer does not know about.
+ */
+static
+int opt_insn_len(const char *pc, const char *end)
+{
+	switch (*(bytecode_opcode_t *) pc) {
+	case BYTECODE_OP_RETURN:
+	case BYTECODE_OP_RETURN_S64:
+		return sizeof(struct return_op);
+
+	case BYTECODE_OP_EQ_STRING:
+	case BYTECODE_OP_NE_STRING:
+	case BYTECODE_OP_GT_STRING:
+	case BYTECODE_OP_LT_STRING:
+	case BYTECODE_OP_GE_STRING:
+	case BYTECODE_OP_LE_STRING:
+	case BYTECODE_OP_EQ_STAR_GLOB_STRING:
+	case BYTECODE_OP_NE_STAR_GLOB_STRING:
+	case BYTECODE_OP_EQ_S64:
+	case BYTECODE_OP_NE_S64:
+	case BYTECODE_OP_GT_S64:
+	case BYTECODE_OP_LT_S64:
+	case BYTECODE_OP_GE_S64:
+	case BYTECODE_OP_LE_S64:
+	case BYTECODE_OP_BIT_RSHIFT:
+	case BYTECODE_OP_BIT_LSHIFT:
+	case BYTECODE_OP_BIT_AND:
+	case BYTECODE_OP_BIT_OR:
+	case BYTECODE_OP_BIT_XOR:
+		return sizeof(struct binary_op);
+
+	case BYTECODE_OP_UNARY_PLUS_S64:
+	case BYTECODE_OP_UNARY_MINUS_S64:
+	case BYTECODE_OP_UNARY_NOT_S64:
+	case BYTECODE_OP_UNARY_BIT_NOT:
+		return sizeof(struct unary_op);
+
+	case BYTECODE_OP_AND:
+	case BYTECODE_OP_OR:
+		return sizeof(struct logical_op);
+
+	case BYTECODE_OP_LOAD_FIELD_REF_STRING:
+	case BYTECODE_OP_LOAD_FIELD_REF_SEQUENCE:
+	case BYTECODE_OP_LOAD_FIELD_REF_USER_STRING:
+	case BYTECODE_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+	case BYTECODE_OP_LOAD_FIELD_REF_S64:
+	case BYTECODE_OP_GET_CONTEXT_REF_STRING:
+	case BYTECODE_OP_GET_CONTEXT_REF_S64:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+
+	case BYTECODE_OP_LOAD_STRING:
+	case BYTECODE_OP_LOAD_STAR_GLOB_STRING:
+	{
+		const struct load_op *insn = (const struct load_op *) pc;
+		size_t maxlen = end - pc - sizeof(struct load_op);
+		size_t str_len = strnlen(insn->data, maxlen);
+
+		if (str_len >= maxlen)
+			return -ERANGE;
+		return sizeof(struct load_op) + str_len + 1;
+	}
+
+	case BYTECODE_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+
+	case BYTECODE_OP_CAST_NOP:
+		return sizeof(struct cast_op);
+
+	case BYTECODE_OP_GET_CONTEXT_ROOT:
+	case BYTECODE_OP_GET_APP_CONTEXT_ROOT:
+	case BYTECODE_OP_GET_PAYLOAD_ROOT:
+	case BYTECODE_OP_LOAD_FIELD:
+	case BYTECODE_OP_LOAD_FIELD_S8:
+	case BYTECODE_OP_LOAD_FIELD_S16:
+	case BYTECODE_OP_LOAD_FIELD_S32:
+	case BYTECODE_OP_LOAD_FIELD_S64:
+	case BYTECODE_OP_LOAD_FIELD_U8:
+	case BYTECODE_OP_LOAD_FIELD_U16:
+	case BYTECODE_OP_LOAD_FIELD_U32:
+	case BYTECODE_OP_LOAD_FIELD_U64:
+	case BYTECODE_OP_LOAD_FIELD_STRING:
+	case BYTECODE_OP_LOAD_FIELD_SEQUENCE:
+		return sizeof(struct load_op);
+
+	case BYTECODE_OP_GET_SYMBOL:
+		return sizeof(struct load_op) + sizeof(struct get_symbol);
+	case BYTECODE_OP_GET_INDEX_U16:
+		return sizeof(struct load_op) + sizeof(struct get_index_u16);
+	case BYTECODE_OP_GET_INDEX_U64:
+		return sizeof(struct load_op) + sizeof(struct get_index_u64);
+
+	default:
+		dbg_printk("Bytecode optimizer: unsupported op %s (%u)\n",
+			lttng_bytecode_print_op(*(bytecode_opcode_t *) pc),
+			(unsigned int) *(bytecode_opcode_t *) pc);
+		return -EINVAL;
+	}
+}
+
+static
+void opt_emit(struct opt_ctx *ctx, const char *pc, size_t len)
+{
+	struct opt_insn *insn = &ctx->insn[ctx->nr_insn++];
+
+	insn->pc = ctx->out + ctx->out_len;
+	insn->op = *(bytecode_opcode_t *) pc;
+	insn->field = false;
+	insn->ranges = NULL;
+	insn->nr_ranges = 0;
+	if (insn->op == BYTECODE_OP_AND || insn->op == BYTECODE_OP_OR)
+		insn->target = ((const struct logical_op *) pc)->skip_offset;
+	memcpy(insn->pc, pc, len);
+	ctx->out_len += len;
+}
+
+/* Drop the rewritten instructions starting at index start. */
+static
+void opt_truncate(struct opt_ctx *ctx, unsigned int start)
+{
+	unsigned int i;
+
+	for (i = start; i < ctx->nr_insn; i++) {
+		kfree(ctx->insn[i].ranges);
+		ctx->insn[i].ranges = NULL;
+	}
+	ctx->nr_insn = start;
+	ctx->out_len = ctx->insn[start].pc - ctx->out;
+	ctx->changed = true;
+}
+
+/* Index of the last nr instructions, if they can be rewritten, else -1. */
+static
+int opt_tail(struct opt_ctx *ctx, unsigned int nr)
+{
+	if (ctx->nr_insn < nr || ctx->nr_insn - nr < ctx->floor)
+		return -1;
+	return ctx->nr_insn - nr;
+}
+
+static
+bool opt_is_literal(struct opt_ctx *ctx, int index)
+{
+	return index >= 0 && ctx->insn[index].op == BYTECODE_OP_LOAD_S64;
+}
+
+static
+int64_t opt_literal(struct opt_ctx *ctx, int index)
+{
+	struct load_op *insn = (struct load_op *) ctx->insn[index].pc;
+
+	return ((struct literal_numeric *) insn->data)->v;
+}
+
+static
+void opt_set_literal(struct opt_ctx *ctx, int index, int64_t v)
+{
+	struct load_op *insn = (struct load_op *) ctx->insn[index].pc;
+
+	((struct literal_numeric *) insn->data)->v = v;
+	ctx->changed = true;
+}
+
+static
+void opt_emit_literal(struct opt_ctx *ctx, int64_t v)
+{
+	char buf[sizeof(struct load_op) + sizeof(struct literal_numeric)];
+	struct load_op *insn = (struct load_op *) buf;
+
+	insn->op = BYTECODE_OP_LOAD_S64;
+	((struct literal_numeric *) insn->data)->v = v;
+	opt_emit(ctx, buf, sizeof(buf));
+}
+
+/*
+ * Record that the last instruction completes the load of an integer
+ * payload field, either LOAD_FIELD_REF_S64 or the GET_PAYLOAD_ROOT,
+ * GET_INDEX_U16, LOAD_FIELD_<type> sequence.
+ */
+static
+void opt_mark_field(struct opt_ctx *ctx)
+{
+	struct bytecode_runtime *bytecode = ctx->bytecode;
+	struct opt_insn *insn = &ctx->insn[ctx->nr_insn - 1];
+
+	if (insn->op == BYTECODE_OP_LOAD_FIELD_REF_S64) {
+		struct load_op *load = (struct load_op *) insn->pc;
+
+		insn->field = true;
+		insn->field_start = ctx->nr_insn - 1;
+		insn->load_op = BYTECODE_OP_LOAD_FIELD_S64;
+		insn->field_offset = ((struct field_ref *) load->data)->offset;
+	} else {
+		const struct bytecode_get_index_data *gid;
+		struct get_index_u16 *index;
+		struct load_op *load;
+
+		if (ctx->nr_insn < 3
+				|| ctx->insn[ctx->nr_insn - 3].op != BYTECODE_OP_GET_PAYLOAD_ROOT
+				|| ctx->insn[ctx->nr_insn - 2].op != BYTECODE_OP_GET_INDEX_U16)
+			return;
+		load = (struct load_op *) ctx->insn[ctx->nr_insn - 2].pc;
+		index = (struct get_index_u16 *) load->data;
+		if (index->index + sizeof(*gid) > bytecode->data_len)
+			return;
+		gid = (const struct bytecode_get_index_data *) &bytecode->data[index->index];
+		if (gid->offset > U16_MAX)
+			return;
+		insn->field = true;
+		insn->field_start = ctx->nr_insn - 3;
+		insn->load_op = insn->op;
+		insn->field_offset = gid->offset;
+	}
+}
+
+static
+bytecode_opcode_t opt_swap_compare(bytecode_opcode_t op)
+{
+	switch (op) {
+	case BYTECODE_OP_GT_S64:
+		return BYTECODE_OP_LT_S64;
+	case BYTECODE_OP_LT_S64:
+		return BYTECODE_OP_GT_S64;
+	case BYTECODE_OP_GE_S64:
+		return BYTECODE_OP_LE_S64;
+	case BYTECODE_OP_LE_S64:
+		return BYTECODE_OP_GE_S64;
+	default:
+		return op;
+	}
+}
+
+static
+int64_t opt_compare(bytecode_opcode_t op, int64_t a, int64_t b)
+{
+	switch (op) {
+	case BYTECODE_OP_EQ_S64:
+		return a == b;
+	case BYTECODE_OP_NE_S64:
+		return a != b;
+	case BYTECODE_OP_GT_S64:
+		return a > b;
+	case BYTECODE_OP_LT_S64:
+		return a < b;
+	case BYTECODE_OP_GE_S64:
+		return a >= b;
+	case BYTECODE_OP_LE_S64:
+	default:
+		return a <= b;
+	}
+}
+
+/* Comparator on S64 registers, bx <op> ax. */
+static
+void opt_compare_insn(struct opt_ctx *ctx, const char *pc, size_t len)
+{
+	bytecode_opcode_t op = *(bytecode_opcode_t *) pc;
+	struct cmp_field_imm_op cmp;
+	int bx = opt_tail(ctx, 2), ax = opt_tail(ctx, 1);
+	const struct opt_insn *field;
+	int64_t v;
+	int start;
+
+	if (opt_is_literal(ctx, bx) && opt_is_literal(ctx, ax)) {
+		v = opt_compare(op, opt_literal(ctx, bx), opt_literal(ctx, ax));
+		opt_truncate(ctx, bx);
+		opt_emit_literal(ctx, v);
+		return;
+	}
+
+	/* field <op> literal */
+	if (opt_is_literal(ctx, ax) && ctx->nr_insn >= 2
+			&& ctx->insn[ctx->nr_insn - 2].field
+			&& ctx->insn[ctx->nr_insn - 2].field_start >= ctx->floor) {
+		field = &ctx->insn[ctx->nr_insn - 2];
+		start = field->field_start;
+		v = opt_literal(ctx, ax);
+	/* literal <op> field */
+	} else if (ax >= 0 && ctx->insn[ax].field
+			&& ctx->insn[ax].field_start > ctx->floor
+			&& opt_is_literal(ctx, ctx->insn[ax].field_start - 1)) {
+		field = &ctx->insn[ax];
+		start = field->field_start - 1;
+		v = opt_literal(ctx, start);
+		op = opt_swap_compare(op);
+	} else {
+		opt_emit(ctx, pc, len);
+		return;
+	}
+	cmp.op = BYTECODE_OP_CMP_FIELD_IMM_S64;
+	cmp.cmp_op = op;
+	cmp.load_op = field->load_op;
+	cmp.offset = field->field_offset;
+	cmp.v = v;
+	opt_truncate(ctx, start);
+	opt_emit(ctx, (const char *) &cmp, sizeof(cmp));
+}
+
+/*
+ * Describe the values accepted by a field comparison, or by a ranges
+ * lookup, as sorted ranges.
+ */
+static
+bool opt_range_term(struct opt_ctx *ctx, unsigned int index, struct opt_term *term)
+{
+	const struct opt_insn *insn = &ctx->insn[index];
+	unsigned int nr = 0;
+
+	if (insn->op == BYTECODE_OP_FIELD_IN_RANGES_S64) {
+		const struct field_in_ranges_op *op = (const struct field_in_ranges_op *) insn->pc;
+
+		term->load_op = op->load_op;
+		term->offset = op->offset;
+		term->ranges = insn->ranges;
+		term->nr_ranges = insn->nr_ranges;
+		return true;
+	}
+	if (insn->op == BYTECODE_OP_CMP_FIELD_IMM_S64) {
+		const struct cmp_field_imm_op *op = (const struct cmp_field_imm_op *) insn->pc;
+		int64_t v = op->v;
+
+		term->load_op = op->load_op;
+		term->offset = op->offset;
+		switch (op->cmp_op) {
+		case BYTECODE_OP_EQ_S64:
+			term->buf[nr].min = v;
+			term->buf[nr++].max = v;
+			break;
+		case BYTECODE_OP_NE_S64:
+			if (v != S64_MIN) {
+				term->buf[nr].min = S64_MIN;
+				term->buf[nr++].max = v - 1;
+			}
+			if (v != S64_MAX) {
+				term->buf[nr].min = v + 1;
+				term->buf[nr++].max = S64_MAX;
+			}
+			break;
+		case BYTECODE_OP_GT_S64:
+			if (v != S64_MAX) {
+				term->buf[nr].min = v + 1;
+				term->buf[nr++].max = S64_MAX;
+			}
+			break;
+		case BYTECODE_OP_GE_S64:
+			term->buf[nr].min = v;
+			term->buf[nr++].max = S64_MAX;
+			break;
+		case BYTECODE_OP_LT_S64:
+			if (v != S64_MIN) {
+				term->buf[nr].min = S64_MIN;
+				term->buf[nr++].max = v - 1;
+			}
+			break;
+		case BYTECODE_OP_LE_S64:
+			term->buf[nr].min = S64_MIN;
+			term->buf[nr++].max = v;
+			break;
+		default:
+			return false;
+		}
+		term->ranges = term->buf;
+		term->nr_ranges = nr;
+		return true;
+	}
+	return false;
+}
+
+/* Union or intersection of sorted, disjoint and not adjacent ranges. */
+static
+struct bytecode_range *opt_combine_ranges(const struct opt_term *a,
+		const struct opt_term *b, bool intersect, unsigned int *nr_ranges)
+{
+	struct bytecode_range *out, r;
+	unsigned int i = 0, j = 0, nr = 0;
+
+	out = kmalloc_array(max(a->nr_ranges + b->nr_ranges, 1U), sizeof(*out), GFP_KERNEL);
+	if (!out)
+		return NULL;
+	while (i < a->nr_ranges && j < b->nr_ranges) {
+		const struct bytecode_range *ra = &a->ranges[i], *rb = &b->ranges[j];
+
+		if (intersect) {
+			r.min = max(ra->min, rb->min);
+			r.max = min(ra->max, rb->max);
+			if (r.min <= r.max)
+				out[nr++] = r;
+			if (ra->max < rb->max)
+				i++;
+			else
+				j++;
+			continue;
+		}
+		if (ra->min < rb->min) {
+			r = *ra;
+			i++;
+		} else {
+			r = *rb;
+			j++;
+		}
+		if (nr && (out[nr - 1].max == S64_MAX || r.min <= out[nr - 1].max + 1))
+			out[nr - 1].max = max(out[nr - 1].max, r.max);
+		else
+			out[nr++] = r;
+	}
+	/* Ranges left in one of the inputs only belong to the union. */
+	while (!intersect && (i < a->nr_ranges || j < b->nr_ranges)) {
+		r = i < a->nr_ranges ? a->ranges[i++] : b->ranges[j++];
+		if (nr && (out[nr - 1].max == S64_MAX || r.min <= out[nr - 1].max + 1))
+			out[nr - 1].max = max(out[nr - 1].max, r.max);
+		else
+			out[nr++] = r;
+	}
+	*nr_ranges = nr;
+	return out;
+}
+
+/*
+ * Emit the lookup of a field in ranges, as a single comparison when the
+ * ranges allow it. Takes ownership of ranges.
+ */
+static
+void opt_emit_ranges(struct opt_ctx *ctx, bytecode_opcode_t load_op,
+		uint16_t offset, struct bytecode_range *ranges, unsigned int nr)
+{
+	struct field_in_ranges_op lookup;
+	struct cmp_field_imm_op cmp;
+
+	cmp.op = BYTECODE_OP_CMP_FIELD_IMM_S64;
+	cmp.cmp_op = 0;
+	cmp.load_op = load_op;
+	cmp.offset = offset;
+	if (nr == 1 && ranges[0].min == ranges[0].max) {
+		cmp.cmp_op = BYTECODE_OP_EQ_S64;
+		cmp.v = ranges[0].min;
+	} else if (nr == 1 && ranges[0].min == S64_MIN && ranges[0].max != S64_MAX) {
+		cmp.cmp_op = BYTECODE_OP_LE_S64;
+		cmp.v = ranges[0].max;
+	} else if (nr == 1 && ranges[0].min != S64_MIN && ranges[0].max == S64_MAX) {
+		cmp.cmp_op = BYTECODE_OP_GE_S64;
+		cmp.v = ranges[0].min;
+	} else if (nr == 2 && ranges[0].min == S64_MIN && ranges[1].max == S64_MAX
+			&& ranges[1].min == ranges[0].max + 2) {
+		cmp.cmp_op = BYTECODE_OP_NE_S64;
+		cmp.v = ranges[0].max + 1;
+	}
+	if (cmp.cmp_op) {
+		kfree(ranges);
+		opt_emit(ctx, (const char *) &cmp, sizeof(cmp));
+		return;
+	}
+	lookup.op = BYTECODE_OP_FIELD_IN_RANGES_S64;
+	lookup.load_op = load_op;
+	lookup.offset = offset;
+	lookup.table = 0;	/* Set by opt_add_ranges(). */
+	lookup.nr_ranges = nr;
+	opt_emit(ctx, (const char *) &lookup, sizeof(lookup));
+	ctx->insn[ctx->nr_insn - 1].ranges = ranges;
+	ctx->insn[ctx->nr_insn - 1].nr_ranges = nr;
+}
+
+/*
+ * Called when reaching the instruction at offset: merge "term, AND or OR
+ * jumping to offset, term" on the same field into a single lookup, as
+ * long as no other jump lands within them.
+ */
+static
+void opt_merge_ranges(struct opt_ctx *ctx, uint16_t offset)
+{
+	struct bytecode_range *ranges;
+	struct opt_term a, b;
+	unsigned int nr;
+	int start;
+
+	for (;;) {
+		const struct opt_insn *logical;
+
+		start = opt_tail(ctx, 3);
+		if (start < 0)
+			return;
+		logical = &ctx->insn[start + 1];
+		if ((logical->op != BYTECODE_OP_AND && logical->op != BYTECODE_OP_OR)
+				|| logical->target != offset)
+			return;
+		if (!opt_range_term(ctx, start, &a) || !opt_range_term(ctx, start + 2, &b))
+			return;
+		if (a.load_op != b.load_op || a.offset != b.offset)
+			return;
+		ranges = opt_combine_ranges(&a, &b, logical->op == BYTECODE_OP_AND, &nr);
+		if (!ranges)
+			return;
+		if (nr > OPT_MAX_RANGES) {
+			kfree(ranges);
+			return;
+		}
+		ctx->nr_jumps[offset]--;
+		opt_truncate(ctx, start);
+		opt_emit_ranges(ctx, a.load_op, a.offset, ranges, nr);
+	}
+}
+
+/* Append the tables of the ranges lookups to the runtime data. */
+static
+int opt_add_ranges(struct opt_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_insn; i++) {
+		struct opt_insn *insn = &ctx->insn[i];
+		ssize_t table;
+
+		if (insn->op != BYTECODE_OP_FIELD_IN_RANGES_S64 || !insn->nr_ranges)
+			continue;
+		table = bytecode_push_data(ctx->bytecode, insn->ranges,
+				__alignof__(struct bytecode_range),
+				insn->nr_ranges * sizeof(struct bytecode_range));
+		if (table < 0)
+			return table;
+		if (table > U16_MAX)
+			return -E2BIG;
+		((struct field_in_ranges_op *) insn->pc)->table = table;
+	}
+	return 0;
+}
+
+/*
+ * Logical operator. When its operand is a literal, either the jump is
+ * never taken and both are removed, or it is always taken and the
+ * instructions it skips are removed, unless another jump targets them.
+ */
+static
+void opt_logical_insn(struct opt_ctx *ctx, const char *start_pc,
+		const char *pc, size_t len, const char **next_pc)
+{
+	const struct logical_op *insn = (const struct logical_op *) pc;
+	int ax = opt_tail(ctx, 1);
+	uint16_t target = insn->skip_offset;
+	const char *p;
+	bool taken;
+	int p_len;
+
+	if (!opt_is_literal(ctx, ax)) {
+		opt_emit(ctx, pc, len);
+		return;
+	}
+	if (insn->op == BYTECODE_OP_AND)
+		taken = (opt_literal(ctx, ax) == 0);
+	else
+		taken = (opt_literal(ctx, ax) != 0);
+	if (!taken) {
+		/* Pop 1 when jump not taken. */
+		ctx->nr_jumps[target]--;
+		opt_truncate(ctx, ax);
+		return;
+	}
+
+	/* Jumps from the skipped instructions go away with them. */
+	for (p = pc + len; p < start_pc + target; p += p_len) {
+		p_len = opt_insn_len(p, start_pc + ctx->bytecode->len);
+		if (*(bytecode_opcode_t *) p == BYTECODE_OP_AND
+				|| *(bytecode_opcode_t *) p == BYTECODE_OP_OR)
+			ctx->nr_jumps[((const struct logical_op *) p)->skip_offset]--;
+	}
+	for (p = pc + len; p < start_pc + target; p += p_len) {
+		p_len = opt_insn_len(p, start_pc + ctx->bytecode->len);
+		if (ctx->nr_jumps[p - start_pc])
+			break;
+	}
+	if (p < start_pc + target) {
+		/* Another jump lands in the skipped instructions. */
+		for (p = pc + len; p < start_pc + target; p += p_len) {
+			p_len = opt_insn_len(p, start_pc + ctx->bytecode->len);
+			if (*(bytecode_opcode_t *) p == BYTECODE_OP_AND
+				|| *(bytecode_opcode_t *) p == BYTECODE_OP_OR)
+				ctx->nr_jumps[((const struct logical_op *) p)->skip_offset]++;
+		}
+		opt_emit(ctx, pc, len);
+		return;
+	}
+	/* OR evaluates to 1 when taken, AND to 0. */
+	opt_set_literal(ctx, ax, insn->op == BYTECODE_OP_OR);
+	ctx->nr_jumps[target]--;
+	*next_pc = start_pc + target;
+}
+
+static
+void opt_insn(struct opt_ctx *ctx, const char *start_pc, const char *pc,
+		size_t len, const char **next_pc)
+{
+	int ax;
+
+	switch (*(bytecode_opcode_t *) pc) {
+	case BYTECODE_OP_CAST_NOP:
+	case BYTECODE_OP_UNARY_PLUS_S64:
+		ctx->changed = true;
+		break;
+
+	case BYTECODE_OP_UNARY_MINUS_S64:
+	case BYTECODE_OP_UNARY_NOT_S64:
+		ax = opt_tail(ctx, 1);
+		if (!opt_is_literal(ctx, ax)) {
+			opt_emit(ctx, pc, len);
+			break;
+		}
+		if (*(bytecode_opcode_t *) pc == BYTECODE_OP_UNARY_MINUS_S64)
+			opt_set_literal(ctx, ax, (int64_t) -(uint64_t) opt_literal(ctx, ax));
+		else
+			opt_set_literal(ctx, ax, !opt_literal(ctx, ax));
+		break;
+
+	case BYTECODE_OP_EQ_S64:
+	case BYTECODE_OP_NE_S64:
+	case BYTECODE_OP_GT_S64:
+	case BYTECODE_OP_LT_S64:
+	case BYTECODE_OP_GE_S64:
+	case BYTECODE_OP_LE_S64:
+		opt_compare_insn(ctx, pc, len);
+		break;
+
+	case BYTECODE_OP_AND:
+	case BYTECODE_OP_OR:
+		opt_logical_insn(ctx, start_pc, pc, len, next_pc);
+		break;
+
+	case BYTECODE_OP_LOAD_FIELD_REF_S64:
+	case BYTECODE_OP_LOAD_FIELD_S8:
+	case BYTECODE_OP_LOAD_FIELD_S16:
+	case BYTECODE_OP_LOAD_FIELD_S32:
+	case BYTECODE_OP_LOAD_FIELD_S64:
+	case BYTECODE_OP_LOAD_FIELD_U8:
+	case BYTECODE_OP_LOAD_FIELD_U16:
+	case BYTECODE_OP_LOAD_FIELD_U32:
+	case BYTECODE_OP_LOAD_FIELD_U64:
+		opt_emit(ctx, pc, len);
+		opt_mark_field(ctx);
+		break;
+
+	default:
+		opt_emit(ctx, pc, len);
+		break;
+	}
+}
+
+/*
+ * Count the jumps targeting each instruction, and return the length of
+ * the code up to the first return, the only part seen by the validator.
+ */
+static
+int opt_scan(struct opt_ctx *ctx)
+{
+	struct bytecode_runtime *bytecode = ctx->bytecode;
+	char *start_pc = bytecode->code, *end_pc = start_pc + bytecode->len;
+	char *pc;
+	int len;
+
+	for (pc = start_pc; pc < end_pc; pc += len) {
+		len = opt_insn_len(pc, end_pc);
+		if (len < 0)
+			return len;
+		if (pc + len > end_pc)
+			return -ERANGE;
+		switch (*(bytecode_opcode_t *) pc) {
+		case BYTECODE_OP_RETURN:
+		case BYTECODE_OP_RETURN_S64:
+			return pc + len - start_pc;
+		case BYTECODE_OP_AND:
+		case BYTECODE_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			if (insn->skip_offset <= pc - start_pc
+					|| insn->skip_offset >= bytecode->len)
+				return -EINVAL;
+			ctx->nr_jumps[insn->skip_offset]++;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	return -EINVAL;
+}
+
+static
+int opt_rewrite(struct opt_ctx *ctx)
+{
+	char *start_pc = ctx->bytecode->code;
+	const char *pc, *next_pc;
+	unsigned int i;
+	int code_len, len, ret;
+
+	code_len = opt_scan(ctx);
+	if (code_len < 0)
+		return code_len;
+	if (code_len < ctx->bytecode->len)
+		ctx->changed = true;
+	for (pc = start_pc; pc < start_pc + code_len; pc = next_pc) {
+		len = opt_insn_len(pc, start_pc + code_len);
+		next_pc = pc + len;
+		opt_merge_ranges(ctx, pc - start_pc);
+		if (ctx->nr_jumps[pc - start_pc])
+			ctx->floor = ctx->nr_insn;
+		ctx->map[pc - start_pc] = ctx->out_len;
+		opt_insn(ctx, start_pc, pc, len, &next_pc);
+	}
+	ret = opt_add_ranges(ctx);
+	if (ret)
+		return ret;
+	/* Relocate the remaining jumps. */
+	for (i = 0; i < ctx->nr_insn; i++) {
+		struct opt_insn *insn = &ctx->insn[i];
+
+		if (insn->op != BYTECODE_OP_AND && insn->op != BYTECODE_OP_OR)
+			continue;
+		if (ctx->map[insn->target] < 0)
+			return -EINVAL;
+		((struct logical_op *) insn->pc)->skip_offset = ctx->map[insn->target];
+	}
+	return 0;
+}
+
+int lttng_bytecode_optimize(struct bytecode_runtime *bytecode)
+{
+	struct opt_ctx ctx = { .bytecode = bytecode };
+	uint16_t orig_len = bytecode->len;
+	char *orig_code = NULL;
+	unsigned int i;
+	int ret;
+
+	ctx.out = kzalloc(orig_len, GFP_KERNEL);
+	ctx.insn = kcalloc(orig_len, sizeof(*ctx.insn), GFP_KERNEL);
+	ctx.map = kcalloc(orig_len, sizeof(*ctx.map), GFP_KERNEL);
+	ctx.nr_jumps = kcalloc(orig_len, sizeof(*ctx.nr_jumps), GFP_KERNEL);
+	if (!ctx.out || !ctx.insn || !ctx.map || !ctx.nr_jumps) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	for (i = 0; i < orig_len; i++)
+		ctx.map[i] = -1;
+	ret = opt_rewrite(&ctx);
+	if (ret || !ctx.changed)
+		goto end;
+
+	orig_code = kmemdup(bytecode->code, orig_len, GFP_KERNEL);
+	if (!orig_code) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	memcpy(bytecode->code, ctx.out, ctx.out_len);
+	bytecode->len = ctx.out_len;
+	bytecode->optimized = true;
+	ret = lttng_bytecode_validate(bytecode);
+	if (ret) {
+		printk(KERN_WARNING "LTTng: bytecode: Optimized bytecode rejected by the validator, keeping the original bytecode\n");
+		memcpy(bytecode->code, orig_code, orig_len);
+		bytecode->len = orig_len;
+		bytecode->optimized = false;
+		goto end;
+	}
+	dbg_printk("Bytecode optimized from %u to %u bytes\n",
+		(unsigned int) orig_len, (unsigned int) bytecode->len);
+end:
+	if (ctx.insn) {
+		for (i = 0; i < ctx.nr_insn; i++)
+			kfree(ctx.insn[i].ranges);
+	}
+	kfree(orig_code);
+	kfree(ctx.nr_jumps);
+	kfree(ctx.map);
+	kfree(ctx.insn);
+	kfree(ctx.out);
+	return ret;
+}
@@ -45,7 +45,7 @@ static ssize_t bytecode_reserve_data(struct bytecode_runtime *runtime,
 	return ret;
 }
 
-static ssize_t bytecode_push_data(struct bytecode_runtime *runtime,
+ssize_t bytecode_push_data(struct bytecode_runtime *runtime,
 		const void *p, size_t align, size_t len)
 {
 	ssize_t offset;
@@ -449,7 +449,7 @@ static int specialize_payload_lookup(const struct lttng_kernel_event_desc *event
 {
 	const char *name;
 	uint16_t offset;
-	unsigned int i, nr_fields;
+	unsigned int i, nr_fields, filter_idx = 0;
 	bool found = false;
 	uint32_t field_offset = 0;
 	const struct lttng_kernel_event_field *field;
@@ -487,11 +487,13 @@ static int specialize_payload_lookup(const struct lttng_kernel_event_desc *event
 			ret = -EINVAL;
 			goto end;
 		}
+		filter_idx++;
 	}
 	if (!found) {
 		ret = -EINVAL;
 		goto end;
 	}
+	runtime->p.payload_fields |= LTTNG_FILTER_FIELD_BIT(filter_idx);
 
 	ret = specialize_load_object(field, load, false);
 	if (ret)
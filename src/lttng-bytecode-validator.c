@@ -527,6 +527,42 @@ int bytecode_validate_overflow(struct bytecode_runtime *bytecode,
 			ret = -ERANGE;
 		}
 		break;
+
+	/* Internal instructions, only valid in optimized bytecode. */
+	case BYTECODE_OP_CMP_FIELD_IMM_S64:
+		if (!bytecode->optimized) {
+			printk(KERN_WARNING "LTTng: bytecode: unknown bytecode op %u\n",
+				(unsigned int) *(bytecode_opcode_t *) pc);
+			ret = -EINVAL;
+			break;
+		}
+		if (unlikely(pc + sizeof(struct cmp_field_imm_op)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+		}
+		break;
+
+	case BYTECODE_OP_FIELD_IN_RANGES_S64:
+	{
+		struct field_in_ranges_op *insn = (struct field_in_ranges_op *) pc;
+
+		if (!bytecode->optimized) {
+			printk(KERN_WARNING "LTTng: bytecode: unknown bytecode op %u\n",
+				(unsigned int) *(bytecode_opcode_t *) pc);
+			ret = -EINVAL;
+			break;
+		}
+		if (unlikely(pc + sizeof(struct field_in_ranges_op)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+			break;
+		}
+		if (unlikely((size_t) insn->table + (size_t) insn->nr_ranges * sizeof(struct bytecode_range)
+				> bytecode->data_len)) {
+			ret = -ERANGE;
+		}
+		break;
+	}
 	}
 
 	return ret;
@@ -1089,6 +1125,62 @@ int validate_instruction_context(struct bytecode_runtime *bytecode,
 			(unsigned long long) get_index->index);
 		break;
 	}
+
+	case BYTECODE_OP_CMP_FIELD_IMM_S64:
+	{
+		struct cmp_field_imm_op *insn = (struct cmp_field_imm_op *) pc;
+
+		if (insn->cmp_op < BYTECODE_OP_EQ_S64
+				|| insn->cmp_op > BYTECODE_OP_LE_S64) {
+			printk(KERN_WARNING "LTTng: bytecode: Unknown field comparator %u\n",
+				(unsigned int) insn->cmp_op);
+			ret = -EINVAL;
+			goto end;
+		}
+		if (insn->load_op < BYTECODE_OP_LOAD_FIELD_S8
+				|| insn->load_op > BYTECODE_OP_LOAD_FIELD_U64) {
+			printk(KERN_WARNING "LTTng: bytecode: Unknown field load %u\n",
+				(unsigned int) insn->load_op);
+			ret = -EINVAL;
+			goto end;
+		}
+		dbg_printk("Validate compare field offset %u with immediate %lld\n",
+			(unsigned int) insn->offset, (long long) insn->v);
+		break;
+	}
+
+	case BYTECODE_OP_FIELD_IN_RANGES_S64:
+	{
+		struct field_in_ranges_op *insn = (struct field_in_ranges_op *) pc;
+		const struct bytecode_range *ranges;
+		unsigned int i;
+
+		if (insn->load_op < BYTECODE_OP_LOAD_FIELD_S8
+				|| insn->load_op > BYTECODE_OP_LOAD_FIELD_U64) {
+			printk(KERN_WARNING "LTTng: bytecode: Unknown field load %u\n",
+				(unsigned int) insn->load_op);
+			ret = -EINVAL;
+			goto end;
+		}
+		if (insn->table % __alignof__(struct bytecode_range)) {
+			printk(KERN_WARNING "LTTng: bytecode: Misaligned range table\n");
+			ret = -EINVAL;
+			goto end;
+		}
+		/* The lookup relies on sorted, disjoint ranges. */
+		ranges = (const struct bytecode_range *) &bytecode->data[insn->table];
+		for (i = 0; i < insn->nr_ranges; i++) {
+			if (ranges[i].min > ranges[i].max
+					|| (i && ranges[i].min <= ranges[i - 1].max)) {
+				printk(KERN_WARNING "LTTng: bytecode: Unsorted range table\n");
+				ret = -EINVAL;
+				goto end;
+			}
+		}
+		dbg_printk("Validate field offset %u in %u ranges\n",
+			(unsigned int) insn->offset, (unsigned int) insn->nr_ranges);
+		break;
+	}
 	}
 end:
 	return ret;
@@ -1758,6 +1850,28 @@ int exec_insn(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	case BYTECODE_OP_CMP_FIELD_IMM_S64:
+	{
+		if (vstack_push(stack)) {
+			ret = -EINVAL;
+			goto end;
+		}
+		vstack_ax(stack)->type = REG_S64;
+		next_pc += sizeof(struct cmp_field_imm_op);
+		break;
+	}
+
+	case BYTECODE_OP_FIELD_IN_RANGES_S64:
+	{
+		if (vstack_push(stack)) {
+			ret = -EINVAL;
+			goto end;
+		}
+		vstack_ax(stack)->type = REG_S64;
+		next_pc += sizeof(struct field_in_ranges_op);
+		break;
+	}
+
 	}
 end:
 	*_next_pc = next_pc;
@@ -9,7 +9,11 @@
 
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
+#include <wrapper/list.h>
 #include <lttng/lttng-bytecode.h>
 #include <lttng/events-internal.h>
 
@@ -157,6 +161,10 @@ static const char *opnames[] = {
 	[ BYTECODE_OP_UNARY_BIT_NOT ] = "UNARY_BIT_NOT",
 
 	[ BYTECODE_OP_RETURN_S64 ] = "RETURN_S64",
+
+	/* internal */
+	[ BYTECODE_OP_CMP_FIELD_IMM_S64 ] = "CMP_FIELD_IMM_S64",
+	[ BYTECODE_OP_FIELD_IN_RANGES_S64 ] = "FIELD_IN_RANGES_S64",
 };
 
 const char *lttng_bytecode_print_op(enum bytecode_op op)
@@ -176,7 +184,7 @@ int apply_field_reloc(const struct lttng_kernel_event_desc *event_desc,
 		enum bytecode_op bytecode_op)
 {
 	const struct lttng_kernel_event_field * const *fields, *field = NULL;
-	unsigned int nr_fields, i;
+	unsigned int nr_fields, i, filter_idx = 0;
 	struct load_op *op;
 	uint32_t field_offset = 0;
 
@@ -222,6 +230,7 @@ int apply_field_reloc(const struct lttng_kernel_event_desc *event_desc,
 		default:
 			return -EINVAL;
 		}
+		filter_idx++;
 	}
 	if (!field)
 		return -EINVAL;
@@ -229,6 +238,7 @@ int apply_field_reloc(const struct lttng_kernel_event_desc *event_desc,
 	/* Check if field offset is too large for 16-bit offset */
 	if (field_offset > LTTNG_KERNEL_ABI_FILTER_BYTECODE_MAX_LEN - 1)
 		return -EINVAL;
+	runtime->p.payload_fields |= LTTNG_FILTER_FIELD_BIT(filter_idx);
 
 	/* set type */
 	op = (struct load_op *) &runtime->code[reloc_offset];
@@ -407,6 +417,15 @@ int apply_reloc(const struct lttng_kernel_event_desc *event_desc,
 	return 0;
 }
 
+static
+void bytecode_runtime_set_interpreter(struct bytecode_runtime *runtime)
+{
+	if (runtime->jit_func)
+		runtime->p.interpreter_func = lttng_bytecode_jit_interpret;
+	else
+		runtime->p.interpreter_func = lttng_bytecode_interpret;
+}
+
 static
 int bytecode_is_linked(struct lttng_kernel_bytecode_node *bytecode,
 		struct list_head *bytecode_runtime_head)
@@ -420,6 +439,276 @@ int bytecode_is_linked(struct lttng_kernel_bytecode_node *bytecode,
 	return 0;
 }
 
+/*
+ * Link cache.
+ *
+ * Relocation, validation, specialization and optimization of a bytecode
+ * only depend on the layout of the payload fields it names. Wildcard
+ * enablers link the same bytecode with many events, most of them sharing
+ * this layout (events of a class, syscalls with the same leading
+ * arguments): link once per distinct layout, and share the result.
+ *
+ * Entries are keyed by bytecode, context and probe provider (specialized
+ * data points to the event fields, which must stay loaded), and by the
+ * stack offset, filter index and type of each named field. They are
+ * reference counted by the runtimes using them, and protected by the
+ * sessions mutex.
+ */
+#define BYTECODE_LINK_CACHE_HT_BITS	8
+#define BYTECODE_LINK_CACHE_HT_SIZE	(1U << BYTECODE_LINK_CACHE_HT_BITS)
+
+struct bytecode_field_ref {
+	const struct lttng_kernel_event_field *field;	/* NULL if not in the payload */
+	uint32_t offset;		/* Offset on the interpreter stack */
+	unsigned int filter_idx;	/* Index among filterable fields */
+};
+
+struct bytecode_link_cache {
+	struct hlist_node hlist;
+	struct lttng_kernel_bytecode_node *bc;
+	struct lttng_kernel_ctx *ctx;
+	const struct lttng_kernel_probe_desc *probe_desc;
+	uint32_t hash;
+	unsigned int refcount;
+
+	/* Link result. */
+	int link_ret;
+	uint64_t payload_fields;
+	bool optimized;
+	uint16_t len;
+	char *code;
+	char *data;
+	size_t data_len;
+
+	unsigned int nr_refs;
+	struct bytecode_field_ref refs[];
+};
+
+static struct hlist_head bytecode_link_cache_table[BYTECODE_LINK_CACHE_HT_SIZE];
+
+static
+bool bytecode_type_layout_equal(const struct lttng_kernel_type_common *a,
+		const struct lttng_kernel_type_common *b)
+{
+	if (a == b)
+		return true;
+	if (a->type != b->type)
+		return false;
+	switch (a->type) {
+	case lttng_kernel_type_integer:
+	{
+		const struct lttng_kernel_type_integer *ia = lttng_kernel_get_type_integer(a),
+			*ib = lttng_kernel_get_type_integer(b);
+
+		return ia->size == ib->size && ia->alignment == ib->alignment
+			&& ia->signedness == ib->signedness
+			&& ia->reverse_byte_order == ib->reverse_byte_order;
+	}
+	case lttng_kernel_type_enum:
+		return bytecode_type_layout_equal(lttng_kernel_get_type_enum(a)->container_type,
+				lttng_kernel_get_type_enum(b)->container_type);
+	case lttng_kernel_type_array:
+	{
+		const struct lttng_kernel_type_array *aa = lttng_kernel_get_type_array(a),
+			*ab = lttng_kernel_get_type_array(b);
+
+		return aa->length == ab->length && aa->alignment == ab->alignment
+			&& aa->encoding == ab->encoding
+			&& bytecode_type_layout_equal(aa->elem_type, ab->elem_type);
+	}
+	case lttng_kernel_type_sequence:
+	{
+		const struct lttng_kernel_type_sequence *sa = lttng_kernel_get_type_sequence(a),
+			*sb = lttng_kernel_get_type_sequence(b);
+
+		return sa->alignment == sb->alignment && sa->encoding == sb->encoding
+			&& bytecode_type_layout_equal(sa->elem_type, sb->elem_type);
+	}
+	case lttng_kernel_type_string:
+		return lttng_kernel_get_type_string(a)->encoding == lttng_kernel_get_type_string(b)->encoding;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Lookup a field by name like apply_field_reloc() and
+ * specialize_payload_lookup() do. Returns -EINVAL on a layout which
+ * cannot be resolved: such events are linked without the cache.
+ */
+static
+int bytecode_resolve_field_ref(const struct lttng_kernel_event_desc *event_desc,
+		const char *name, struct bytecode_field_ref *ref)
+{
+	const struct lttng_kernel_tracepoint_class *tp_class = event_desc->tp_class;
+	unsigned int i;
+
+	ref->field = NULL;
+	ref->offset = 0;
+	ref->filter_idx = 0;
+	for (i = 0; i < tp_class->nr_fields; i++) {
+		const struct lttng_kernel_event_field *field = tp_class->fields[i];
+
+		if (field->nofilter)
+			continue;
+		if (!strcmp(field->name, name)) {
+			ref->field = field;
+			return 0;
+		}
+		switch (field->type->type) {
+		case lttng_kernel_type_integer:
+		case lttng_kernel_type_enum:
+			ref->offset += sizeof(int64_t);
+			break;
+		case lttng_kernel_type_array:
+			if (!lttng_kernel_type_is_bytewise_integer(lttng_kernel_get_type_array(field->type)->elem_type))
+				return -EINVAL;
+			ref->offset += sizeof(unsigned long);
+			ref->offset += sizeof(void *);
+			break;
+		case lttng_kernel_type_sequence:
+			if (!lttng_kernel_type_is_bytewise_integer(lttng_kernel_get_type_sequence(field->type)->elem_type))
+				return -EINVAL;
+			ref->offset += sizeof(unsigned long);
+			ref->offset += sizeof(void *);
+			break;
+		case lttng_kernel_type_string:
+			ref->offset += sizeof(void *);
+			break;
+		default:
+			return -EINVAL;
+		}
+		ref->filter_idx++;
+	}
+	return 0;
+}
+
+/*
+ * Allocate a link cache entry describing how the names of the bytecode
+ * reloc table resolve in the event payload. Returns NULL if the event
+ * cannot use the cache.
+ */
+static
+struct bytecode_link_cache *bytecode_link_cache_alloc(const struct lttng_kernel_event_desc *event_desc,
+		struct lttng_kernel_ctx *ctx,
+		struct lttng_kernel_bytecode_node *bytecode)
+{
+	struct bytecode_link_cache *entry;
+	unsigned int nr_refs = 0, i;
+	uint32_t offset, hash;
+
+	if (!event_desc || !event_desc->tp_class || !event_desc->tp_class->fields)
+		return NULL;
+	for (offset = bytecode->bc.reloc_offset; offset < bytecode->bc.len;
+			offset += sizeof(uint16_t) + strlen(&bytecode->bc.data[offset + sizeof(uint16_t)]) + 1)
+		nr_refs++;
+	entry = kzalloc(sizeof(*entry) + nr_refs * sizeof(entry->refs[0]), GFP_KERNEL);
+	if (!entry)
+		return NULL;
+	entry->bc = bytecode;
+	entry->ctx = ctx;
+	entry->probe_desc = event_desc->probe_desc;
+	entry->nr_refs = nr_refs;
+	hash = jhash_3words((u32) (unsigned long) bytecode, (u32) (unsigned long) ctx,
+			(u32) (unsigned long) event_desc->probe_desc, 0);
+	for (i = 0, offset = bytecode->bc.reloc_offset; i < nr_refs; i++) {
+		const char *name = &bytecode->bc.data[offset + sizeof(uint16_t)];
+		struct bytecode_field_ref *ref = &entry->refs[i];
+
+		if (bytecode_resolve_field_ref(event_desc, name, ref)) {
+			kfree(entry);
+			return NULL;
+		}
+		hash = jhash_3words(ref->offset, ref->filter_idx,
+				ref->field ? ref->field->type->type : ~0U, hash);
+		offset += sizeof(uint16_t) + strlen(name) + 1;
+	}
+	entry->hash = hash;
+	return entry;
+}
+
+static
+bool bytecode_link_cache_match(const struct bytecode_link_cache *a,
+		const struct bytecode_link_cache *b)
+{
+	unsigned int i;
+
+	if (a->hash != b->hash || a->bc != b->bc || a->ctx != b->ctx
+			|| a->probe_desc != b->probe_desc)
+		return false;
+	for (i = 0; i < a->nr_refs; i++) {
+		const struct bytecode_field_ref *ra = &a->refs[i], *rb = &b->refs[i];
+
+		if (ra->offset != rb->offset || ra->filter_idx != rb->filter_idx)
+			return false;
+		if (!ra->field || !rb->field) {
+			if (ra->field != rb->field)
+				return false;
+			continue;
+		}
+		if (ra->field->user != rb->field->user
+				|| !bytecode_type_layout_equal(ra->field->type, rb->field->type))
+			return false;
+	}
+	return true;
+}
+
+static
+struct bytecode_link_cache *bytecode_link_cache_lookup(const struct bytecode_link_cache *key)
+{
+	struct hlist_head *head;
+	struct bytecode_link_cache *entry;
+
+	head = &bytecode_link_cache_table[key->hash & (BYTECODE_LINK_CACHE_HT_SIZE - 1)];
+	lttng_hlist_for_each_entry(entry, head, hlist) {
+		if (bytecode_link_cache_match(entry, key))
+			return entry;
+	}
+	return NULL;
+}
+
+/* Record the result of linking runtime in a new cache entry. */
+static
+void bytecode_link_cache_add(struct bytecode_link_cache *entry,
+		struct bytecode_runtime *runtime, int link_ret)
+{
+	struct hlist_head *head;
+
+	entry->link_ret = link_ret;
+	if (!link_ret) {
+		entry->code = kmemdup(runtime->code, runtime->len, GFP_KERNEL);
+		if (!entry->code) {
+			kfree(entry);
+			return;
+		}
+		entry->payload_fields = runtime->p.payload_fields;
+		entry->optimized = runtime->optimized;
+		entry->len = runtime->len;
+		entry->data = runtime->data;
+		entry->data_len = runtime->data_len;
+	} else {
+		/* Failed runtimes never run: no data to share. */
+		kfree(runtime->data);
+		runtime->data = NULL;
+		runtime->data_len = runtime->data_alloc_len = 0;
+	}
+	entry->refcount = 1;
+	runtime->link_cache = entry;
+	head = &bytecode_link_cache_table[entry->hash & (BYTECODE_LINK_CACHE_HT_SIZE - 1)];
+	hlist_add_head(&entry->hlist, head);
+}
+
+static
+void bytecode_link_cache_put(struct bytecode_link_cache *entry)
+{
+	if (--entry->refcount)
+		return;
+	hlist_del(&entry->hlist);
+	kfree(entry->code);
+	kfree(entry->data);
+	kfree(entry);
+}
+
 /*
  * Take a bytecode with reloc table and link it to an event to create a
  * bytecode runtime.
@@ -429,10 +718,12 @@ int link_bytecode(const struct lttng_kernel_event_desc *event_desc,
 		struct lttng_kernel_ctx *ctx,
 		struct lttng_kernel_bytecode_node *bytecode,
 		struct list_head *bytecode_runtime_head,
-		struct list_head *insert_loc)
+		struct list_head *insert_loc,
+		uint64_t *instance_payload_fields)
 {
 	int ret, offset, next_offset;
 	struct bytecode_runtime *runtime = NULL;
+	struct bytecode_link_cache *cache_key = NULL;
 	size_t runtime_alloc_len;
 
 	if (!bytecode)
@@ -454,8 +745,32 @@ int link_bytecode(const struct lttng_kernel_event_desc *event_desc,
 	runtime->p.bc = bytecode;
 	runtime->p.ctx = ctx;
 	runtime->len = bytecode->bc.reloc_offset;
+	runtime->content_hash = jhash(bytecode->bc.data, bytecode->bc.len, bytecode->type);
 	/* copy original bytecode */
 	memcpy(runtime->code, bytecode->bc.data, runtime->len);
+	/* Filters of wildcard enablers are linked with many events. */
+	if (bytecode->type == LTTNG_KERNEL_BYTECODE_TYPE_FILTER)
+		cache_key = bytecode_link_cache_alloc(event_desc, ctx, bytecode);
+	if (cache_key) {
+		struct bytecode_link_cache *entry = bytecode_link_cache_lookup(cache_key);
+
+		if (entry) {
+			kfree(cache_key);
+			cache_key = NULL;
+			entry->refcount++;
+			runtime->link_cache = entry;
+			ret = entry->link_ret;
+			if (ret)
+				goto link_error;
+			runtime->len = entry->len;
+			memcpy(runtime->code, entry->code, entry->len);
+			runtime->data = entry->data;
+			runtime->data_len = runtime->data_alloc_len = entry->data_len;
+			runtime->optimized = entry->optimized;
+			runtime->p.payload_fields = entry->payload_fields;
+			goto linked;
+		}
+	}
 	/*
 	 * apply relocs. Those are a uint16_t (offset in bytecode)
 	 * followed by a string (field name).
@@ -484,14 +799,38 @@ int link_bytecode(const struct lttng_kernel_event_desc *event_desc,
 	if (ret) {
 		goto link_error;
 	}
-	runtime->p.interpreter_func = lttng_bytecode_interpret;
+	/* Optimize bytecode, keeping it unchanged on failure. */
+	(void) lttng_bytecode_optimize(runtime);
+	if (cache_key)
+		bytecode_link_cache_add(cache_key, runtime, 0);
+linked:
+	/* Compile to native code when supported, else interpret. */
+	(void) lttng_bytecode_jit_compile(runtime);
+	bytecode_runtime_set_interpreter(runtime);
 	runtime->p.link_failed = 0;
+	/*
+	 * Let the probes lay out the fields read by this bytecode. Probes
+	 * which read the previous mask skip it, see
+	 * lttng_kernel_interpret_event_filter().
+	 */
+	if (instance_payload_fields)
+		WRITE_ONCE(*instance_payload_fields,
+			*instance_payload_fields | runtime->p.payload_fields);
 	list_add_rcu(&runtime->p.node, insert_loc);
 	dbg_printk("Linking successful.\n");
 	return 0;
 
 link_error:
-
+	if (cache_key) {
+		/*
+		 * Only cache failures which depend on the bytecode and
+		 * layout alone: -ENOMEM and friends may succeed next time.
+		 */
+		if (ret == -EINVAL || ret == -ERANGE)
+			bytecode_link_cache_add(cache_key, runtime, ret);
+		else
+			kfree(cache_key);
+	}
 	runtime->p.interpreter_func = lttng_bytecode_interpret_error;
 	runtime->p.link_failed = 1;
 	list_add_rcu(&runtime->p.node, insert_loc);
@@ -507,7 +846,184 @@ void lttng_bytecode_sync_state(struct lttng_kernel_bytecode_runtime *runtime)
 	if (!bc->enabler->enabled || runtime->link_failed)
 		runtime->interpreter_func = lttng_bytecode_interpret_error;
 	else
-		runtime->interpreter_func = lttng_bytecode_interpret;
+		bytecode_runtime_set_interpreter(container_of(runtime,
+				struct bytecode_runtime, p));
+}
+
+static
+bool bytecode_runtime_is_active(struct lttng_kernel_bytecode_runtime *runtime)
+{
+	return runtime->interpreter_func != lttng_bytecode_interpret_error;
+}
+
+/* Both runtimes are linked to the same event: compare the bytecode. */
+static
+bool bytecode_runtime_equal(struct lttng_kernel_bytecode_runtime *a,
+		struct lttng_kernel_bytecode_runtime *b)
+{
+	struct bytecode_runtime *runtime_a = container_of(a, struct bytecode_runtime, p);
+	struct bytecode_runtime *runtime_b = container_of(b, struct bytecode_runtime, p);
+
+	return runtime_a->content_hash == runtime_b->content_hash
+		&& a->type == b->type
+		&& a->ctx == b->ctx
+		&& a->bc->bc.len == b->bc->bc.len
+		&& a->bc->bc.reloc_offset == b->bc->bc.reloc_offset
+		&& !memcmp(a->bc->bc.data, b->bc->bc.data, a->bc->bc.len);
+}
+
+/*
+ * Return the comparison of an optimized filter which only compares an
+ * integer payload field with a constant, NULL otherwise.
+ */
+static
+const struct cmp_field_imm_op *bytecode_runtime_field_eq(struct lttng_kernel_bytecode_runtime *p)
+{
+	struct bytecode_runtime *runtime = container_of(p, struct bytecode_runtime, p);
+	const struct cmp_field_imm_op *insn = (const struct cmp_field_imm_op *) runtime->code;
+
+	if (p->type != LTTNG_KERNEL_BYTECODE_TYPE_FILTER || !runtime->optimized)
+		return NULL;
+	if (runtime->len != sizeof(struct cmp_field_imm_op) + sizeof(struct return_op))
+		return NULL;
+	if (insn->op != BYTECODE_OP_CMP_FIELD_IMM_S64 || insn->cmp_op != BYTECODE_OP_EQ_S64)
+		return NULL;
+	if (runtime->code[sizeof(*insn)] != BYTECODE_OP_RETURN_S64)
+		return NULL;
+	return insn;
+}
+
+static
+void filter_set_add(struct lttng_kernel_filter_set *set, int64_t v)
+{
+	unsigned int mask = (1U << set->bits) - 1, i;
+
+	if (!v) {
+		set->accept_zero = true;
+		return;
+	}
+	for (i = hash_64((u64) v, set->bits); set->values[i]; i = (i + 1) & mask) {
+		if (set->values[i] == v)
+			return;
+	}
+	set->values[i] = v;
+}
+
+/*
+ * Merge the enabled filters of an event into a set of accepted values if
+ * they all compare the same field with a constant. Returns NULL if they
+ * cannot be merged, or if there is nothing to gain.
+ */
+static
+struct lttng_kernel_filter_set *filter_set_create(struct list_head *runtime_head)
+{
+	struct lttng_kernel_bytecode_runtime *runtime;
+	const struct cmp_field_imm_op *insn, *first = NULL;
+	struct lttng_kernel_filter_set *set;
+	uint64_t payload_fields = 0;
+	unsigned int nr_values = 0, bits;
+
+	list_for_each_entry(runtime, runtime_head, node) {
+		if (!bytecode_runtime_is_active(runtime) || runtime->duplicate)
+			continue;
+		insn = bytecode_runtime_field_eq(runtime);
+		if (!insn)
+			return NULL;
+		if (first && (insn->load_op != first->load_op
+				|| insn->offset != first->offset))
+			return NULL;
+		if (!first)
+			first = insn;
+		payload_fields |= runtime->payload_fields;
+		nr_values++;
+	}
+	if (nr_values < 2)
+		return NULL;
+
+	/* At most half full. */
+	bits = ilog2(roundup_pow_of_two(2 * nr_values));
+	set = kzalloc(sizeof(*set) + (sizeof(set->values[0]) << bits), GFP_KERNEL);
+	if (!set)
+		return NULL;
+	set->load_op = first->load_op;
+	set->offset = first->offset;
+	set->payload_fields = payload_fields;
+	set->bits = bits;
+	list_for_each_entry(runtime, runtime_head, node) {
+		if (!bytecode_runtime_is_active(runtime) || runtime->duplicate)
+			continue;
+		filter_set_add(set, bytecode_runtime_field_eq(runtime)->v);
+	}
+	return set;
+}
+
+static
+bool filter_set_equal(const struct lttng_kernel_filter_set *a,
+		const struct lttng_kernel_filter_set *b)
+{
+	if (!a || !b)
+		return a == b;
+	return a->load_op == b->load_op
+		&& a->offset == b->offset
+		&& a->payload_fields == b->payload_fields
+		&& a->accept_zero == b->accept_zero
+		&& a->bits == b->bits
+		&& !memcmp(a->values, b->values, sizeof(a->values[0]) << a->bits);
+}
+
+/*
+ * Called after lttng_bytecode_sync_state() on each filter of an event,
+ * with the sessions mutex held. Filters identical to an enabled filter
+ * earlier in the list are skipped, and filters comparing the same field
+ * with constants are merged into a single set lookup. The set replaced,
+ * if any, is queued on release_list to be freed by
+ * lttng_bytecode_release_filter_sets().
+ */
+void lttng_bytecode_sync_filters(struct lttng_kernel_event_common_private *event_priv,
+		struct list_head *release_list)
+{
+	struct list_head *runtime_head = &event_priv->filter_bytecode_runtime_head;
+	struct lttng_kernel_bytecode_runtime *runtime, *prev;
+	struct lttng_kernel_filter_set *set, *old_set = event_priv->filter_set;
+
+	list_for_each_entry(runtime, runtime_head, node) {
+		int duplicate = 0;
+
+		if (bytecode_runtime_is_active(runtime)) {
+			list_for_each_entry(prev, runtime_head, node) {
+				if (prev == runtime)
+					break;
+				if (bytecode_runtime_is_active(prev) && !prev->duplicate
+						&& bytecode_runtime_equal(prev, runtime)) {
+					duplicate = 1;
+					break;
+				}
+			}
+		}
+		WRITE_ONCE(runtime->duplicate, duplicate);
+	}
+
+	set = filter_set_create(runtime_head);
+	if (filter_set_equal(set, old_set)) {
+		kfree(set);
+		return;
+	}
+	rcu_assign_pointer(event_priv->filter_set, set);
+	if (old_set)
+		list_add(&old_set->node, release_list);
+}
+
+/* Free the filter sets replaced by lttng_bytecode_sync_filters(). */
+void lttng_bytecode_release_filter_sets(struct list_head *release_list)
+{
+	struct lttng_kernel_filter_set *set, *tmp;
+
+	if (list_empty(release_list))
+		return;
+	synchronize_trace();	/* Wait for in-flight filter evaluations */
+	list_for_each_entry_safe(set, tmp, release_list, node)
+		kfree(set);
+	INIT_LIST_HEAD(release_list);
 }
 
 /*
@@ -521,7 +1037,8 @@ void lttng_bytecode_sync_state(struct lttng_kernel_bytecode_runtime *runtime)
 void lttng_enabler_link_bytecode(const struct lttng_kernel_event_desc *event_desc,
 		struct lttng_kernel_ctx *ctx,
 		struct list_head *instance_bytecode_head,
-		struct list_head *enabler_bytecode_head)
+		struct list_head *enabler_bytecode_head,
+		uint64_t *instance_payload_fields)
 {
 	struct lttng_kernel_bytecode_node *enabler_bc;
 	struct lttng_kernel_bytecode_runtime *runtime;
@@ -568,7 +1085,8 @@ void lttng_enabler_link_bytecode(const struct lttng_kernel_event_desc *event_des
 		insert_loc = instance_bytecode_head;
 	add_within:
 		dbg_printk("linking bytecode\n");
-		ret = link_bytecode(event_desc, ctx, enabler_bc, instance_bytecode_head, insert_loc);
+		ret = link_bytecode(event_desc, ctx, enabler_bc, instance_bytecode_head,
+				insert_loc, instance_payload_fields);
 		if (ret) {
 			dbg_printk("[lttng filter] warning: cannot link event bytecode\n");
 		}
@@ -601,7 +1119,13 @@ void lttng_free_event_filter_runtime(struct lttng_kernel_event_common *event)
 
 	list_for_each_entry_safe(runtime, tmp,
 			&event->priv->filter_bytecode_runtime_head, p.node) {
-		kfree(runtime->data);
+		lttng_bytecode_jit_free(runtime);
+		if (runtime->link_cache)
+			bytecode_link_cache_put(runtime->link_cache);
+		else
+			kfree(runtime->data);
 		kfree(runtime);
 	}
+	kfree(event->priv->filter_set);
+	event->priv->filter_set = NULL;
 }
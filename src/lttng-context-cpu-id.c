@@ -45,7 +45,7 @@ void cpu_id_get_value(void *priv,
 	value->u.s64 = smp_processor_id();
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_reserve_cpu_ctx_field(
 	lttng_kernel_static_event_field("cpu_id",
 		lttng_kernel_static_type_integer_from_type(int, __BYTE_ORDER, 10),
 		false, false, false),
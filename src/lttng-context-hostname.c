@@ -76,7 +76,7 @@ void hostname_get_value(void *priv,
 	value->u.str = hostname;
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_sticky_ctx_field(
 	lttng_kernel_static_event_field("hostname",
 		lttng_kernel_static_type_array_text(LTTNG_HOSTNAME_CTX_LEN),
 		false, false, false),
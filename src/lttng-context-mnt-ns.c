@@ -75,7 +75,7 @@ void mnt_ns_get_value(void *priv,
 	value->u.s64 = mnt_ns_inum;
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_sticky_ctx_field(
 	lttng_kernel_static_event_field("mnt_ns",
 		lttng_kernel_static_type_integer_from_type(unsigned int, __BYTE_ORDER, 10),
 		false, false, false),
@@ -45,7 +45,7 @@ void nice_get_value(void *priv,
 	value->u.s64 = task_nice(current);
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_sticky_ctx_field(
 	lttng_kernel_static_event_field("nice",
 		lttng_kernel_static_type_integer_from_type(int, __BYTE_ORDER, 10),
 		false, false, false),
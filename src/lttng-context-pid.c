@@ -45,7 +45,7 @@ void pid_get_value(void *priv,
 	value->u.s64 = task_tgid_nr(current);
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_sticky_ctx_field(
 	lttng_kernel_static_event_field("pid",
 		lttng_kernel_static_type_integer_from_type(pid_t, __BYTE_ORDER, 10),
 		false, false, false),
@@ -48,7 +48,7 @@ void procname_get_value(void *priv,
 	value->u.str = current->comm;
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_sticky_ctx_field(
 	lttng_kernel_static_event_field("procname",
 		lttng_kernel_static_type_array_text(sizeof(current->comm)),
 		false, false, false),
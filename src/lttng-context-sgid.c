@@ -47,7 +47,7 @@ void sgid_get_value(void *priv,
 	value->u.s64 = lttng_current_sgid();
 }
 
-static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_ctx_field(
+static const struct lttng_kernel_ctx_field *ctx_field = lttng_kernel_static_sticky_ctx_field(
 	lttng_kernel_static_event_field("sgid",
 		lttng_kernel_static_type_integer_from_type(gid_t, __BYTE_ORDER, 10),
 		false, false, false),
@@ -15,6 +15,7 @@
 #include <lttng/events.h>
 #include <lttng/events-internal.h>
 #include <lttng/tracer.h>
+#include <ringbuffer/config.h>
 
 /*
  * The filter implementation requires that two consecutive "get" for the
@@ -150,23 +151,133 @@ static size_t get_type_max_align(const struct lttng_kernel_type_common *type)
 	}
 }
 
+/*
+ * Returns the size of a type in bytes if it is known without looking at
+ * the field content, 0 otherwise. Only integers, enumerations and arrays
+ * of integers are considered fixed size.
+ */
+static size_t get_type_fixed_size(const struct lttng_kernel_type_common *type)
+{
+	switch (type->type) {
+	case lttng_kernel_type_integer:
+	{
+		const struct lttng_kernel_type_integer *integer_type = lttng_kernel_get_type_integer(type);
+
+		if (integer_type->size % CHAR_BIT)
+			return 0;
+		return integer_type->size / CHAR_BIT;
+	}
+	case lttng_kernel_type_enum:
+		return get_type_fixed_size(lttng_kernel_get_type_enum(type)->container_type);
+	case lttng_kernel_type_array:
+	{
+		const struct lttng_kernel_type_array *array_type = lttng_kernel_get_type_array(type);
+
+		if (array_type->elem_type->type != lttng_kernel_type_integer)
+			return 0;
+		return array_type->length * get_type_fixed_size(array_type->elem_type);
+	}
+	default:
+		return 0;
+	}
+}
+
+/*
+ * A field can be gathered when its value is a native byte order integer
+ * or a text array obtained through get_value.
+ */
+static bool ctx_field_can_gather(const struct lttng_kernel_ctx_field *field)
+{
+	const struct lttng_kernel_type_common *type = field->event_field->type;
+	const struct lttng_kernel_type_integer *integer_type;
+
+	if (!field->get_value)
+		return false;
+	if (type->type == lttng_kernel_type_array)
+		return lttng_kernel_get_type_array(type)->encoding != lttng_kernel_string_encoding_none
+			&& field->fixed_size;
+	if (type->type == lttng_kernel_type_enum)
+		type = lttng_kernel_get_type_enum(type)->container_type;
+	if (type->type != lttng_kernel_type_integer)
+		return false;
+	integer_type = lttng_kernel_get_type_integer(type);
+	if (integer_type->reverse_byte_order)
+		return false;
+	switch (integer_type->size) {
+	case 8:
+	case 16:
+	case 32:
+	case 64:
+		return true;
+	default:
+		return false;
+	}
+}
+
 /*
  * lttng_context_update() should be called at least once between context
  * modification and trace start.
+ *
+ * Besides the largest alignment, it precomputes the size and alignment
+ * of each fixed size field, so the client can skip the get_size
+ * callbacks, and the total context length when all fields are fixed
+ * size. Offsets are relative to a start aligned on largest_align, which
+ * is how the client lays out the context.
+ *
+ * It also selects the sticky group used in sticky context mode: the
+ * sticky fields which can be gathered, as long as they fit in
+ * LTTNG_KERNEL_CTX_GATHER_MAX bytes.
  */
 static
 void lttng_context_update(struct lttng_kernel_ctx *ctx)
 {
 	int i;
 	size_t largest_align = 8;	/* in bits */
+	size_t offset = 0, sticky_offset = 0, sticky_align = 1;
+	unsigned int nr_sticky = 0;
+	bool all_fixed = true, gather = true;
 
 	for (i = 0; i < ctx->nr_fields; i++) {
-		size_t field_align = 8;
+		struct lttng_kernel_ctx_field *field = &ctx->fields[i];
+		size_t field_align = 8, sticky_end;
 
-		field_align = get_type_max_align(ctx->fields[i].event_field->type);
+		field_align = get_type_max_align(field->event_field->type);
 		largest_align = max_t(size_t, largest_align, field_align);
+
+		field->fixed_size = get_type_fixed_size(field->event_field->type);
+		field->fixed_align = max_t(size_t, field_align >> 3, 1);
+		field->sticky_group = 0;
+		if (!field->fixed_size) {
+			all_fixed = false;
+			gather = false;
+			continue;
+		}
+		offset += lib_ring_buffer_align(offset, field->fixed_align);
+		offset += field->fixed_size;
+		if (!ctx_field_can_gather(field)) {
+			gather = false;
+			continue;
+		}
+		if (!field->sticky)
+			continue;
+		sticky_end = sticky_offset;
+		sticky_end += lib_ring_buffer_align(sticky_end, field->fixed_align);
+		sticky_end += field->fixed_size;
+		if (sticky_end > LTTNG_KERNEL_CTX_GATHER_MAX)
+			continue;
+		field->sticky_group = 1;
+		sticky_offset = sticky_end;
+		sticky_align = max_t(size_t, sticky_align, field->fixed_align);
+		nr_sticky++;
 	}
 	ctx->largest_align = largest_align >> 3;	/* bits to bytes */
+	ctx->all_fixed = all_fixed;
+	ctx->fixed_len = all_fixed ? offset : 0;
+	ctx->gather = gather && ctx->nr_fields
+			&& offset <= LTTNG_KERNEL_CTX_GATHER_MAX;
+	ctx->nr_sticky = nr_sticky;
+	ctx->sticky_len = sticky_offset;
+	ctx->sticky_align = sticky_align;
 }
 
 int lttng_kernel_context_append(struct lttng_kernel_ctx **ctx_p,
@@ -28,6 +28,7 @@
 #include <linux/vmalloc.h>
 #include <linux/dmi.h>
 
+#include <wrapper/barrier.h>
 #include <wrapper/compiler_attributes.h>
 #include <wrapper/uuid.h>
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_mappings() */
@@ -71,6 +72,9 @@ static void lttng_event_notifier_enabler_destroy(struct lttng_event_notifier_ena
 static void lttng_event_notifier_group_sync_enablers(struct lttng_event_notifier_group *event_notifier_group);
 
 static void _lttng_event_destroy(struct lttng_kernel_event_common *event);
+static int lttng_event_recorder_sampling_init(struct lttng_kernel_event_recorder *event_recorder);
+static void lttng_event_recorder_projection_init(struct lttng_kernel_event_recorder *event_recorder);
+static void lttng_event_recorder_sampling_destroy(struct lttng_kernel_event_recorder *event_recorder);
 static void _lttng_channel_destroy(struct lttng_kernel_channel_buffer *chan);
 static int _lttng_event_unregister(struct lttng_kernel_event_recorder *event);
 static int _lttng_event_notifier_unregister(struct lttng_kernel_event_notifier *event_notifier);
@@ -79,8 +83,16 @@ int _lttng_event_metadata_statedump(struct lttng_kernel_session *session,
 				  struct lttng_kernel_channel_buffer *chan,
 				  struct lttng_kernel_event_recorder *event);
 static
+int _lttng_event_declaration_statedump(struct lttng_kernel_session *session,
+				  struct lttng_kernel_event_recorder *event_recorder,
+				  unsigned int id);
+static
 int _lttng_session_metadata_statedump(struct lttng_kernel_session *session);
 static
+void lttng_metadata_begin(struct lttng_kernel_session *session);
+static
+void lttng_metadata_end(struct lttng_kernel_session *session);
+static
 void _lttng_metadata_channel_hangup(struct lttng_metadata_stream *stream);
 static
 int _lttng_type_statedump(struct lttng_kernel_session *session,
@@ -185,6 +197,10 @@ struct lttng_kernel_session *lttng_session_create(void)
 	INIT_LIST_HEAD(&session_priv->enablers_head);
 	for (i = 0; i < LTTNG_EVENT_HT_SIZE; i++)
 		INIT_HLIST_HEAD(&session_priv->events_ht.table[i]);
+	session->tracker_gen = 1;
+	session->tracker_cache = alloc_percpu(struct lttng_tracker_cache);
+	if (!session->tracker_cache)
+		goto err_free_cache_data;
 	list_add(&session_priv->list, &sessions);
 
 	if (lttng_id_tracker_init(&session->pid_tracker, session, TRACKER_PID))
@@ -211,6 +227,9 @@ tracker_alloc_error:
 	lttng_id_tracker_fini(&session->vuid_tracker);
 	lttng_id_tracker_fini(&session->gid_tracker);
 	lttng_id_tracker_fini(&session->vgid_tracker);
+	free_percpu(session->tracker_cache);
+err_free_cache_data:
+	vfree(metadata_cache->data);
 err_free_cache:
 	kfree(metadata_cache);
 err_free_session_private:
@@ -315,7 +334,7 @@ struct lttng_event_notifier_group *lttng_event_notifier_group_create(void)
 	event_notifier_group->chan = transport->ops.priv->channel_create(
 			transport_name, event_notifier_group, NULL,
 			subbuf_size, num_subbuf, switch_timer_interval,
-			read_timer_interval);
+			read_timer_interval, NULL);
 	if (!event_notifier_group->chan)
 		goto create_error;
 
@@ -358,6 +377,14 @@ void lttng_session_destroy(struct lttng_kernel_session *session)
 	struct lttng_event_enabler *event_enabler, *tmp_event_enabler;
 	int ret;
 
+	/*
+	 * The remapping work takes the sessions mutex. No channel can be
+	 * added to a session being destroyed.
+	 */
+	list_for_each_entry(chan_priv, &session->priv->chan, node) {
+		if (chan_priv->id_remap)
+			cancel_delayed_work_sync(&chan_priv->id_remap->work);
+	}
 	mutex_lock(&sessions_mutex);
 	WRITE_ONCE(session->active, 0);
 	list_for_each_entry(chan_priv, &session->priv->chan, node) {
@@ -392,6 +419,7 @@ void lttng_session_destroy(struct lttng_kernel_session *session)
 	lttng_id_tracker_fini(&session->vuid_tracker);
 	lttng_id_tracker_fini(&session->gid_tracker);
 	lttng_id_tracker_fini(&session->vgid_tracker);
+	free_percpu(session->tracker_cache);
 	kref_put(&session->priv->metadata_cache->refcount, metadata_cache_destroy);
 	list_del(&session->priv->list);
 	mutex_unlock(&sessions_mutex);
@@ -486,7 +514,7 @@ int lttng_session_enable(struct lttng_kernel_session *session)
 	list_for_each_entry(chan_priv, &session->priv->chan, node) {
 		if (chan_priv->header_type)
 			continue;			/* don't change it if session stop/restart */
-		if (chan_priv->free_event_id < 31)
+		if (chan_priv->free_event_id < 31 || chan_priv->id_remap)
 			chan_priv->header_type = 1;	/* compact */
 		else
 			chan_priv->header_type = 2;	/* large */
@@ -506,8 +534,15 @@ int lttng_session_enable(struct lttng_kernel_session *session)
 		goto end;
 	}
 	ret = lttng_statedump_start(session);
-	if (ret)
+	if (ret) {
 		WRITE_ONCE(session->active, 0);
+		goto end;
+	}
+	list_for_each_entry(chan_priv, &session->priv->chan, node) {
+		if (chan_priv->id_remap)
+			schedule_delayed_work(&chan_priv->id_remap->work,
+				msecs_to_jiffies(LTTNG_EVENT_ID_REMAP_PERIOD_MS));
+	}
 end:
 	mutex_unlock(&sessions_mutex);
 	return ret;
@@ -753,12 +788,142 @@ end:
 	return ret;
 }
 
+/*
+ * Give compact ID aliases to the most frequent events of the channel since
+ * the last sampling, as long as compact IDs remain. The aliases are declared
+ * in a single metadata transaction before being published to writers.
+ */
+static
+void lttng_event_id_remap_work(struct work_struct *work)
+{
+	struct lttng_event_id_remap *remap =
+		container_of(work, struct lttng_event_id_remap, work.work);
+	struct lttng_kernel_channel_buffer *chan = remap->chan;
+	struct lttng_kernel_session *session = chan->parent.session;
+	struct lttng_kernel_event_recorder_private *top[LTTNG_EVENT_ID_REMAP_NR_COMPACT];
+	unsigned long top_hits[LTTNG_EVENT_ID_REMAP_NR_COMPACT];
+	struct lttng_kernel_event_recorder_private *event_recorder_priv;
+	unsigned int i, nr_top = 0, nr_free;
+	int ret = 0;
+
+	mutex_lock(&sessions_mutex);
+	/* Rescheduled by lttng_session_enable(). */
+	if (!LTTNG_READ_ONCE(session->active))
+		goto end;
+	nr_free = LTTNG_EVENT_ID_REMAP_NR_COMPACT - remap->nr_compact;
+	if (!nr_free)
+		goto end;
+
+	/* Keep the nr_free most frequent events, by decreasing hit count. */
+	list_for_each_entry(event_recorder_priv, &session->priv->events, node) {
+		unsigned long hits = 0, delta;
+		int cpu;
+
+		if (event_recorder_priv->pub->chan != chan
+				|| event_recorder_priv->compact_gen
+				|| !event_recorder_priv->metadata_dumped)
+			continue;
+		for_each_possible_cpu(cpu)
+			hits += *per_cpu_ptr(event_recorder_priv->hits, cpu);
+		delta = hits - event_recorder_priv->hits_sampled;
+		event_recorder_priv->hits_sampled = hits;
+		if (delta < LTTNG_EVENT_ID_REMAP_MIN_HITS)
+			continue;
+		if (nr_top < nr_free)
+			i = nr_top++;
+		else if (top_hits[nr_top - 1] < delta)
+			i = nr_top - 1;
+		else
+			continue;
+		for (; i > 0 && top_hits[i - 1] < delta; i--) {
+			top[i] = top[i - 1];
+			top_hits[i] = top_hits[i - 1];
+		}
+		top[i] = event_recorder_priv;
+		top_hits[i] = delta;
+	}
+	if (!nr_top)
+		goto resched;
+
+	lttng_metadata_begin(session);
+	for (i = 0; i < nr_top; i++) {
+		ret = _lttng_event_declaration_statedump(session, top[i]->pub,
+				remap->nr_compact + i);
+		if (ret)
+			break;
+	}
+	lttng_metadata_end(session);
+	if (ret)
+		goto end;
+
+	/*
+	 * Writers use an alias from the first packet begun once the channel
+	 * generation reaches the alias generation.
+	 */
+	for (i = 0; i < nr_top; i++) {
+		top[i]->compact_id = remap->nr_compact++;
+		lttng_smp_store_release(&top[i]->compact_gen, remap->gen + 1);
+	}
+	WRITE_ONCE(remap->gen, remap->gen + 1);
+resched:
+	if (remap->nr_compact < LTTNG_EVENT_ID_REMAP_NR_COMPACT)
+		schedule_delayed_work(&remap->work,
+			msecs_to_jiffies(LTTNG_EVENT_ID_REMAP_PERIOD_MS));
+end:
+	mutex_unlock(&sessions_mutex);
+}
+
+static
+struct lttng_event_id_remap *lttng_event_id_remap_create(struct lttng_kernel_channel_buffer *chan)
+{
+	struct lttng_event_id_remap *remap;
+
+	remap = kzalloc(sizeof(*remap), GFP_KERNEL);
+	if (!remap)
+		return NULL;
+	remap->packet_gen = alloc_percpu(unsigned int);
+	if (!remap->packet_gen) {
+		kfree(remap);
+		return NULL;
+	}
+	remap->chan = chan;
+	INIT_DELAYED_WORK(&remap->work, lttng_event_id_remap_work);
+	return remap;
+}
+
+static
+void lttng_event_id_remap_destroy(struct lttng_event_id_remap *remap)
+{
+	if (!remap)
+		return;
+	free_percpu(remap->packet_gen);
+	kfree(remap);
+}
+
+/*
+ * Events of channels remapping their IDs count their hits.
+ */
+static
+int lttng_event_id_remap_init_event(struct lttng_kernel_event_recorder *event_recorder)
+{
+	if (!event_recorder->chan->priv->id_remap)
+		return 0;
+	event_recorder->priv->hits = alloc_percpu(unsigned long);
+	if (!event_recorder->priv->hits)
+		return -ENOMEM;
+	return 0;
+}
+
 struct lttng_kernel_channel_buffer *lttng_channel_create(struct lttng_kernel_session *session,
 				       const char *transport_name,
 				       void *buf_addr,
 				       size_t subbuf_size, size_t num_subbuf,
 				       unsigned int switch_timer_interval,
 				       unsigned int read_timer_interval,
+				       const struct lttng_kernel_ring_buffer_channel_attr *attr,
+				       unsigned int event_id_remap,
+				       int header_type,
+				       unsigned int sticky_ctx,
 				       enum channel_type channel_type)
 {
 	struct lttng_kernel_channel_buffer *chan;
@@ -789,7 +954,21 @@ struct lttng_kernel_channel_buffer *lttng_channel_create(struct lttng_kernel_ses
 	chan->parent.type = LTTNG_KERNEL_CHANNEL_TYPE_BUFFER;
 	chan->parent.session = session;
 	chan->priv->id = session->priv->free_chan_id++;
+	chan->priv->header_type = header_type;	/* 0: chosen at session start */
 	chan->ops = &transport->ops;
+	if (event_id_remap) {
+		/* Buffer creation already begins packets. */
+		chan_priv->id_remap = lttng_event_id_remap_create(chan);
+		if (!chan_priv->id_remap)
+			goto remap_error;
+		/* Compact IDs are only handed out by remapping. */
+		chan_priv->free_event_id = LTTNG_EVENT_ID_REMAP_NR_COMPACT;
+	}
+	if (sticky_ctx) {
+		chan_priv->sticky_ctx = alloc_percpu(struct lttng_sticky_ctx_state);
+		if (!chan_priv->sticky_ctx)
+			goto sticky_error;
+	}
 	/*
 	 * Note: the channel creation op already writes into the packet
 	 * headers. Therefore the "chan" information used as input
@@ -797,7 +976,7 @@ struct lttng_kernel_channel_buffer *lttng_channel_create(struct lttng_kernel_ses
 	 */
 	chan->priv->rb_chan = transport->ops.priv->channel_create(transport_name,
 			chan, buf_addr, subbuf_size, num_subbuf,
-			switch_timer_interval, read_timer_interval);
+			switch_timer_interval, read_timer_interval, attr);
 	if (!chan->priv->rb_chan)
 		goto create_error;
 	chan->priv->parent.tstate = 1;
@@ -809,6 +988,10 @@ struct lttng_kernel_channel_buffer *lttng_channel_create(struct lttng_kernel_ses
 	return chan;
 
 create_error:
+	free_percpu(chan_priv->sticky_ctx);
+sticky_error:
+	lttng_event_id_remap_destroy(chan_priv->id_remap);
+remap_error:
 	kfree(chan_priv);
 nomem_priv:
 	kfree(chan);
@@ -833,6 +1016,8 @@ void _lttng_channel_destroy(struct lttng_kernel_channel_buffer *chan)
 	module_put(chan->priv->transport->owner);
 	list_del(&chan->priv->node);
 	lttng_kernel_destroy_context(chan->priv->ctx);
+	lttng_event_id_remap_destroy(chan->priv->id_remap);
+	free_percpu(chan->priv->sticky_ctx);
 	kfree(chan->priv);
 	kfree(chan);
 }
@@ -936,6 +1121,9 @@ struct lttng_kernel_event_recorder *_lttng_kernel_event_recorder_create(struct l
 	event_recorder->priv->parent.instrumentation = itype;
 	INIT_LIST_HEAD(&event_recorder->priv->parent.filter_bytecode_runtime_head);
 	INIT_LIST_HEAD(&event_recorder->priv->parent.enablers_ref_head);
+	ret = lttng_event_id_remap_init_event(event_recorder);
+	if (ret)
+		goto register_error;
 
 	switch (itype) {
 	case LTTNG_KERNEL_ABI_TRACEPOINT:
@@ -1014,6 +1202,12 @@ struct lttng_kernel_event_recorder *_lttng_kernel_event_recorder_create(struct l
 		event_recorder_return->priv->parent.registered = 1;
 		INIT_LIST_HEAD(&event_recorder_return->priv->parent.filter_bytecode_runtime_head);
 		INIT_LIST_HEAD(&event_recorder_return->priv->parent.enablers_ref_head);
+		ret = lttng_event_id_remap_init_event(event_recorder_return);
+		if (ret) {
+			kmem_cache_free(event_recorder_private_cache, event_recorder_return_priv);
+			kmem_cache_free(event_recorder_cache, event_recorder_return);
+			goto register_error;
+		}
 		/*
 		 * Populate lttng_event structure before kretprobe registration.
 		 */
@@ -1024,6 +1218,7 @@ struct lttng_kernel_event_recorder *_lttng_kernel_event_recorder_create(struct l
 				event_param->u.kretprobe.addr,
 				event_recorder, event_recorder_return);
 		if (ret) {
+			free_percpu(event_recorder_return_priv->hits);
 			kmem_cache_free(event_recorder_private_cache, event_recorder_return_priv);
 			kmem_cache_free(event_recorder_cache, event_recorder_return);
 			ret = -EINVAL;
@@ -1038,6 +1233,7 @@ struct lttng_kernel_event_recorder *_lttng_kernel_event_recorder_create(struct l
 						    event_recorder_return);
 		WARN_ON_ONCE(ret > 0);
 		if (ret) {
+			free_percpu(event_recorder_return_priv->hits);
 			kmem_cache_free(event_recorder_private_cache, event_recorder_return_priv);
 			kmem_cache_free(event_recorder_cache, event_recorder_return);
 			module_put(event_recorder_return->priv->parent.desc->owner);
@@ -1116,6 +1312,19 @@ struct lttng_kernel_event_recorder *_lttng_kernel_event_recorder_create(struct l
 		ret = -EINVAL;
 		goto register_error;
 	}
+	switch (itype) {
+	case LTTNG_KERNEL_ABI_TRACEPOINT:
+		lttng_fallthrough;
+	case LTTNG_KERNEL_ABI_SYSCALL:
+		/* Sampling and projection are applied by the generated probes only. */
+		ret = lttng_event_recorder_sampling_init(event_recorder);
+		if (ret)
+			goto register_error;
+		lttng_event_recorder_projection_init(event_recorder);
+		break;
+	default:
+		break;
+	}
 	ret = _lttng_event_metadata_statedump(chan->parent.session, chan, event_recorder);
 	WARN_ON_ONCE(ret > 0);
 	if (ret) {
@@ -1127,7 +1336,9 @@ struct lttng_kernel_event_recorder *_lttng_kernel_event_recorder_create(struct l
 
 statedump_error:
 	/* If a statedump error occurs, events will not be readable. */
+	lttng_event_recorder_sampling_destroy(event_recorder);
 register_error:
+	free_percpu(event_recorder_priv->hits);
 	kmem_cache_free(event_recorder_private_cache, event_recorder_priv);
 cache_private_error:
 	kmem_cache_free(event_recorder_cache, event_recorder);
@@ -1425,6 +1636,54 @@ struct lttng_kernel_event_notifier *lttng_event_notifier_create(
 	return event_notifier;
 }
 
+/*
+ * Let the recorders attached to the tracepoint of @desc share their
+ * payload when there are several of them. Called under sessions lock
+ * after a recorder registration or unregistration.
+ */
+static
+void lttng_event_recorder_fanout_update(const struct lttng_kernel_event_desc *desc)
+{
+	struct lttng_kernel_session_private *session_priv;
+	struct lttng_kernel_event_recorder_private *event_recorder_priv;
+	unsigned int nr_recorders = 0;
+	struct hlist_head *head;
+
+	list_for_each_entry(session_priv, &sessions, list) {
+		head = utils_borrow_hash_table_bucket(session_priv->events_ht.table,
+			LTTNG_EVENT_HT_SIZE, desc->event_name);
+		lttng_hlist_for_each_entry(event_recorder_priv, head, hlist) {
+			struct lttng_kernel_event_common_private *event_priv = &event_recorder_priv->parent;
+
+			if (event_priv->desc == desc && event_priv->registered
+					&& event_priv->instrumentation == LTTNG_KERNEL_ABI_TRACEPOINT
+					&& !event_recorder_priv->pub->skip_fields)
+				nr_recorders++;
+		}
+	}
+	list_for_each_entry(session_priv, &sessions, list) {
+		head = utils_borrow_hash_table_bucket(session_priv->events_ht.table,
+			LTTNG_EVENT_HT_SIZE, desc->event_name);
+		lttng_hlist_for_each_entry(event_recorder_priv, head, hlist) {
+			struct lttng_kernel_event_common_private *event_priv = &event_recorder_priv->parent;
+			const void *key = NULL;
+
+			if (event_priv->desc != desc
+					|| event_priv->instrumentation != LTTNG_KERNEL_ABI_TRACEPOINT)
+				continue;
+			/* Recorders of a subset of the fields serialize their own payload. */
+			if (event_priv->registered && nr_recorders > 1
+					&& nr_recorders <= LTTNG_FANOUT_MAX_RECORDERS
+					&& !event_recorder_priv->pub->skip_fields)
+				key = desc;
+			WRITE_ONCE(event_recorder_priv->pub->fanout_key, key);
+		}
+	}
+	/* Publish the keys before the generation, see lttng_fanout_enter(). */
+	smp_wmb();
+	WRITE_ONCE(lttng_fanout_gen, lttng_fanout_gen + 1);
+}
+
 /* Only used for tracepoints for now. */
 static
 void register_event(struct lttng_kernel_event_recorder *event_recorder)
@@ -1441,6 +1700,10 @@ void register_event(struct lttng_kernel_event_recorder *event_recorder)
 		ret = lttng_wrapper_tracepoint_probe_register(desc->event_kname,
 						  desc->tp_class->probe_callback,
 						  event_recorder);
+		if (!ret) {
+			event_recorder->priv->parent.registered = 1;
+			lttng_event_recorder_fanout_update(desc);
+		}
 		break;
 
 	case LTTNG_KERNEL_ABI_SYSCALL:
@@ -1484,6 +1747,10 @@ int _lttng_event_unregister(struct lttng_kernel_event_recorder *event_recorder)
 		ret = lttng_wrapper_tracepoint_probe_unregister(event_priv->desc->event_kname,
 						  event_priv->desc->tp_class->probe_callback,
 						  event_recorder);
+		if (!ret) {
+			event_priv->registered = 0;
+			lttng_event_recorder_fanout_update(desc);
+		}
 		break;
 
 	case LTTNG_KERNEL_ABI_KPROBE:
@@ -1658,6 +1925,8 @@ void _lttng_event_destroy(struct lttng_kernel_event_common *event)
 			WARN_ON_ONCE(1);
 		}
 		list_del(&event_recorder->priv->node);
+		lttng_event_recorder_sampling_destroy(event_recorder);
+		free_percpu(event_recorder->priv->hits);
 		kmem_cache_free(event_recorder_private_cache, event_recorder->priv);
 		kmem_cache_free(event_recorder_cache, event_recorder);
 		break;
@@ -1726,6 +1995,22 @@ struct lttng_kernel_id_tracker *get_tracker(struct lttng_kernel_session *session
 	}
 }
 
+/*
+ * Invalidate the tracker verdicts cached for the session. Called under
+ * sessions lock after a tracker change.
+ */
+static
+void lttng_session_tracker_update(struct lttng_kernel_session *session)
+{
+	WRITE_ONCE(session->tracker_active,
+		session->pid_tracker.p || session->vpid_tracker.p
+		|| session->uid_tracker.p || session->vuid_tracker.p
+		|| session->gid_tracker.p || session->vgid_tracker.p);
+	/* Publish the trackers before the generation. */
+	smp_wmb();
+	WRITE_ONCE(session->tracker_gen, session->tracker_gen + 1);
+}
+
 int lttng_session_track_id(struct lttng_kernel_session *session,
 		enum tracker_type tracker_type, int id)
 {
@@ -1745,6 +2030,7 @@ int lttng_session_track_id(struct lttng_kernel_session *session,
 	} else {
 		ret = lttng_id_tracker_add(tracker, id);
 	}
+	lttng_session_tracker_update(session);
 	mutex_unlock(&sessions_mutex);
 	return ret;
 }
@@ -1767,6 +2053,7 @@ int lttng_session_untrack_id(struct lttng_kernel_session *session,
 	} else {
 		ret = lttng_id_tracker_del(tracker, id);
 	}
+	lttng_session_tracker_update(session);
 	mutex_unlock(&sessions_mutex);
 	return ret;
 }
@@ -2328,7 +2615,8 @@ int lttng_event_enabler_ref_events(struct lttng_event_enabler *event_enabler)
 		lttng_enabler_link_bytecode(event_recorder_priv->parent.desc,
 			lttng_static_ctx,
 			&event_recorder_priv->parent.filter_bytecode_runtime_head,
-			&lttng_event_enabler_as_enabler(event_enabler)->filter_bytecode_head);
+			&lttng_event_enabler_as_enabler(event_enabler)->filter_bytecode_head,
+			&event_recorder_priv->parent.pub->filter_payload_fields);
 	}
 	return 0;
 }
@@ -2416,12 +2704,13 @@ int lttng_event_notifier_enabler_ref_event_notifiers(
 		 */
 		lttng_enabler_link_bytecode(event_notifier_priv->parent.desc,
 			lttng_static_ctx, &event_notifier_priv->parent.filter_bytecode_runtime_head,
-			&lttng_event_notifier_enabler_as_enabler(event_notifier_enabler)->filter_bytecode_head);
+			&lttng_event_notifier_enabler_as_enabler(event_notifier_enabler)->filter_bytecode_head,
+			&event_notifier_priv->parent.pub->filter_payload_fields);
 
 		/* Link capture bytecodes if not linked yet. */
 		lttng_enabler_link_bytecode(event_notifier_priv->parent.desc,
 			lttng_static_ctx, &event_notifier_priv->capture_bytecode_runtime_head,
-			&event_notifier_enabler->capture_bytecode_head);
+			&event_notifier_enabler->capture_bytecode_head, NULL);
 
 		event_notifier_priv->num_captures = event_notifier_enabler->num_captures;
 	}
@@ -2578,6 +2867,262 @@ int lttng_event_add_callsite(struct lttng_kernel_event_common *event,
 	}
 }
 
+/*
+ * Whether events were created from @event_enabler. Called with sessions
+ * lock held.
+ */
+static
+bool lttng_event_enabler_has_events(struct lttng_event_enabler *event_enabler)
+{
+	struct lttng_kernel_session *session = event_enabler->chan->parent.session;
+	struct lttng_kernel_event_recorder_private *event_recorder_priv;
+
+	list_for_each_entry(event_recorder_priv, &session->priv->events, node) {
+		if (lttng_enabler_ref(&event_recorder_priv->parent.enablers_ref_head,
+				lttng_event_enabler_as_enabler(event_enabler)))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Set the sampling of the events created from an enabler. Analyses scale
+ * the counts back up from the parameters declared in the event metadata,
+ * so they cannot change once events were created.
+ */
+int lttng_event_enabler_set_sampling(struct lttng_event_enabler *event_enabler,
+		const struct lttng_kernel_abi_event_sampling *param)
+{
+	int ret = 0;
+
+	if (param->rate > NSEC_PER_SEC)
+		return -EINVAL;
+	mutex_lock(&sessions_mutex);
+	if (lttng_event_enabler_has_events(event_enabler)) {
+		ret = -EBUSY;
+		goto end;
+	}
+	event_enabler->sampling = *param;
+end:
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
+/*
+ * Sum the hits skipped by the events created from an enabler.
+ */
+void lttng_event_enabler_sampling_stats(struct lttng_event_enabler *event_enabler,
+		struct lttng_kernel_abi_event_sampling_stats *stats)
+{
+	struct lttng_kernel_session *session = event_enabler->chan->parent.session;
+	struct lttng_kernel_event_recorder_private *event_recorder_priv;
+	int cpu;
+
+	stats->skipped_period = 0;
+	stats->skipped_rate = 0;
+	mutex_lock(&sessions_mutex);
+	list_for_each_entry(event_recorder_priv, &session->priv->events, node) {
+		struct lttng_event_sampling *sampling = event_recorder_priv->pub->sampling;
+
+		if (!sampling || !lttng_enabler_ref(&event_recorder_priv->parent.enablers_ref_head,
+				lttng_event_enabler_as_enabler(event_enabler)))
+			continue;
+		for_each_possible_cpu(cpu) {
+			struct lttng_event_sampling_state *state =
+				per_cpu_ptr(sampling->state, cpu);
+
+			stats->skipped_period += READ_ONCE(state->skipped_period);
+			stats->skipped_rate += READ_ONCE(state->skipped_rate);
+		}
+	}
+	mutex_unlock(&sessions_mutex);
+}
+
+/*
+ * Set the payload fields recorded by the events created from an enabler.
+ * Like sampling, they cannot change once events were created.
+ */
+int lttng_event_enabler_set_fields(struct lttng_event_enabler *event_enabler,
+		struct lttng_kernel_abi_event_fields __user *ufields)
+{
+	char *names = NULL;
+	uint32_t len;
+	int ret;
+
+	ret = get_user(len, &ufields->len);
+	if (ret)
+		return ret;
+	if (len > LTTNG_KERNEL_ABI_EVENT_FIELDS_MAX_LEN)
+		return -EINVAL;
+	if (len) {
+		names = kmalloc(len, GFP_KERNEL);
+		if (!names)
+			return -ENOMEM;
+		if (copy_from_user(names, ufields->names, len)) {
+			ret = -EFAULT;
+			goto error;
+		}
+		if (names[len - 1] != '\0') {
+			ret = -EINVAL;
+			goto error;
+		}
+	}
+	mutex_lock(&sessions_mutex);
+	if (lttng_event_enabler_has_events(event_enabler)) {
+		mutex_unlock(&sessions_mutex);
+		ret = -EBUSY;
+		goto error;
+	}
+	kfree(event_enabler->fields);
+	event_enabler->fields = names;
+	event_enabler->fields_len = len;
+	mutex_unlock(&sessions_mutex);
+	return 0;
+
+error:
+	kfree(names);
+	return ret;
+}
+
+static
+bool lttng_event_enabler_has_field(struct lttng_event_enabler *event_enabler,
+		const char *name)
+{
+	const char *p = event_enabler->fields;
+
+	while (p < event_enabler->fields + event_enabler->fields_len) {
+		if (!strcmp(p, name))
+			return true;
+		p += strlen(p) + 1;
+	}
+	return false;
+}
+
+/*
+ * Set the fields recorded by a new event recorder, before its metadata is
+ * dumped: the union of the fields recorded by the enablers matching it.
+ * A sequence is recorded with its length field, and the fields a sequence
+ * or a variant take as length or tag are recorded with them. Called with
+ * sessions lock held.
+ */
+static
+void lttng_event_recorder_projection_init(struct lttng_kernel_event_recorder *event_recorder)
+{
+	struct lttng_kernel_session *session = event_recorder->chan->parent.session;
+	const struct lttng_kernel_tracepoint_class *tp_class =
+		event_recorder->priv->parent.desc->tp_class;
+	struct lttng_event_enabler *event_enabler;
+	uint64_t recorded = 0;
+	bool matched = false;
+	int i;
+
+	list_for_each_entry(event_enabler, &session->priv->enablers_head, node) {
+		if (!lttng_event_enabler_match_event(event_enabler, event_recorder))
+			continue;
+		if (!event_enabler->fields)
+			return;
+		matched = true;
+		for (i = 0; i < tp_class->nr_fields; i++) {
+			const struct lttng_kernel_event_field *field = tp_class->fields[i];
+
+			if (!field->nowrite
+					&& lttng_event_enabler_has_field(event_enabler, field->name))
+				recorded |= LTTNG_EVENT_FIELD_BIT(i);
+		}
+	}
+	if (!matched)
+		return;
+	for (i = tp_class->nr_fields - 1; i > 0; i--) {
+		const struct lttng_kernel_type_common *type = tp_class->fields[i]->type;
+
+		switch (type->type) {
+		case lttng_kernel_type_sequence:
+			if (lttng_kernel_get_type_sequence(type)->length_name)
+				break;
+			if (recorded & LTTNG_EVENT_FIELD_BIT(i - 1))
+				recorded |= LTTNG_EVENT_FIELD_BIT(i);
+			if (recorded & LTTNG_EVENT_FIELD_BIT(i))
+				recorded |= LTTNG_EVENT_FIELD_BIT(i - 1);
+			break;
+		case lttng_kernel_type_variant:
+			if (lttng_kernel_get_type_variant(type)->tag_name)
+				break;
+			if (recorded & LTTNG_EVENT_FIELD_BIT(i))
+				recorded |= LTTNG_EVENT_FIELD_BIT(i - 1);
+			break;
+		default:
+			break;
+		}
+	}
+	event_recorder->skip_fields = ~recorded;
+}
+
+/*
+ * Set the sampling of a new event recorder from the enablers matching it,
+ * before its metadata is dumped. The event is sampled only if all of them
+ * sample it, with their least restrictive parameters. Called with sessions
+ * lock held.
+ */
+static
+int lttng_event_recorder_sampling_init(struct lttng_kernel_event_recorder *event_recorder)
+{
+	struct lttng_kernel_session *session = event_recorder->chan->parent.session;
+	struct lttng_event_enabler *event_enabler;
+	struct lttng_event_sampling *sampling;
+	unsigned int period = UINT_MAX, rate = 0, burst = 0;
+	bool matched = false, rate_limited = true;
+
+	list_for_each_entry(event_enabler, &session->priv->enablers_head, node) {
+		const struct lttng_kernel_abi_event_sampling *param = &event_enabler->sampling;
+
+		if (!lttng_event_enabler_match_event(event_enabler, event_recorder))
+			continue;
+		if (param->period <= 1 && !param->rate)
+			return 0;
+		matched = true;
+		period = min(period, max(param->period, 1U));
+		if (!param->rate)
+			rate_limited = false;
+		rate = max(rate, param->rate);
+		burst = max(burst, param->burst ? : param->rate);
+	}
+	if (!matched)
+		return 0;
+	if (!rate_limited)
+		rate = 0;
+	if (period == 1 && !rate)
+		return 0;
+
+	sampling = kzalloc(sizeof(*sampling), GFP_KERNEL);
+	if (!sampling)
+		return -ENOMEM;
+	sampling->state = alloc_percpu(struct lttng_event_sampling_state);
+	if (!sampling->state) {
+		kfree(sampling);
+		return -ENOMEM;
+	}
+	sampling->period = period;
+	sampling->rate = rate;
+	sampling->burst = burst;
+	if (rate) {
+		sampling->cost = div_u64(NSEC_PER_SEC, rate);
+		sampling->max_credit = (uint64_t) burst * sampling->cost;
+	}
+	event_recorder->sampling = sampling;
+	return 0;
+}
+
+static
+void lttng_event_recorder_sampling_destroy(struct lttng_kernel_event_recorder *event_recorder)
+{
+	struct lttng_event_sampling *sampling = event_recorder->sampling;
+
+	if (!sampling)
+		return;
+	free_percpu(sampling->state);
+	kfree(sampling);
+}
+
 static
 void lttng_enabler_destroy(struct lttng_enabler *enabler)
 {
@@ -2596,6 +3141,7 @@ void lttng_event_enabler_destroy(struct lttng_event_enabler *event_enabler)
 	lttng_enabler_destroy(lttng_event_enabler_as_enabler(event_enabler));
 
 	list_del(&event_enabler->node);
+	kfree(event_enabler->fields);
 	kfree(event_enabler);
 }
 
@@ -2738,6 +3284,7 @@ void lttng_session_sync_event_enablers(struct lttng_kernel_session *session)
 {
 	struct lttng_event_enabler *event_enabler;
 	struct lttng_kernel_event_recorder_private *event_recorder_priv;
+	LIST_HEAD(filter_set_release);
 
 	list_for_each_entry(event_enabler, &session->priv->enablers_head, node)
 		lttng_event_enabler_ref_events(event_enabler);
@@ -2807,9 +3354,11 @@ void lttng_session_sync_event_enablers(struct lttng_kernel_session *session)
 			lttng_bytecode_sync_state(runtime);
 			nr_filters++;
 		}
+		lttng_bytecode_sync_filters(&event_recorder_priv->parent, &filter_set_release);
 		WRITE_ONCE(event_recorder_priv->parent.pub->eval_filter,
 			!(has_enablers_without_filter_bytecode || !nr_filters));
 	}
+	lttng_bytecode_release_filter_sets(&filter_set_release);
 }
 
 /*
@@ -2833,6 +3382,7 @@ void lttng_event_notifier_group_sync_enablers(struct lttng_event_notifier_group
 {
 	struct lttng_event_notifier_enabler *event_notifier_enabler;
 	struct lttng_kernel_event_notifier_private *event_notifier_priv;
+	LIST_HEAD(filter_set_release);
 
 	list_for_each_entry(event_notifier_enabler, &event_notifier_group->enablers_head, node)
 		lttng_event_notifier_enabler_ref_event_notifiers(event_notifier_enabler);
@@ -2898,6 +3448,7 @@ void lttng_event_notifier_group_sync_enablers(struct lttng_event_notifier_group
 			lttng_bytecode_sync_state(runtime);
 			nr_filters++;
 		}
+		lttng_bytecode_sync_filters(&event_notifier_priv->parent, &filter_set_release);
 		WRITE_ONCE(event_notifier_priv->parent.pub->eval_filter,
 			!(has_enablers_without_filter_bytecode || !nr_filters));
 
@@ -2909,6 +3460,7 @@ void lttng_event_notifier_group_sync_enablers(struct lttng_event_notifier_group
 		}
 		WRITE_ONCE(event_notifier->eval_capture, !!nr_captures);
 	}
+	lttng_bytecode_release_filter_sets(&filter_set_release);
 }
 
 /*
@@ -3635,9 +4187,14 @@ int _lttng_field_statedump(struct lttng_kernel_session *session,
 	return ret;
 }
 
+/*
+ * In sticky context mode, the sticky group follows the other context
+ * fields. It is a variant selected by a flag, so events only carry it
+ * when it changed since the previous event of the packet.
+ */
 static
 int _lttng_context_metadata_statedump(struct lttng_kernel_session *session,
-				    struct lttng_kernel_ctx *ctx)
+				    struct lttng_kernel_ctx *ctx, bool sticky)
 {
 	const char *prev_field_name = NULL;
 	int ret = 0;
@@ -3645,14 +4202,40 @@ int _lttng_context_metadata_statedump(struct lttng_kernel_session *session,
 
 	if (!ctx)
 		return 0;
+	if (!ctx->nr_sticky)
+		sticky = false;
 	for (i = 0; i < ctx->nr_fields; i++) {
 		const struct lttng_kernel_ctx_field *field = &ctx->fields[i];
 
+		if (sticky && field->sticky_group)
+			continue;
 		ret = _lttng_field_statedump(session, field->event_field, 2, &prev_field_name);
 		if (ret)
 			return ret;
 	}
-	return ret;
+	if (!sticky)
+		return 0;
+	ret = lttng_metadata_printf(session,
+		"		enum : uint8_t { unchanged = 0, changed = 1 } _sticky;\n"
+		"		variant <_sticky> {\n"
+		"			struct { } unchanged;\n"
+		"			struct {\n");
+	if (ret)
+		return ret;
+	prev_field_name = NULL;
+	for (i = 0; i < ctx->nr_fields; i++) {
+		const struct lttng_kernel_ctx_field *field = &ctx->fields[i];
+
+		if (!field->sticky_group)
+			continue;
+		ret = _lttng_field_statedump(session, field->event_field, 4, &prev_field_name);
+		if (ret)
+			return ret;
+	}
+	return lttng_metadata_printf(session,
+		"			} align(%u) changed;\n"
+		"		} _sticky_v;\n",
+		(unsigned int) ctx->sticky_align * CHAR_BIT);
 }
 
 static
@@ -3667,6 +4250,8 @@ int _lttng_fields_metadata_statedump(struct lttng_kernel_session *session,
 	for (i = 0; i < desc->tp_class->nr_fields; i++) {
 		const struct lttng_kernel_event_field *field = desc->tp_class->fields[i];
 
+		if (event_recorder->skip_fields & LTTNG_EVENT_FIELD_BIT(i))
+			continue;
 		ret = _lttng_field_statedump(session, field, 2, &prev_field_name);
 		if (ret)
 			return ret;
@@ -3675,23 +4260,15 @@ int _lttng_fields_metadata_statedump(struct lttng_kernel_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
- * The entire event metadata is printed as a single atomic metadata
- * transaction.
+ * Print the declaration of @event_recorder with event ID @id. Must be called
+ * within a metadata transaction.
  */
 static
-int _lttng_event_metadata_statedump(struct lttng_kernel_session *session,
-				  struct lttng_kernel_channel_buffer *chan,
-				  struct lttng_kernel_event_recorder *event_recorder)
+int _lttng_event_declaration_statedump(struct lttng_kernel_session *session,
+				  struct lttng_kernel_event_recorder *event_recorder,
+				  unsigned int id)
 {
-	int ret = 0;
-
-	if (event_recorder->priv->metadata_dumped || !LTTNG_READ_ONCE(session->active))
-		return 0;
-	if (chan->priv->channel_type == METADATA_CHANNEL)
-		return 0;
-
-	lttng_metadata_begin(session);
+	int ret;
 
 	ret = lttng_metadata_printf(session,
 		"event {\n"
@@ -3699,31 +4276,75 @@ int _lttng_event_metadata_statedump(struct lttng_kernel_session *session,
 		"	id = %u;\n"
 		"	stream_id = %u;\n",
 		event_recorder->priv->parent.desc->event_name,
-		event_recorder->priv->id,
+		id,
 		event_recorder->chan->priv->id);
 	if (ret)
-		goto end;
+		return ret;
+
+	/* Lets analyses scale the recorded counts back up. */
+	if (event_recorder->sampling) {
+		ret = lttng_metadata_printf(session,
+			"	sampling_period = %u;\n"
+			"	rate_limit = %u;\n"
+			"	rate_limit_burst = %u;\n",
+			event_recorder->sampling->period,
+			event_recorder->sampling->rate,
+			event_recorder->sampling->burst);
+		if (ret)
+			return ret;
+	}
 
 	ret = lttng_metadata_printf(session,
 		"	fields := struct {\n"
 		);
 	if (ret)
-		goto end;
+		return ret;
 
 	ret = _lttng_fields_metadata_statedump(session, event_recorder);
 	if (ret)
-		goto end;
+		return ret;
 
 	/*
 	 * LTTng space reservation can only reserve multiples of the
 	 * byte size.
 	 */
-	ret = lttng_metadata_printf(session,
+	return lttng_metadata_printf(session,
 		"	};\n"
 		"};\n\n");
+}
+
+/*
+ * Must be called with sessions_mutex held.
+ * The entire event metadata is printed as a single atomic metadata
+ * transaction.
+ */
+static
+int _lttng_event_metadata_statedump(struct lttng_kernel_session *session,
+				  struct lttng_kernel_channel_buffer *chan,
+				  struct lttng_kernel_event_recorder *event_recorder)
+{
+	int ret = 0;
+
+	if (event_recorder->priv->metadata_dumped || !LTTNG_READ_ONCE(session->active))
+		return 0;
+	if (chan->priv->channel_type == METADATA_CHANNEL)
+		return 0;
+
+	lttng_metadata_begin(session);
+
+	ret = _lttng_event_declaration_statedump(session, event_recorder,
+			event_recorder->priv->id);
 	if (ret)
 		goto end;
 
+	/* Compact ID alias given by event ID remapping. */
+	if (event_recorder->priv->compact_gen) {
+		ret = _lttng_event_declaration_statedump(session, event_recorder,
+				event_recorder->priv->compact_id);
+		if (ret)
+			goto end;
+	}
+
 	event_recorder->priv->metadata_dumped = 1;
 end:
 	lttng_metadata_end(session);
@@ -3758,7 +4379,8 @@ int _lttng_channel_metadata_statedump(struct lttng_kernel_session *session,
 		"	packet.context := struct packet_context;\n",
 		chan->priv->id,
 		chan->priv->header_type == 1 ? "struct event_header_compact" :
-			"struct event_header_large");
+		chan->priv->header_type == 2 ? "struct event_header_large" :
+			"struct event_header_varlen");
 	if (ret)
 		goto end;
 
@@ -3768,10 +4390,21 @@ int _lttng_channel_metadata_statedump(struct lttng_kernel_session *session,
 		if (ret)
 			goto end;
 	}
-	ret = _lttng_context_metadata_statedump(session, chan->priv->ctx);
+	ret = _lttng_context_metadata_statedump(session, chan->priv->ctx,
+			chan->priv->sticky_ctx != NULL);
 	if (ret)
 		goto end;
-	if (chan->priv->ctx) {
+	if (chan->priv->ctx && chan->priv->sticky_ctx && chan->priv->ctx->nr_sticky) {
+		/*
+		 * The alignment of a variant depends on the selected
+		 * field: state the one used by the tracer.
+		 */
+		ret = lttng_metadata_printf(session,
+			"	} align(%u);\n",
+			(unsigned int) chan->priv->ctx->largest_align * CHAR_BIT);
+		if (ret)
+			goto end;
+	} else if (chan->priv->ctx) {
 		ret = lttng_metadata_printf(session,
 			"	};\n");
 		if (ret)
@@ -3815,12 +4448,19 @@ int _lttng_stream_packet_context_declare(struct lttng_kernel_session *session)
  * id: range: 0 - 65534.
  * id 65535 is reserved to indicate an extended header.
  *
+ * Variable length header:
+ * byte aligned, the form tag selects the id and timestamp widths. The
+ * writer picks the smallest form holding the id and the timestamp bits
+ * changed since the previous record of the stream.
+ *
  * Must be called with sessions_mutex held.
  */
 static
 int _lttng_event_header_declare(struct lttng_kernel_session *session)
 {
-	return lttng_metadata_printf(session,
+	int ret;
+
+	ret = lttng_metadata_printf(session,
 	"struct event_header_compact {\n"
 	"	enum : uint5_t { compact = 0 ... 30, extended = 31 } id;\n"
 	"	variant <id> {\n"
@@ -3849,6 +4489,38 @@ int _lttng_event_header_declare(struct lttng_kernel_session *session)
 	lttng_alignof(uint32_t) * CHAR_BIT,
 	lttng_alignof(uint16_t) * CHAR_BIT
 	);
+	if (ret)
+		return ret;
+
+	return lttng_metadata_printf(session,
+	"struct event_header_varlen {\n"
+	"	enum : integer { size = 2; align = 1; signed = false; }\n"
+	"		{ tiny = 0, small = 1, medium = 2, extended = 3 } form;\n"
+	"	variant <form> {\n"
+	"		struct {\n"
+	"			integer { size = 5; align = 1; signed = false; } id;\n"
+	"			integer { size = 9; align = 1; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} tiny;\n"
+	"		struct {\n"
+	"			integer { size = 6; align = 1; signed = false; } id;\n"
+	"			integer { size = 16; align = 1; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} small;\n"
+	"		struct {\n"
+	"			integer { size = 16; align = 1; signed = false; } id;\n"
+	"			integer { size = 30; align = 1; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} medium;\n"
+	"		struct {\n"
+	"			integer { size = 6; align = 1; signed = false; } padding;\n"
+	"			integer { size = 32; align = 8; signed = false; } id;\n"
+	"			integer { size = 64; align = 8; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} extended;\n"
+	"	} v;\n"
+	"} align(8);\n\n",
+	trace_clock_name(),
+	trace_clock_name(),
+	trace_clock_name(),
+	trace_clock_name()
+	);
 }
 
  /*
@@ -4357,7 +5029,7 @@ static int __init lttng_events_init(void)
 		return ret;
 	ret = lttng_context_init();
 	if (ret)
-		return ret;
+		goto error_context;
 	ret = lttng_tracepoint_init();
 	if (ret)
 		goto error_tp;
@@ -4427,6 +5099,8 @@ error_kmem_event_recorder:
 	lttng_tracepoint_exit();
 error_tp:
 	lttng_context_exit();
+error_context:
+	lttng_probes_exit();
 	printk(KERN_NOTICE "LTTng: Failed to load modules v%s.%s.%s%s (%s)%s%s\n",
 		__stringify(LTTNG_MODULES_MAJOR_VERSION),
 		__stringify(LTTNG_MODULES_MINOR_VERSION),
@@ -4463,6 +5137,7 @@ static void __exit lttng_events_exit(void)
 	kmem_cache_destroy(event_notifier_private_cache);
 	lttng_tracepoint_exit();
 	lttng_context_exit();
+	lttng_probes_exit();
 	printk(KERN_NOTICE "LTTng: Unloaded modules v%s.%s.%s%s (%s)%s%s\n",
 		__stringify(LTTNG_MODULES_MAJOR_VERSION),
 		__stringify(LTTNG_MODULES_MINOR_VERSION),
@@ -11,7 +11,11 @@
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/uaccess.h>
 
+#include <wrapper/uaccess.h>
+#include <ringbuffer/config.h>
 #include <lttng/events.h>
 #include <lttng/events-internal.h>
 
@@ -36,6 +40,170 @@ DEFINE_PER_CPU(struct lttng_dynamic_len_stack, lttng_dynamic_len_stack);
 
 EXPORT_PER_CPU_SYMBOL_GPL(lttng_dynamic_len_stack);
 
+struct lttng_fanout_percpu __percpu *lttng_fanout_percpu;
+EXPORT_SYMBOL_GPL(lttng_fanout_percpu);
+
+/*
+ * Bumped, under sessions lock, whenever the recorders attached to a
+ * tracepoint change.
+ */
+unsigned long lttng_fanout_gen;
+EXPORT_SYMBOL_GPL(lttng_fanout_gen);
+
+/*
+ * Payload serialization into a fan-out scratch area. The context
+ * client_priv is the scratch area, and buf_offset the offset within its
+ * data, starting at 0. The payload start being aligned on its largest
+ * alignment in the channels, the layout and padding match the ring
+ * buffer ones byte for byte.
+ */
+static
+char *lttng_fanout_dest(struct lttng_kernel_ring_buffer_ctx *ctx)
+{
+	struct lttng_fanout_scratch *scratch = ctx->client_priv;
+
+	return scratch->data + ctx->priv.buf_offset;
+}
+
+static
+void lttng_fanout_write(struct lttng_kernel_ring_buffer_ctx *ctx, const void *src,
+		size_t len, size_t alignment)
+{
+	lib_ring_buffer_align_ctx(ctx, alignment);
+	memcpy(lttng_fanout_dest(ctx), src, len);
+	ctx->priv.buf_offset += len;
+}
+
+static
+void lttng_fanout_write_from_user(struct lttng_kernel_ring_buffer_ctx *ctx,
+		const void __user *src, size_t len, size_t alignment)
+{
+	char *dest;
+	unsigned long ret;
+
+	lib_ring_buffer_align_ctx(ctx, alignment);
+	dest = lttng_fanout_dest(ctx);
+	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len))) {
+		memset(dest, 0, len);
+	} else {
+		pagefault_disable();
+		ret = __copy_from_user_inatomic(dest, src, len);
+		pagefault_enable();
+		if (unlikely(ret))
+			memset(dest, 0, len);
+	}
+	ctx->priv.buf_offset += len;
+}
+
+static
+void lttng_fanout_memset(struct lttng_kernel_ring_buffer_ctx *ctx,
+		int c, size_t len)
+{
+	memset(lttng_fanout_dest(ctx), c, len);
+	ctx->priv.buf_offset += len;
+}
+
+/*
+ * Copy up to @len bytes of @src, stopping at its terminating '\0', and
+ * pad up to @len with @pad.
+ */
+static
+void lttng_fanout_pad_str(char *dest, const char *src, size_t len, char pad)
+{
+	size_t count;
+
+	for (count = 0; count < len; count++) {
+		char c = READ_ONCE(src[count]);
+
+		if (!c)
+			break;
+		dest[count] = c;
+	}
+	memset(dest + count, pad, len - count);
+}
+
+static
+void lttng_fanout_pad_str_from_user(char *dest, const char __user *src,
+		size_t len, char pad)
+{
+	size_t count = 0;
+
+	if (likely(lttng_access_ok(VERIFY_READ, src, len))) {
+		pagefault_disable();
+		for (; count < len; count++) {
+			char c;
+
+			if (__copy_from_user_inatomic(&c, src + count, 1) || !c)
+				break;
+			dest[count] = c;
+		}
+		pagefault_enable();
+	}
+	memset(dest + count, pad, len - count);
+}
+
+static
+void lttng_fanout_strcpy(struct lttng_kernel_ring_buffer_ctx *ctx, const char *src,
+		size_t len)
+{
+	char *dest = lttng_fanout_dest(ctx);
+
+	if (unlikely(!len))
+		return;
+	lttng_fanout_pad_str(dest, src, len - 1, '#');
+	dest[len - 1] = '\0';
+	ctx->priv.buf_offset += len;
+}
+
+static
+void lttng_fanout_strcpy_from_user(struct lttng_kernel_ring_buffer_ctx *ctx,
+		const char __user *src, size_t len)
+{
+	char *dest = lttng_fanout_dest(ctx);
+
+	if (unlikely(!len))
+		return;
+	lttng_fanout_pad_str_from_user(dest, src, len - 1, '#');
+	dest[len - 1] = '\0';
+	ctx->priv.buf_offset += len;
+}
+
+static
+void lttng_fanout_pstrcpy_pad(struct lttng_kernel_ring_buffer_ctx *ctx, const char *src,
+		size_t len)
+{
+	lttng_fanout_pad_str(lttng_fanout_dest(ctx), src, len, '\0');
+	ctx->priv.buf_offset += len;
+}
+
+static
+void lttng_fanout_pstrcpy_pad_from_user(struct lttng_kernel_ring_buffer_ctx *ctx,
+		const char __user *src, size_t len)
+{
+	lttng_fanout_pad_str_from_user(lttng_fanout_dest(ctx), src, len, '\0');
+	ctx->priv.buf_offset += len;
+}
+
+static
+struct lttng_kernel_channel_buffer_ops lttng_fanout_ops = {
+	.event_write = lttng_fanout_write,
+	.event_write_from_user = lttng_fanout_write_from_user,
+	.event_memset = lttng_fanout_memset,
+	.event_strcpy = lttng_fanout_strcpy,
+	.event_strcpy_from_user = lttng_fanout_strcpy_from_user,
+	.event_pstrcpy_pad = lttng_fanout_pstrcpy_pad,
+	.event_pstrcpy_pad_from_user = lttng_fanout_pstrcpy_pad_from_user,
+};
+
+/*
+ * Channel used by the probes to serialize a payload into a fan-out
+ * scratch area. Only the field write operations are available.
+ */
+struct lttng_kernel_channel_buffer lttng_fanout_chan = {
+	.ops = &lttng_fanout_ops,
+};
+EXPORT_SYMBOL_GPL(lttng_fanout_chan);
+
 /*
  * Called under sessions lock.
  */
@@ -330,5 +498,13 @@ int lttng_probes_init(void)
 
 	for_each_possible_cpu(cpu)
 		per_cpu_ptr(&lttng_dynamic_len_stack, cpu)->offset = 0;
+	lttng_fanout_percpu = alloc_percpu(struct lttng_fanout_percpu);
+	if (!lttng_fanout_percpu)
+		return -ENOMEM;
 	return 0;
 }
+
+void lttng_probes_exit(void)
+{
+	free_percpu(lttng_fanout_percpu);
+}
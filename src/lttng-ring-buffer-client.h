@@ -10,16 +10,41 @@
 #include <linux/module.h>
 #include <linux/types.h>
 #include <lttng/bitfield.h>
+#include <wrapper/barrier.h>
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_mappings() */
 #include <wrapper/trace-clock.h>
 #include <lttng/events.h>
 #include <lttng/events-internal.h>
 #include <lttng/tracer.h>
 #include <ringbuffer/frontend_types.h>
+#include <ringbuffer/frontend_internal.h>
 
 #define LTTNG_COMPACT_EVENT_BITS	5
 #define LTTNG_COMPACT_TSC_BITS		27
 
+/*
+ * Variable length event header forms, see _lttng_event_header_declare().
+ * The tag selects the id and timestamp widths of the form.
+ */
+#define LTTNG_VARLEN_TAG_BITS		2
+
+enum lttng_varlen_form {
+	LTTNG_VARLEN_TINY = 0,
+	LTTNG_VARLEN_SMALL = 1,
+	LTTNG_VARLEN_MEDIUM = 2,
+	LTTNG_VARLEN_EXTENDED = 3,
+};
+
+static const struct lttng_varlen_layout {
+	unsigned int id_bits, tsc_bits, size;
+} lttng_varlen_layouts[] = {
+	[LTTNG_VARLEN_TINY] = { 5, 9, 2 },
+	[LTTNG_VARLEN_SMALL] = { 6, 16, 3 },
+	[LTTNG_VARLEN_MEDIUM] = { 16, 30, 6 },
+	/* Tag and padding byte, 32-bit id, 64-bit timestamp. */
+	[LTTNG_VARLEN_EXTENDED] = { 32, 64, 13 },
+};
+
 static struct lttng_transport lttng_relay_transport;
 
 /*
@@ -67,6 +92,14 @@ struct packet_header {
 struct lttng_client_ctx {
 	size_t packet_context_len;
 	size_t event_context_len;
+	uint32_t event_id;
+	enum lttng_varlen_form varlen_form;	/* Set by record_header_size() */
+
+	/* Sticky context mode. */
+	bool sticky_nested;		/* Record nested in another record on this cpu */
+	bool sticky_changed;		/* Set by record_header_size() */
+	unsigned long sticky_gen;	/* Set by record_header_size() */
+	char sticky_values[LTTNG_KERNEL_CTX_GATHER_MAX] __attribute__((aligned(8)));
 };
 
 static inline notrace u64 lib_ring_buffer_clock_read(struct lttng_kernel_ring_buffer_channel *chan)
@@ -87,11 +120,24 @@ size_t ctx_get_aligned_size(size_t offset, struct lttng_kernel_ctx *ctx,
 	return offset - orig_offset;
 }
 
+static inline
+bool ctx_sticky_enabled(struct lttng_kernel_channel_buffer *lttng_chan,
+		struct lttng_kernel_ctx *ctx)
+{
+	return unlikely(lttng_chan->priv->sticky_ctx) && ctx && ctx->nr_sticky;
+}
+
+/*
+ * In sticky context mode, the computed length covers the fields outside
+ * of the sticky group and the sticky flag. record_header_size() adds the
+ * sticky group when it needs to be written.
+ */
 static inline
 void ctx_get_struct_size(struct lttng_kernel_ctx *ctx, size_t *ctx_len,
 		struct lttng_kernel_channel_buffer *lttng_chan,
 		struct lttng_kernel_ring_buffer_ctx *bufctx)
 {
+	bool sticky = ctx_sticky_enabled(lttng_chan, ctx);
 	int i;
 	size_t offset = 0;
 
@@ -99,28 +145,221 @@ void ctx_get_struct_size(struct lttng_kernel_ctx *ctx, size_t *ctx_len,
 		*ctx_len = 0;
 		return;
 	}
+	if (ctx->all_fixed && !sticky) {
+		*ctx_len = ctx->fixed_len;
+		return;
+	}
 	for (i = 0; i < ctx->nr_fields; i++) {
-		offset += ctx->fields[i].get_size(ctx->fields[i].priv,
-				bufctx->probe_ctx, offset);
+		const struct lttng_kernel_ctx_field *field = &ctx->fields[i];
+
+		if (sticky && field->sticky_group)
+			continue;
+		if (field->fixed_size) {
+			offset += lib_ring_buffer_align(offset, field->fixed_align);
+			offset += field->fixed_size;
+		} else {
+			offset += field->get_size(field->priv,
+					bufctx->probe_ctx, offset);
+		}
 	}
+	if (sticky)
+		offset += sizeof(uint8_t);
 	*ctx_len = offset;
 }
 
+/*
+ * Store the value of a gatherable context field at its aligned offset
+ * in buf. Returns the offset following the field. The value comes from
+ * the same source as the field record() callback.
+ */
 static inline
-void ctx_record(struct lttng_kernel_ring_buffer_ctx *bufctx,
+size_t ctx_gather_field(const struct lttng_kernel_ctx_field *field,
+		struct lttng_kernel_ring_buffer_ctx *bufctx,
+		char *buf, size_t offset)
+{
+	struct lttng_ctx_value v;
+
+	if (field->reserve_cpu)
+		v.u.s64 = bufctx->priv.reserve_cpu;
+	else
+		field->get_value(field->priv, bufctx->probe_ctx, &v);
+	offset += lib_ring_buffer_align(offset, field->fixed_align);
+	if (field->event_field->type->type == lttng_kernel_type_array) {
+		/* Text array, buf is zeroed past the string. */
+		memcpy(&buf[offset], v.u.str, strnlen(v.u.str, field->fixed_size));
+		return offset + field->fixed_size;
+	}
+	switch (field->fixed_size) {
+	case 1:
+		*(uint8_t *) &buf[offset] = (uint8_t) v.u.s64;
+		break;
+	case 2:
+		*(uint16_t *) &buf[offset] = (uint16_t) v.u.s64;
+		break;
+	case 4:
+		*(uint32_t *) &buf[offset] = (uint32_t) v.u.s64;
+		break;
+	case 8:
+		*(uint64_t *) &buf[offset] = (uint64_t) v.u.s64;
+		break;
+	default:
+		WARN_ON_ONCE(1);
+	}
+	return offset + field->fixed_size;
+}
+
+/*
+ * Gather the values of a context made only of gatherable fields into a
+ * stack buffer laid out as in the trace, and write it in a single chunk.
+ */
+static inline
+void ctx_record_gather(struct lttng_kernel_ring_buffer_ctx *bufctx,
 		struct lttng_kernel_channel_buffer *lttng_chan,
 		struct lttng_kernel_ctx *ctx)
+{
+	char buf[LTTNG_KERNEL_CTX_GATHER_MAX] __attribute__((aligned(8)));
+	size_t offset = 0;
+	int i;
+
+	/* Do not leak stack content through padding. */
+	memset(buf, 0, ctx->fixed_len);
+	for (i = 0; i < ctx->nr_fields; i++)
+		offset = ctx_gather_field(&ctx->fields[i], bufctx, buf, offset);
+	lttng_chan->ops->event_write(bufctx, buf, ctx->fixed_len, 1);
+}
+
+/*
+ * Gather the sticky group of the context, laid out from an aligned
+ * start, into client_ctx. Called once per event before reservation.
+ */
+static inline
+void ctx_sticky_gather(struct lttng_kernel_ctx *ctx,
+		struct lttng_kernel_ring_buffer_ctx *bufctx,
+		struct lttng_client_ctx *client_ctx)
+{
+	size_t offset = 0;
+	int i;
+
+	memset(client_ctx->sticky_values, 0, ctx->sticky_len);
+	for (i = 0; i < ctx->nr_fields; i++) {
+		const struct lttng_kernel_ctx_field *field = &ctx->fields[i];
+
+		if (!field->sticky_group)
+			continue;
+		offset = ctx_gather_field(field, bufctx,
+				client_ctx->sticky_values, offset);
+	}
+}
+
+/*
+ * Whether the sticky group needs to be written by a record starting at
+ * offset: always for the first record of a packet and for nested
+ * records, otherwise only when it differs from the last one written on
+ * this cpu.
+ */
+static inline
+bool ctx_sticky_changed(struct lttng_kernel_ring_buffer_channel *chan,
+		struct lttng_kernel_channel_buffer *lttng_chan,
+		struct lttng_kernel_ring_buffer_ctx *ctx,
+		struct lttng_client_ctx *client_ctx, size_t offset)
+{
+	struct lttng_sticky_ctx_state *state;
+	unsigned long gen;
+
+	if (client_ctx->sticky_nested)
+		return true;
+	state = per_cpu_ptr(lttng_chan->priv->sticky_ctx, ctx->priv.reserve_cpu);
+	gen = READ_ONCE(state->gen);
+	client_ctx->sticky_gen = gen;
+	if (subbuf_offset(offset, chan) <= offsetof(struct packet_header, ctx.header_end))
+		return true;
+	if (READ_ONCE(state->valid_gen) != gen + 1)
+		return true;
+	return memcmp(state->last, client_ctx->sticky_values,
+			lttng_chan->priv->ctx->sticky_len) != 0;
+}
+
+/*
+ * Called after a successful reservation. Outer records which wrote the
+ * sticky group make it the reference for the following records, unless
+ * a nested record bumped gen in the meantime.
+ */
+static inline
+void ctx_sticky_commit(struct lttng_kernel_channel_buffer *lttng_chan,
+		struct lttng_kernel_ring_buffer_ctx *ctx,
+		const struct lttng_client_ctx *client_ctx)
+{
+	struct lttng_sticky_ctx_state *state;
+
+	if (client_ctx->sticky_nested || !client_ctx->sticky_changed)
+		return;
+	state = per_cpu_ptr(lttng_chan->priv->sticky_ctx, ctx->priv.reserve_cpu);
+	memcpy(state->last, client_ctx->sticky_values,
+			lttng_chan->priv->ctx->sticky_len);
+	barrier();
+	WRITE_ONCE(state->valid_gen, client_ctx->sticky_gen + 1);
+}
+
+static inline
+void ctx_record(struct lttng_kernel_ring_buffer_ctx *bufctx,
+		struct lttng_kernel_channel_buffer *lttng_chan,
+		struct lttng_kernel_ctx *ctx,
+		const struct lttng_client_ctx *client_ctx)
 {
 	int i;
 
 	if (likely(!ctx))
 		return;
 	lib_ring_buffer_align_ctx(bufctx, ctx->largest_align);
+	if (ctx_sticky_enabled(lttng_chan, ctx)) {
+		uint8_t changed = client_ctx->sticky_changed;
+
+		for (i = 0; i < ctx->nr_fields; i++) {
+			if (ctx->fields[i].sticky_group)
+				continue;
+			ctx->fields[i].record(ctx->fields[i].priv,
+					bufctx->probe_ctx, bufctx, lttng_chan);
+		}
+		lttng_chan->ops->event_write(bufctx, &changed, sizeof(changed),
+				lttng_alignof(changed));
+		if (changed)
+			lttng_chan->ops->event_write(bufctx,
+					client_ctx->sticky_values,
+					ctx->sticky_len, ctx->sticky_align);
+		return;
+	}
+	if (ctx->gather) {
+		ctx_record_gather(bufctx, lttng_chan, ctx);
+		return;
+	}
 	for (i = 0; i < ctx->nr_fields; i++)
 		ctx->fields[i].record(ctx->fields[i].priv, bufctx->probe_ctx,
 				bufctx, lttng_chan);
 }
 
+/*
+ * Smallest variable length header form holding the event id and enough
+ * timestamp bits for readers to rebuild the record timestamp.
+ */
+static __inline__
+enum lttng_varlen_form lttng_varlen_form(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer_ctx *ctx, uint32_t event_id)
+{
+	enum lttng_varlen_form form;
+
+	if (ctx->priv.rflags & RING_BUFFER_RFLAG_FULL_TSC)
+		return LTTNG_VARLEN_EXTENDED;
+	for (form = LTTNG_VARLEN_TINY; form < LTTNG_VARLEN_EXTENDED; form++) {
+		const struct lttng_varlen_layout *layout = &lttng_varlen_layouts[form];
+
+		if (event_id < (1U << layout->id_bits)
+				&& last_tsc_fits(config, ctx->priv.buf,
+					ctx->priv.tsc, layout->tsc_bits))
+			return form;
+	}
+	return LTTNG_VARLEN_EXTENDED;
+}
+
 /*
  * record_header_size - Calculate the header size and padding necessary.
  * @config: ring buffer instance configuration
@@ -176,12 +415,27 @@ size_t record_header_size(const struct lttng_kernel_ring_buffer_config *config,
 			offset += sizeof(uint64_t);	/* timestamp */
 		}
 		break;
+	case 3:	/* varlen */
+		padding = 0;
+		client_ctx->varlen_form = lttng_varlen_form(config, ctx,
+				client_ctx->event_id);
+		offset += lttng_varlen_layouts[client_ctx->varlen_form].size;
+		break;
 	default:
 		padding = 0;
 		WARN_ON_ONCE(1);
 	}
 	offset += ctx_get_aligned_size(offset, lttng_chan->priv->ctx,
 			client_ctx->packet_context_len);
+	if (ctx_sticky_enabled(lttng_chan, lttng_chan->priv->ctx)) {
+		client_ctx->sticky_changed = ctx_sticky_changed(chan, lttng_chan,
+				ctx, client_ctx, orig_offset);
+		if (client_ctx->sticky_changed) {
+			offset += lib_ring_buffer_align(offset,
+					lttng_chan->priv->ctx->sticky_align);
+			offset += lttng_chan->priv->ctx->sticky_len;
+		}
+	}
 	*pre_header_padding = padding;
 	return offset - orig_offset;
 }
@@ -191,8 +445,35 @@ size_t record_header_size(const struct lttng_kernel_ring_buffer_config *config,
 static
 void lttng_write_event_header_slow(const struct lttng_kernel_ring_buffer_config *config,
 				 struct lttng_kernel_ring_buffer_ctx *ctx,
+				 const struct lttng_client_ctx *client_ctx,
 				 uint32_t event_id);
 
+static __inline__
+void lttng_write_event_header_varlen(const struct lttng_kernel_ring_buffer_config *config,
+			    struct lttng_kernel_ring_buffer_ctx *ctx,
+			    enum lttng_varlen_form form,
+			    uint32_t event_id)
+{
+	const struct lttng_varlen_layout *layout = &lttng_varlen_layouts[form];
+	uint8_t header[8] = { 0 };
+
+	bt_bitfield_write(header, uint8_t, 0, LTTNG_VARLEN_TAG_BITS, form);
+	if (form == LTTNG_VARLEN_EXTENDED) {
+		uint64_t timestamp = ctx->priv.tsc;
+
+		lib_ring_buffer_write(config, ctx, header, sizeof(uint8_t));
+		lib_ring_buffer_write(config, ctx, &event_id, sizeof(event_id));
+		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		return;
+	}
+	bt_bitfield_write(header, uint8_t, LTTNG_VARLEN_TAG_BITS,
+			layout->id_bits, event_id);
+	bt_bitfield_write(header, uint8_t,
+			LTTNG_VARLEN_TAG_BITS + layout->id_bits,
+			layout->tsc_bits, ctx->priv.tsc);
+	lib_ring_buffer_write(config, ctx, header, layout->size);
+}
+
 /*
  * lttng_write_event_header
  *
@@ -200,11 +481,13 @@ void lttng_write_event_header_slow(const struct lttng_kernel_ring_buffer_config
  *
  * @config: ring buffer instance configuration
  * @ctx: reservation context
+ * @client_ctx: client reservation context
  * @event_id: event ID
  */
 static __inline__
 void lttng_write_event_header(const struct lttng_kernel_ring_buffer_config *config,
 			    struct lttng_kernel_ring_buffer_ctx *ctx,
+			    const struct lttng_client_ctx *client_ctx,
 			    uint32_t event_id)
 {
 	struct lttng_kernel_channel_buffer *lttng_chan = channel_get_private(ctx->priv.chan);
@@ -238,22 +521,27 @@ void lttng_write_event_header(const struct lttng_kernel_ring_buffer_config *conf
 		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
 		break;
 	}
+	case 3:	/* varlen */
+		lttng_write_event_header_varlen(config, ctx,
+				client_ctx->varlen_form, event_id);
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
 
-	ctx_record(ctx, lttng_chan, lttng_chan->priv->ctx);
+	ctx_record(ctx, lttng_chan, lttng_chan->priv->ctx, client_ctx);
 	lib_ring_buffer_align_ctx(ctx, ctx->largest_align);
 
 	return;
 
 slow_path:
-	lttng_write_event_header_slow(config, ctx, event_id);
+	lttng_write_event_header_slow(config, ctx, client_ctx, event_id);
 }
 
 static
 void lttng_write_event_header_slow(const struct lttng_kernel_ring_buffer_config *config,
 				 struct lttng_kernel_ring_buffer_ctx *ctx,
+				 const struct lttng_client_ctx *client_ctx,
 				 uint32_t event_id)
 {
 	struct lttng_kernel_channel_buffer *lttng_chan = channel_get_private(ctx->priv.chan);
@@ -309,10 +597,14 @@ void lttng_write_event_header_slow(const struct lttng_kernel_ring_buffer_config
 		}
 		break;
 	}
+	case 3:	/* varlen */
+		lttng_write_event_header_varlen(config, ctx,
+				client_ctx->varlen_form, event_id);
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
-	ctx_record(ctx, lttng_chan, lttng_chan->priv->ctx);
+	ctx_record(ctx, lttng_chan, lttng_chan->priv->ctx, client_ctx);
 	lib_ring_buffer_align_ctx(ctx, ctx->largest_align);
 }
 
@@ -370,6 +662,12 @@ static void client_buffer_begin(struct lttng_kernel_ring_buffer *buf, u64 tsc,
 				     subbuf_idx;
 	header->ctx.events_discarded = 0;
 	header->ctx.cpu_id = buf->backend.cpu;
+	if (lttng_chan->priv->id_remap) {
+		struct lttng_event_id_remap *remap = lttng_chan->priv->id_remap;
+
+		WRITE_ONCE(*per_cpu_ptr(remap->packet_gen, buf->backend.cpu),
+			   READ_ONCE(remap->gen));
+	}
 }
 
 /*
@@ -518,7 +816,7 @@ static const struct lttng_kernel_ring_buffer_config client_config = {
 	.alloc = RING_BUFFER_ALLOC_PER_CPU,
 	.sync = RING_BUFFER_SYNC_PER_CPU,
 	.mode = RING_BUFFER_MODE_TEMPLATE,
-	.backend = RING_BUFFER_PAGE,
+	.backend = RING_BUFFER_BACKEND_TEMPLATE,
 	.output = RING_BUFFER_OUTPUT_TEMPLATE,
 	.oops = RING_BUFFER_OOPS_CONSISTENCY,
 	.ipi = RING_BUFFER_IPI_BARRIER,
@@ -542,14 +840,15 @@ struct lttng_kernel_ring_buffer_channel *_channel_create(const char *name,
 				void *priv, void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval)
+				unsigned int read_timer_interval,
+				const struct lttng_kernel_ring_buffer_channel_attr *attr)
 {
 	struct lttng_kernel_channel_buffer *lttng_chan = priv;
 	struct lttng_kernel_ring_buffer_channel *chan;
 
 	chan = channel_create(&client_config, name, lttng_chan, buf_addr,
 			      subbuf_size, num_subbuf, switch_timer_interval,
-			      read_timer_interval);
+			      read_timer_interval, attr);
 	if (chan) {
 		/*
 		 * Ensure this module is not unloaded before we finish
@@ -603,6 +902,23 @@ void lttng_buffer_read_close(struct lttng_kernel_ring_buffer *buf)
 	lib_ring_buffer_release_read(buf);
 }
 
+/*
+ * Use the compact ID alias of an event once the packet being written by
+ * @cpu began after the alias was declared. Count the hit otherwise.
+ */
+static
+uint32_t lttng_event_id_remap(struct lttng_kernel_channel_buffer *lttng_chan,
+		struct lttng_kernel_event_recorder *event_recorder, int cpu)
+{
+	struct lttng_event_id_remap *remap = lttng_chan->priv->id_remap;
+	unsigned int gen = lttng_smp_load_acquire(&event_recorder->priv->compact_gen);
+
+	if (gen && gen <= READ_ONCE(*per_cpu_ptr(remap->packet_gen, cpu)))
+		return event_recorder->priv->compact_id;
+	this_cpu_inc(*event_recorder->priv->hits);
+	return event_recorder->priv->id;
+}
+
 static
 int lttng_event_reserve(struct lttng_kernel_ring_buffer_ctx *ctx)
 {
@@ -622,9 +938,23 @@ int lttng_event_reserve(struct lttng_kernel_ring_buffer_ctx *ctx)
 
 	/* Compute internal size of context structures. */
 	ctx_get_struct_size(lttng_chan->priv->ctx, &client_ctx.packet_context_len, lttng_chan, ctx);
+	if (ctx_sticky_enabled(lttng_chan, lttng_chan->priv->ctx)) {
+		client_ctx.sticky_nested = per_cpu(lib_ring_buffer_nesting, cpu) > 1;
+		if (client_ctx.sticky_nested) {
+			struct lttng_sticky_ctx_state *state =
+				per_cpu_ptr(lttng_chan->priv->sticky_ctx, cpu);
+
+			/* Invalidate the reference of the interrupted record. */
+			WRITE_ONCE(state->gen, state->gen + 1);
+			barrier();
+		}
+		ctx_sticky_gather(lttng_chan->priv->ctx, ctx, &client_ctx);
+	}
 
 	switch (lttng_chan->priv->header_type) {
 	case 1:	/* compact */
+		if (unlikely(lttng_chan->priv->id_remap))
+			event_id = lttng_event_id_remap(lttng_chan, event_recorder, cpu);
 		if (event_id > 30)
 			ctx->priv.rflags |= LTTNG_RFLAG_EXTENDED;
 		break;
@@ -632,16 +962,24 @@ int lttng_event_reserve(struct lttng_kernel_ring_buffer_ctx *ctx)
 		if (event_id > 65534)
 			ctx->priv.rflags |= LTTNG_RFLAG_EXTENDED;
 		break;
+	case 3:	/* varlen */
+		/* The header form is chosen by record_header_size(). */
+		if (unlikely(lttng_chan->priv->id_remap))
+			event_id = lttng_event_id_remap(lttng_chan, event_recorder, cpu);
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
+	client_ctx.event_id = event_id;
 
 	ret = lib_ring_buffer_reserve(&client_config, ctx, &client_ctx);
 	if (unlikely(ret))
 		goto put;
+	if (ctx_sticky_enabled(lttng_chan, lttng_chan->priv->ctx))
+		ctx_sticky_commit(lttng_chan, ctx, &client_ctx);
 	lib_ring_buffer_backend_get_pages(&client_config, ctx,
 			&ctx->priv.backend_pages);
-	lttng_write_event_header(&client_config, ctx, event_id);
+	lttng_write_event_header(&client_config, ctx, &client_ctx, event_id);
 	return 0;
 put:
 	lib_ring_buffer_put_cpu(&client_config);
@@ -18,6 +18,7 @@
 #include <wrapper/tracepoint.h>
 #include <wrapper/rcu.h>
 #include <wrapper/list.h>
+#include <wrapper/user_namespace.h>
 #include <lttng/events.h>
 #include <lttng/events-internal.h>
 
@@ -56,6 +57,58 @@ bool lttng_id_tracker_lookup(struct lttng_kernel_id_tracker_rcu *p, int id)
 }
 EXPORT_SYMBOL_GPL(lttng_id_tracker_lookup);
 
+/*
+ * Compute the tracker verdict of the current task for a session and
+ * cache it in @verdict. Called from lttng_session_track_current() with
+ * preemption disabled. The generation is written last: if an interrupt
+ * updates the same entry meanwhile, the entry ends up either consistent
+ * or with a stale generation, recomputed on next use.
+ */
+bool lttng_session_track_current_slow(struct lttng_kernel_session *session,
+		struct lttng_tracker_verdict *verdict, unsigned long gen)
+{
+	struct lttng_kernel_id_tracker_rcu *lf;
+	uid_t uid = lttng_current_uid(), vuid = lttng_current_vuid();
+	gid_t gid = lttng_current_gid(), vgid = lttng_current_vgid();
+	bool track = false;
+
+	/* Read the generation before the trackers. */
+	smp_rmb();
+	lf = lttng_rcu_dereference(session->pid_tracker.p);
+	if (lf && !lttng_id_tracker_lookup(lf, current->tgid))
+		goto end;
+	lf = lttng_rcu_dereference(session->vpid_tracker.p);
+	if (lf && !lttng_id_tracker_lookup(lf, task_tgid_vnr(current)))
+		goto end;
+	lf = lttng_rcu_dereference(session->uid_tracker.p);
+	if (lf && !lttng_id_tracker_lookup(lf, uid))
+		goto end;
+	lf = lttng_rcu_dereference(session->vuid_tracker.p);
+	if (lf && !lttng_id_tracker_lookup(lf, vuid))
+		goto end;
+	lf = lttng_rcu_dereference(session->gid_tracker.p);
+	if (lf && !lttng_id_tracker_lookup(lf, gid))
+		goto end;
+	lf = lttng_rcu_dereference(session->vgid_tracker.p);
+	if (lf && !lttng_id_tracker_lookup(lf, vgid))
+		goto end;
+	track = true;
+end:
+	WRITE_ONCE(verdict->gen, 0);
+	barrier();
+	verdict->task = current;
+	verdict->pid = current->pid;
+	verdict->uid = uid;
+	verdict->vuid = vuid;
+	verdict->gid = gid;
+	verdict->vgid = vgid;
+	verdict->track = track;
+	barrier();
+	WRITE_ONCE(verdict->gen, gen);
+	return track;
+}
+EXPORT_SYMBOL_GPL(lttng_session_track_current_slow);
+
 static struct lttng_kernel_id_tracker_rcu *lttng_id_tracker_rcu_create(void)
 {
 	struct lttng_kernel_id_tracker_rcu *tracker;
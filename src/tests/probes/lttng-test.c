@@ -10,11 +10,25 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/proc_fs.h>
+#include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/byteorder/generic.h>
 #include <asm/byteorder.h>
 
+#include <lttng/abi.h>
 #include <lttng/events.h>
 #include <lttng/tracer.h>
+#include <ringbuffer/config.h>
+#include <ringbuffer/vfs.h>
+#include <wrapper/file.h>
 #include <wrapper/tracepoint.h>
 
 #define TP_MODULE_NOAUTOLOAD
@@ -32,12 +46,26 @@ LTTNG_DEFINE_TRACE(lttng_test_filter_event,
 	PARAMS(anint, netint, values, text, textlen, etext, net_values)
 );
 
+LTTNG_DEFINE_TRACE(lttng_test_ring_buffer_event,
+	PARAMS(uint32_t seq, const uint8_t *data),
+	PARAMS(seq, data)
+);
+
 #define LTTNG_TEST_FILTER_EVENT_FILE	"lttng-test-filter-event"
+#define LTTNG_TEST_RING_BUFFER_FILE	"lttng-test-ring-buffer"
 
 #define LTTNG_WRITE_COUNT_MAX	64
 
 static struct proc_dir_entry *lttng_test_filter_event_dentry;
 
+/*
+ * Duration of the last burst of events, read back from the proc file to
+ * measure the cost of filters attached to lttng_test_filter_event.
+ */
+static DEFINE_MUTEX(lttng_test_bench_mutex);
+static unsigned int lttng_test_bench_nr_iter;
+static u64 lttng_test_bench_ns;
+
 static
 void trace_test_event(unsigned int nr_iter)
 {
@@ -70,6 +98,8 @@ ssize_t lttng_test_filter_event_write(struct file *file, const char __user *user
 {
 	unsigned int nr_iter;
 	ssize_t written;
+	ktime_t start;
+	u64 duration;
 	int ret;
 
 	/* Get the number of iterations */
@@ -79,23 +109,699 @@ ssize_t lttng_test_filter_event_write(struct file *file, const char __user *user
 		goto end;
 	}
 	/* Trace the event */
+	start = ktime_get();
 	trace_test_event(nr_iter);
+	duration = ktime_to_ns(ktime_sub(ktime_get(), start));
+	mutex_lock(&lttng_test_bench_mutex);
+	lttng_test_bench_nr_iter = nr_iter;
+	lttng_test_bench_ns = duration;
+	mutex_unlock(&lttng_test_bench_mutex);
 	written = count;
 	*ppos += written;
 end:
 	return written;
 }
 
+/**
+ * lttng_test_filter_event_read - report the duration of the last events
+ * @file: file pointer
+ * @user_buf: user string
+ * @count: length to copy
+ *
+ * Reads "<number of events> <duration in ns>" for the last write.
+ */
+static
+ssize_t lttng_test_filter_event_read(struct file *file, char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	char buf[48];
+	int len;
+
+	mutex_lock(&lttng_test_bench_mutex);
+	len = scnprintf(buf, sizeof(buf), "%u %llu\n", lttng_test_bench_nr_iter,
+			(unsigned long long) lttng_test_bench_ns);
+	mutex_unlock(&lttng_test_bench_mutex);
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,6,0))
 static const struct proc_ops lttng_test_filter_event_proc_ops = {
+	.proc_read = lttng_test_filter_event_read,
 	.proc_write = lttng_test_filter_event_write,
 };
 #else
 static const struct file_operations lttng_test_filter_event_proc_ops = {
+	.read = lttng_test_filter_event_read,
 	.write = lttng_test_filter_event_write,
 };
 #endif
 
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(3,5,0))
+#define LTTNG_TEST_RING_BUFFER
+#endif
+
+#ifdef LTTNG_TEST_RING_BUFFER
+
+/*
+ * Ring buffer tests, run through the tracer ABI from the context of the
+ * task writing the test name to the proc file, as a consumer would:
+ *
+ * - "sticky": sticky vtid context, decoding the second packet on its own,
+ * - "ctrl": reading the packets through the stream control area alone,
+ *   without GET_SUBBUF,
+ * - "vmap": reading packets of a vmap backend channel. It also measures
+ *   the same burst of events recorded with the page and vmap backends,
+ *   which is read back from the proc file.
+ */
+
+#define LTTNG_TEST_RB_SUBBUF_SIZE	(4 * PAGE_SIZE)
+#define LTTNG_TEST_RB_NUM_SUBBUF	4
+#define LTTNG_TEST_RB_NR_PACKETS	2
+/* Smallest record: compact header, seq and data. */
+#define LTTNG_TEST_RB_RECORD_MIN_LEN	\
+	(2 * sizeof(uint32_t) + LTTNG_TEST_RING_BUFFER_DATA_LEN)
+/*
+ * Fill two and a half sub-buffers: the first two packets are delivered,
+ * and the buffer never gets full.
+ */
+#define LTTNG_TEST_RB_NR_EVENTS		\
+	(5 * LTTNG_TEST_RB_SUBBUF_SIZE / (2 * LTTNG_TEST_RB_RECORD_MIN_LEN))
+#define LTTNG_TEST_RB_SEQ_UNKNOWN	UINT_MAX
+
+struct lttng_test_rb_config {
+	uint32_t backend;		/* enum lttng_kernel_abi_backend */
+	bool sticky_vtid;		/* Sticky vtid context */
+	bool ctrl;			/* Read through the stream control area */
+};
+
+struct lttng_test_rb_session {
+	struct file *lttng_file;	/* /proc/lttng */
+	unsigned long scratch;		/* User-space page for ioctl arguments */
+	int session_fd;
+	int channel_fd;
+	int event_fd;
+	int *stream_fd;			/* Indexed by cpu, -1 if none */
+};
+
+union lttng_test_rb_param {
+	struct lttng_kernel_abi_channel channel;
+	struct lttng_kernel_abi_context context;
+	struct lttng_kernel_abi_event event;
+};
+
+/* Mirrors struct packet_header of the ring buffer client. */
+struct lttng_test_rb_packet_header {
+	uint32_t magic;
+	uint8_t uuid[16];
+	uint32_t stream_id;
+	uint64_t stream_instance_id;
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t content_size;
+	uint64_t packet_size;
+	uint64_t packet_seq_num;
+	unsigned long events_discarded;
+	uint32_t cpu_id;
+	uint8_t header_end;
+};
+
+static DEFINE_MUTEX(lttng_test_rb_mutex);
+static u64 lttng_test_rb_page_ns, lttng_test_rb_vmap_ns;
+static struct proc_dir_entry *lttng_test_ring_buffer_dentry;
+
+static
+long lttng_test_rb_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	if (!file->f_op->unlocked_ioctl)
+		return -ENOTTY;
+	return file->f_op->unlocked_ioctl(file, cmd, arg);
+}
+
+static
+long lttng_test_rb_fd_ioctl(int fd, unsigned int cmd, unsigned long arg)
+{
+	struct file *file;
+	long ret;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+	ret = lttng_test_rb_ioctl(file, cmd, arg);
+	fput(file);
+	return ret;
+}
+
+/* Pass @len bytes of @param to the ioctl through the scratch page. */
+static
+long lttng_test_rb_fd_ioctl_in(struct lttng_test_rb_session *s, int fd,
+		unsigned int cmd, const void *param, size_t len)
+{
+	if (copy_to_user((void __user *) s->scratch, param, len))
+		return -EFAULT;
+	return lttng_test_rb_fd_ioctl(fd, cmd, s->scratch);
+}
+
+/* Get @len bytes returned by the ioctl through the scratch page. */
+static
+long lttng_test_rb_fd_ioctl_out(struct lttng_test_rb_session *s, int fd,
+		unsigned int cmd, void *out, size_t len)
+{
+	long ret;
+
+	ret = lttng_test_rb_fd_ioctl(fd, cmd, s->scratch);
+	if (ret)
+		return ret;
+	if (copy_from_user(out, (void __user *) s->scratch, len))
+		return -EFAULT;
+	return 0;
+}
+
+static
+void lttng_test_rb_destroy(struct lttng_test_rb_session *s)
+{
+	unsigned int cpu;
+
+	if (s->stream_fd) {
+		for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+			if (s->stream_fd[cpu] >= 0)
+				lttng_close_fd(s->stream_fd[cpu]);
+		}
+		kfree(s->stream_fd);
+	}
+	if (s->event_fd >= 0)
+		lttng_close_fd(s->event_fd);
+	if (s->channel_fd >= 0)
+		lttng_close_fd(s->channel_fd);
+	if (s->session_fd >= 0)
+		lttng_close_fd(s->session_fd);
+	if (s->scratch)
+		vm_munmap(s->scratch, PAGE_SIZE);
+	if (s->lttng_file)
+		filp_close(s->lttng_file, NULL);
+}
+
+/*
+ * Create and start a session holding a single mmap channel configured by
+ * @cfg, which records lttng_test_ring_buffer_event, and open its streams.
+ */
+static
+long lttng_test_rb_create(struct lttng_test_rb_session *s,
+		const struct lttng_test_rb_config *cfg)
+{
+	union lttng_test_rb_param *param;
+	unsigned long scratch;
+	unsigned int cpu;
+	long ret;
+
+	memset(s, 0, sizeof(*s));
+	s->session_fd = s->channel_fd = s->event_fd = -1;
+	param = kzalloc(sizeof(*param), GFP_KERNEL);
+	s->stream_fd = kmalloc_array(nr_cpu_ids, sizeof(*s->stream_fd),
+			GFP_KERNEL);
+	if (!param || !s->stream_fd) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		s->stream_fd[cpu] = -1;
+	s->lttng_file = filp_open("/proc/lttng", O_RDWR, 0);
+	if (IS_ERR(s->lttng_file)) {
+		ret = PTR_ERR(s->lttng_file);
+		s->lttng_file = NULL;
+		goto error;
+	}
+	scratch = vm_mmap(NULL, 0, PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (IS_ERR_VALUE(scratch)) {
+		ret = (long) scratch;
+		goto error;
+	}
+	s->scratch = scratch;
+
+	ret = lttng_test_rb_ioctl(s->lttng_file, LTTNG_KERNEL_ABI_SESSION, 0);
+	if (ret < 0)
+		goto error;
+	s->session_fd = ret;
+
+	param->channel.subbuf_size = LTTNG_TEST_RB_SUBBUF_SIZE;
+	param->channel.num_subbuf = LTTNG_TEST_RB_NUM_SUBBUF;
+	param->channel.output = LTTNG_KERNEL_ABI_MMAP;
+	param->channel.backend = cfg->backend;
+	param->channel.event_header = LTTNG_KERNEL_ABI_EVENT_HEADER_COMPACT;
+	param->channel.sticky_ctx = cfg->sticky_vtid;
+	ret = lttng_test_rb_fd_ioctl_in(s, s->session_fd,
+			LTTNG_KERNEL_ABI_CHANNEL, &param->channel,
+			sizeof(param->channel));
+	if (ret < 0)
+		goto error;
+	s->channel_fd = ret;
+
+	if (cfg->sticky_vtid) {
+		memset(param, 0, sizeof(*param));
+		param->context.ctx = LTTNG_KERNEL_ABI_CONTEXT_VTID;
+		ret = lttng_test_rb_fd_ioctl_in(s, s->channel_fd,
+				LTTNG_KERNEL_ABI_CONTEXT, &param->context,
+				sizeof(param->context));
+		if (ret)
+			goto error;
+	}
+
+	memset(param, 0, sizeof(*param));
+	strcpy(param->event.name, "lttng_test_ring_buffer_event");
+	param->event.instrumentation = LTTNG_KERNEL_ABI_TRACEPOINT;
+	ret = lttng_test_rb_fd_ioctl_in(s, s->channel_fd,
+			LTTNG_KERNEL_ABI_EVENT, &param->event,
+			sizeof(param->event));
+	if (ret < 0)
+		goto error;
+	s->event_fd = ret;
+	ret = lttng_test_rb_fd_ioctl(s->event_fd, LTTNG_KERNEL_ABI_ENABLE, 0);
+	if (ret)
+		goto error;
+
+	for (;;) {
+		uint64_t id;
+		int fd;
+
+		ret = lttng_test_rb_fd_ioctl(s->channel_fd,
+				LTTNG_KERNEL_ABI_STREAM, 0);
+		if (ret == -ENOENT)
+			break;
+		if (ret < 0)
+			goto error;
+		fd = ret;
+		ret = lttng_test_rb_fd_ioctl_out(s, fd,
+				LTTNG_KERNEL_ABI_RING_BUFFER_INSTANCE_ID,
+				&id, sizeof(id));
+		if (!ret && id >= nr_cpu_ids)
+			ret = -ERANGE;
+		if (ret) {
+			lttng_close_fd(fd);
+			goto error;
+		}
+		s->stream_fd[id] = fd;
+		/* Packets delivered before this are not published. */
+		if (cfg->ctrl) {
+			ret = lttng_test_rb_fd_ioctl(fd,
+					LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT,
+					s->scratch);
+			if (ret)
+				goto error;
+		}
+	}
+
+	ret = lttng_test_rb_fd_ioctl(s->session_fd,
+			LTTNG_KERNEL_ABI_SESSION_START, 0);
+	if (ret)
+		goto error;
+	kfree(param);
+	return 0;
+
+error:
+	kfree(param);
+	lttng_test_rb_destroy(s);
+	return ret;
+}
+
+/*
+ * Record @nr events from a single cpu, which is returned, and the
+ * duration of the burst in @duration.
+ */
+static
+int lttng_test_rb_trace(unsigned int nr, u64 *duration)
+{
+	uint8_t data[LTTNG_TEST_RING_BUFFER_DATA_LEN];
+	unsigned int i, j;
+	ktime_t start;
+	int cpu;
+
+	preempt_disable();
+	cpu = smp_processor_id();
+	start = ktime_get();
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < LTTNG_TEST_RING_BUFFER_DATA_LEN; j++)
+			data[j] = i + j;
+		trace_lttng_test_ring_buffer_event(i, data);
+	}
+	*duration = ktime_to_ns(ktime_sub(ktime_get(), start));
+	preempt_enable();
+	return cpu;
+}
+
+static
+uint32_t lttng_test_rb_read_u32(const char *pkt, size_t offset)
+{
+	uint32_t v;
+
+	memcpy(&v, pkt + offset, sizeof(v));
+	return v;
+}
+
+/*
+ * Decode the records of the packet @seq_num of @len bytes, checking the
+ * payload of each. Their sequence numbers must follow *next_seq, unless it
+ * is LTTNG_TEST_RB_SEQ_UNKNOWN, and *next_seq is updated. A non-zero @vtid
+ * means the records carry the sticky vtid context: the first record must
+ * hold it, so the packet can be decoded on its own.
+ */
+static
+int lttng_test_rb_check_packet(const char *pkt, size_t len, int cpu,
+		uint64_t seq_num, pid_t vtid, uint32_t *next_seq)
+{
+	const struct lttng_test_rb_packet_header *header = (const void *) pkt;
+	size_t offset = offsetof(struct lttng_test_rb_packet_header, header_end);
+	unsigned int nr_records = 0, i;
+
+	if (len < sizeof(*header)
+			|| header->magic != CTF_MAGIC_NUMBER
+			|| header->cpu_id != cpu
+			|| header->packet_seq_num != seq_num
+			|| header->content_size != (uint64_t) len * CHAR_BIT
+			|| header->packet_size != (uint64_t) PAGE_ALIGN(len) * CHAR_BIT
+			|| header->events_discarded) {
+		printk(KERN_WARNING "LTTng test: bad header in packet %llu\n",
+			(unsigned long long) seq_num);
+		return -EIO;
+	}
+	while (offset < len) {
+		uint32_t id, seq;
+
+		offset += lib_ring_buffer_align(offset, lttng_alignof(uint32_t));
+		if (len - offset < LTTNG_TEST_RB_RECORD_MIN_LEN)
+			goto error;
+		/* Compact header: 5-bit event id, 31 for the extended header. */
+#ifdef __BIG_ENDIAN
+		id = (uint8_t) pkt[offset] >> 3;
+#else
+		id = pkt[offset] & 0x1f;
+#endif
+		if (id == 31) {
+			offset += sizeof(uint8_t);
+			offset += lib_ring_buffer_align(offset, lttng_alignof(uint64_t));
+			id = lttng_test_rb_read_u32(pkt, offset);
+			offset += sizeof(uint32_t);
+			offset += lib_ring_buffer_align(offset, lttng_alignof(uint64_t));
+			offset += sizeof(uint64_t);
+		} else {
+			offset += sizeof(uint32_t);
+		}
+		if (id != 0)
+			goto error;
+		if (vtid) {
+			uint8_t sticky;
+
+			offset += lib_ring_buffer_align(offset, lttng_alignof(pid_t));
+			sticky = pkt[offset];
+			offset += sizeof(uint8_t);
+			if (!sticky && !nr_records)
+				goto error;
+			if (sticky) {
+				offset += lib_ring_buffer_align(offset, lttng_alignof(pid_t));
+				if ((pid_t) lttng_test_rb_read_u32(pkt, offset) != vtid)
+					goto error;
+				offset += sizeof(pid_t);
+			}
+		}
+		offset += lib_ring_buffer_align(offset, lttng_alignof(uint32_t));
+		if (offset + sizeof(uint32_t) + LTTNG_TEST_RING_BUFFER_DATA_LEN > len)
+			goto error;
+		seq = lttng_test_rb_read_u32(pkt, offset);
+		offset += sizeof(uint32_t);
+		if (*next_seq != LTTNG_TEST_RB_SEQ_UNKNOWN && seq != *next_seq)
+			goto error;
+		for (i = 0; i < LTTNG_TEST_RING_BUFFER_DATA_LEN; i++) {
+			if ((uint8_t) pkt[offset + i] != (uint8_t) (seq + i))
+				goto error;
+		}
+		offset += LTTNG_TEST_RING_BUFFER_DATA_LEN;
+		*next_seq = seq + 1;
+		nr_records++;
+	}
+	if (!nr_records)
+		goto error;
+	return 0;
+
+error:
+	printk(KERN_WARNING "LTTng test: bad record %u of packet %llu\n",
+		nr_records, (unsigned long long) seq_num);
+	return -EIO;
+}
+
+static
+long lttng_test_rb_copy_packet(unsigned long data_map, unsigned long offset,
+		unsigned long len, char *pkt)
+{
+	if (len > LTTNG_TEST_RB_SUBBUF_SIZE)
+		return -EIO;
+	if (copy_from_user(pkt, (const void __user *) (data_map + offset), len))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Locate packet @index from its control area entry, without holding it.
+ */
+static
+long lttng_test_rb_ctrl_packet(unsigned long ctrl_map, unsigned int index,
+		unsigned long *offset, unsigned long *len)
+{
+	struct lttng_kernel_abi_ring_buffer_ctrl_subbuf __user *uentry;
+	struct lttng_kernel_abi_ring_buffer_ctrl_subbuf entry;
+	uint64_t end;
+
+	uentry = (struct lttng_kernel_abi_ring_buffer_ctrl_subbuf __user *)
+		(ctrl_map + offsetof(struct lttng_kernel_abi_ring_buffer_ctrl, subbuf));
+	uentry += index % LTTNG_TEST_RB_NUM_SUBBUF;
+	if (copy_from_user(&end, &uentry->end, sizeof(end)))
+		return -EFAULT;
+	if (end != (uint64_t) (index + 1) * LTTNG_TEST_RB_SUBBUF_SIZE)
+		return -EAGAIN;
+	/* Read "end" before the rest of the entry. */
+	smp_rmb();
+	if (copy_from_user(&entry, uentry, sizeof(entry)))
+		return -EFAULT;
+	*offset = entry.mmap_offset;
+	*len = entry.data_size;
+	return 0;
+}
+
+/*
+ * Copy packet @index of the stream @fd into @pkt through the data mapping
+ * @data_map, and return its size. It is located through the control area
+ * mapping @ctrl_map if non-zero, or held with GET_NEXT_SUBBUF otherwise.
+ */
+static
+long lttng_test_rb_read_packet(struct lttng_test_rb_session *s, int fd,
+		unsigned long data_map, unsigned long ctrl_map,
+		unsigned int index, char *pkt)
+{
+	unsigned long offset, len;
+	long ret, put_ret;
+
+	if (ctrl_map) {
+		ret = lttng_test_rb_ctrl_packet(ctrl_map, index, &offset, &len);
+		if (!ret)
+			ret = lttng_test_rb_copy_packet(data_map, offset, len, pkt);
+		return ret ? : len;
+	}
+	ret = lttng_test_rb_fd_ioctl(fd,
+			LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF, 0);
+	if (ret)
+		return ret;
+	ret = lttng_test_rb_fd_ioctl_out(s, fd,
+			LTTNG_KERNEL_ABI_RING_BUFFER_GET_MMAP_READ_OFFSET,
+			&offset, sizeof(offset));
+	if (!ret)
+		ret = lttng_test_rb_fd_ioctl_out(s, fd,
+				LTTNG_KERNEL_ABI_RING_BUFFER_GET_SUBBUF_SIZE,
+				&len, sizeof(len));
+	if (!ret)
+		ret = lttng_test_rb_copy_packet(data_map, offset, len, pkt);
+	put_ret = lttng_test_rb_fd_ioctl(fd,
+			LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUF, 0);
+	return ret ? : put_ret ? : len;
+}
+
+/*
+ * Trace a burst of events in a new session configured by @cfg, returning
+ * its duration in @duration, then decode the first packets written by the
+ * burst. With sticky contexts, the first packet is skipped so that the
+ * second one is decoded on its own.
+ */
+static
+long lttng_test_rb_run(const struct lttng_test_rb_config *cfg, u64 *duration)
+{
+	struct lttng_kernel_abi_ring_buffer_ctrl_layout layout;
+	unsigned long data_map = 0, ctrl_map = 0, map_len;
+	struct lttng_test_rb_session s;
+	uint32_t next_seq = 0;
+	struct file *file;
+	unsigned int i;
+	int cpu, fd;
+	char *pkt;
+	long ret;
+
+	pkt = vmalloc(LTTNG_TEST_RB_SUBBUF_SIZE);
+	if (!pkt)
+		return -ENOMEM;
+	ret = lttng_test_rb_create(&s, cfg);
+	if (ret)
+		goto end_free;
+	cpu = lttng_test_rb_trace(LTTNG_TEST_RB_NR_EVENTS, duration);
+	fd = s.stream_fd[cpu];
+	file = fd >= 0 ? fget(fd) : NULL;
+	if (!file) {
+		ret = -ENOENT;
+		goto end_destroy;
+	}
+	ret = lttng_test_rb_fd_ioctl_out(&s, fd,
+			LTTNG_KERNEL_ABI_RING_BUFFER_GET_MMAP_LEN,
+			&map_len, sizeof(map_len));
+	if (ret)
+		goto end_fput;
+	data_map = vm_mmap(file, 0, map_len, PROT_READ, MAP_SHARED, 0);
+	if (IS_ERR_VALUE(data_map)) {
+		ret = (long) data_map;
+		data_map = 0;
+		goto end_fput;
+	}
+	if (cfg->ctrl) {
+		ret = lttng_test_rb_fd_ioctl_out(&s, fd,
+				LTTNG_KERNEL_ABI_RING_BUFFER_GET_CTRL_LAYOUT,
+				&layout, sizeof(layout));
+		if (ret)
+			goto end_fput;
+		ctrl_map = vm_mmap(file, 0, layout.ctrl_len, PROT_READ,
+				MAP_SHARED, layout.ctrl_offset);
+		if (IS_ERR_VALUE(ctrl_map)) {
+			ret = (long) ctrl_map;
+			ctrl_map = 0;
+			goto end_fput;
+		}
+	}
+	if (cfg->sticky_vtid)
+		next_seq = LTTNG_TEST_RB_SEQ_UNKNOWN;
+	for (i = 0; i < LTTNG_TEST_RB_NR_PACKETS; i++) {
+		ret = lttng_test_rb_read_packet(&s, fd, data_map, ctrl_map,
+				i, pkt);
+		if (ret < 0)
+			goto end_fput;
+		if (cfg->sticky_vtid && !i)
+			continue;
+		ret = lttng_test_rb_check_packet(pkt, ret, cpu, i,
+				cfg->sticky_vtid ? task_pid_vnr(current) : 0,
+				&next_seq);
+		if (ret)
+			goto end_fput;
+	}
+	ret = 0;
+
+end_fput:
+	if (ctrl_map)
+		vm_munmap(ctrl_map, layout.ctrl_len);
+	if (data_map)
+		vm_munmap(data_map, map_len);
+	fput(file);
+end_destroy:
+	lttng_test_rb_destroy(&s);
+end_free:
+	vfree(pkt);
+	return ret;
+}
+
+/**
+ * lttng_test_ring_buffer_write - run a ring buffer test
+ * @file: file pointer
+ * @user_buf: user string
+ * @count: length to copy
+ *
+ * Runs the test named by the user string: "sticky", "ctrl" or "vmap".
+ * Returns count on success, -EIO if the packets read back do not match
+ * the recorded events, or another negative error value.
+ */
+static
+ssize_t lttng_test_ring_buffer_write(struct file *file, const char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	struct lttng_test_rb_config cfg = {
+		.backend = LTTNG_KERNEL_ABI_BACKEND_PAGE,
+	};
+	char name[LTTNG_WRITE_COUNT_MAX];
+	u64 page_ns, vmap_ns;
+	long ret;
+
+	if (count >= sizeof(name))
+		return -EINVAL;
+	if (copy_from_user(name, user_buf, count))
+		return -EFAULT;
+	name[count] = '\0';
+	mutex_lock(&lttng_test_rb_mutex);
+	if (sysfs_streq(name, "sticky")) {
+		cfg.sticky_vtid = true;
+		ret = lttng_test_rb_run(&cfg, &page_ns);
+	} else if (sysfs_streq(name, "ctrl")) {
+		cfg.ctrl = true;
+		ret = lttng_test_rb_run(&cfg, &page_ns);
+	} else if (sysfs_streq(name, "vmap")) {
+		ret = lttng_test_rb_run(&cfg, &page_ns);
+		if (!ret) {
+			cfg.backend = LTTNG_KERNEL_ABI_BACKEND_VMAP;
+			ret = lttng_test_rb_run(&cfg, &vmap_ns);
+		}
+		if (!ret) {
+			lttng_test_rb_page_ns = page_ns;
+			lttng_test_rb_vmap_ns = vmap_ns;
+		}
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&lttng_test_rb_mutex);
+	if (ret)
+		return ret;
+	*ppos += count;
+	return count;
+}
+
+/**
+ * lttng_test_ring_buffer_read - report the last backend measurement
+ * @file: file pointer
+ * @user_buf: user string
+ * @count: length to copy
+ *
+ * Reads "<number of events> <page backend ns> <vmap backend ns>", the
+ * duration of the same burst of events recorded by the last "vmap" test
+ * with each backend.
+ */
+static
+ssize_t lttng_test_ring_buffer_read(struct file *file, char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	char buf[64];
+	int len;
+
+	mutex_lock(&lttng_test_rb_mutex);
+	len = scnprintf(buf, sizeof(buf), "%lu %llu %llu\n",
+			(unsigned long) LTTNG_TEST_RB_NR_EVENTS,
+			(unsigned long long) lttng_test_rb_page_ns,
+			(unsigned long long) lttng_test_rb_vmap_ns);
+	mutex_unlock(&lttng_test_rb_mutex);
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,6,0))
+static const struct proc_ops lttng_test_ring_buffer_proc_ops = {
+	.proc_read = lttng_test_ring_buffer_read,
+	.proc_write = lttng_test_ring_buffer_write,
+};
+#else
+static const struct file_operations lttng_test_ring_buffer_proc_ops = {
+	.read = lttng_test_ring_buffer_read,
+	.write = lttng_test_ring_buffer_write,
+};
+#endif
+
+#endif /* LTTNG_TEST_RING_BUFFER */
+
 static
 int __init lttng_test_init(void)
 {
@@ -112,12 +818,27 @@ int __init lttng_test_init(void)
 		ret = -ENOMEM;
 		goto error;
 	}
+#ifdef LTTNG_TEST_RING_BUFFER
+	lttng_test_ring_buffer_dentry =
+			proc_create_data(LTTNG_TEST_RING_BUFFER_FILE,
+				S_IRUSR | S_IWUSR, NULL,
+				&lttng_test_ring_buffer_proc_ops, NULL);
+	if (!lttng_test_ring_buffer_dentry) {
+		printk(KERN_ERR "Error creating LTTng test ring buffer file\n");
+		ret = -ENOMEM;
+		goto error_ring_buffer;
+	}
+#endif
 	ret = __lttng_events_init__lttng_test();
 	if (ret)
 		goto error_events;
 	return ret;
 
 error_events:
+#ifdef LTTNG_TEST_RING_BUFFER
+	remove_proc_entry(LTTNG_TEST_RING_BUFFER_FILE, NULL);
+error_ring_buffer:
+#endif
 	remove_proc_entry(LTTNG_TEST_FILTER_EVENT_FILE, NULL);
 error:
 	return ret;
@@ -131,6 +852,10 @@ void __exit lttng_test_exit(void)
 	__lttng_events_exit__lttng_test();
 	if (lttng_test_filter_event_dentry)
 		remove_proc_entry(LTTNG_TEST_FILTER_EVENT_FILE, NULL);
+#ifdef LTTNG_TEST_RING_BUFFER
+	if (lttng_test_ring_buffer_dentry)
+		remove_proc_entry(LTTNG_TEST_RING_BUFFER_FILE, NULL);
+#endif
 }
 
 module_exit(lttng_test_exit);